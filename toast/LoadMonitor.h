@@ -0,0 +1,172 @@
+// LoadMonitor.h
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+// ==========================================
+// Processing load
+// ==========================================
+//
+// Times each process call on the audio thread against its realtime budget
+// (nFrames / sampleRate) and reports the statistics once per interval of
+// audio. The counters are plain members owned by the audio thread; the only
+// shared state is the enabled flag, so a disabled monitor costs one relaxed
+// atomic load per call and never reads the clock.
+
+enum LoadStat {
+  kLoadBlocks = 0,     // process calls in the interval
+  kLoadAverageMicros,  // time per call
+  kLoadMinMicros,
+  kLoadMaxMicros,
+  kLoadAveragePercent, // time over realtime budget, all calls together
+  kLoadMaxPercent,     // the call that used the most of its own budget
+  kLoadXrunRiskBlocks, // calls over kXrunRiskPercent of their budget
+  kLoadSpikeBlocks,    // calls over kSpikeRatio times the recent cost
+  kNumLoadStats
+};
+
+class LoadMonitor {
+public:
+  // A single instance using this much of the budget leaves the host and
+  // every other plugin on the track too little to finish in time
+  static constexpr float kXrunRiskPercent = 50.0f;
+
+  // A call this many times the recent cost per frame is a spike: the
+  // signature of denormals in a decaying tail (or of preemption)
+  static constexpr double kSpikeRatio = 4.0;
+
+  // Calls shorter than this are too noisy to judge a spike by
+  static constexpr int kMinSpikeFrames = 16;
+
+  // Calls that set the reference cost before spikes are counted
+  static constexpr int kSpikeWarmupBlocks = 16;
+
+  // Any thread. Off by default; each enable starts a new interval.
+  void SetEnabled(bool enabled) {
+    mEnabled.store(enabled, std::memory_order_relaxed);
+  }
+
+  // Not concurrent with the audio thread (from OnReset)
+  void SetSampleRate(double sampleRate, double reportSeconds) {
+    mSampleRate = sampleRate;
+    mReportFrames =
+        std::max<int64_t>(1, (int64_t)(sampleRate * reportSeconds));
+    mRunning = false;
+  }
+
+  // Audio thread, at the start of a process call
+  void BeginBlock() {
+    if (!mEnabled.load(std::memory_order_relaxed)) {
+      mRunning = false;
+      return;
+    }
+    if (!mRunning) {
+      mRunning = true;
+      mAverageNanosPerFrame = 0.0;
+      mSpikeWarmup = kSpikeWarmupBlocks;
+      StartInterval();
+    }
+    mStart = Clock::now();
+    mTiming = true;
+  }
+
+  // Audio thread, at the end of the call BeginBlock started. Returns true
+  // when the interval is complete, with its statistics in stats (indexed
+  // by LoadStat).
+  bool EndBlock(int nFrames, float* stats) {
+    if (!mTiming) {
+      return false;
+    }
+    mTiming = false;
+    const double nanos =
+        (double)std::chrono::duration_cast<std::chrono::nanoseconds>(
+            Clock::now() - mStart)
+            .count();
+
+    const double budget = nFrames * 1e9 / mSampleRate;
+    const double percent = budget > 0.0 ? 100.0 * nanos / budget : 0.0;
+
+    mBlocks++;
+    mFrames += nFrames;
+    mTotalNanos += nanos;
+    mMinNanos = std::min(mMinNanos, nanos);
+    mMaxNanos = std::max(mMaxNanos, nanos);
+    mMaxPercent = std::max(mMaxPercent, percent);
+    if (percent > kXrunRiskPercent) {
+      mXrunRiskBlocks++;
+    }
+
+    if (nFrames >= kMinSpikeFrames) {
+      const double perFrame = nanos / nFrames;
+      if (mSpikeWarmup > 0) {
+        // The first calls run from cold caches: a plain average
+        mSpikeWarmup--;
+        mAverageNanosPerFrame +=
+            (perFrame - mAverageNanosPerFrame) /
+            (kSpikeWarmupBlocks - mSpikeWarmup);
+      } else {
+        if (perFrame > kSpikeRatio * mAverageNanosPerFrame) {
+          mSpikeBlocks++;
+        }
+        // Spikes are clipped so they do not raise the reference, while a
+        // lasting change (a higher oversampling setting) is followed
+        const double clipped =
+            std::min(perFrame, kSpikeRatio * mAverageNanosPerFrame);
+        mAverageNanosPerFrame += (clipped - mAverageNanosPerFrame) / 16.0;
+      }
+    }
+
+    if (mFrames < mReportFrames) {
+      return false;
+    }
+    const double intervalBudget = mFrames * 1e9 / mSampleRate;
+    stats[kLoadBlocks] = (float)mBlocks;
+    stats[kLoadAverageMicros] = (float)(mTotalNanos / mBlocks * 1e-3);
+    stats[kLoadMinMicros] = (float)(mMinNanos * 1e-3);
+    stats[kLoadMaxMicros] = (float)(mMaxNanos * 1e-3);
+    stats[kLoadAveragePercent] = (float)(100.0 * mTotalNanos / intervalBudget);
+    stats[kLoadMaxPercent] = (float)mMaxPercent;
+    stats[kLoadXrunRiskBlocks] = (float)mXrunRiskBlocks;
+    stats[kLoadSpikeBlocks] = (float)mSpikeBlocks;
+    StartInterval();
+    return true;
+  }
+
+private:
+  using Clock = std::chrono::steady_clock;
+
+  void StartInterval() {
+    mBlocks = 0;
+    mFrames = 0;
+    mTotalNanos = 0.0;
+    mMinNanos = 1e300;
+    mMaxNanos = 0.0;
+    mMaxPercent = 0.0;
+    mXrunRiskBlocks = 0;
+    mSpikeBlocks = 0;
+  }
+
+  std::atomic<bool> mEnabled{false};
+
+  double mSampleRate = 44100.0;
+  int64_t mReportFrames = 44100;
+
+  // Audio thread only
+  bool mRunning = false;
+  bool mTiming = false;
+  Clock::time_point mStart;
+  double mAverageNanosPerFrame = 0.0;
+  int mSpikeWarmup = 0;
+
+  int mBlocks = 0;
+  int64_t mFrames = 0;
+  double mTotalNanos = 0.0;
+  double mMinNanos = 1e300;
+  double mMaxNanos = 0.0;
+  double mMaxPercent = 0.0;
+  int mXrunRiskBlocks = 0;
+  int mSpikeBlocks = 0;
+};
@@ -0,0 +1,290 @@
+// Metering.h
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+
+#include "SIMD.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+// ==========================================
+// Level meters
+// ==========================================
+//
+// Meter collects input and output levels of a channel pair on the audio
+// thread and emits one MeterFrame per interval of audio (the UI frame
+// rate); a MeterQueue hands the frames to the UI thread without locks.
+// Levels are linear amplitudes.
+
+struct MeterFrame {
+  float inputPeak[2];
+  float inputRms[2];
+  float outputPeak[2];
+  float outputRms[2];
+  // Output peak between the samples (4x interpolated), at least the
+  // sample peak
+  float outputTruePeak[2];
+  // THD modulation: the envelope above the threshold and the THD amount
+  // it drove, both 0 - 1 and the largest of the interval
+  float thdEnvelope;
+  float thdAmount;
+};
+
+// Single-producer / single-consumer ring. Push from one thread and Pop from
+// another, never blocking; a full queue drops the new item.
+template <typename T, int kCapacity> class MeterQueue {
+  static_assert((kCapacity & (kCapacity - 1)) == 0,
+                "capacity is a power of two");
+
+public:
+  bool Push(const T& item) {
+    const uint32_t write = mWrite.load(std::memory_order_relaxed);
+    if (write - mRead.load(std::memory_order_acquire) == kCapacity) {
+      return false;
+    }
+    mItems[write & (kCapacity - 1)] = item;
+    mWrite.store(write + 1, std::memory_order_release);
+    return true;
+  }
+
+  bool Pop(T& item) {
+    const uint32_t read = mRead.load(std::memory_order_relaxed);
+    if (read == mWrite.load(std::memory_order_acquire)) {
+      return false;
+    }
+    item = mItems[read & (kCapacity - 1)];
+    mRead.store(read + 1, std::memory_order_release);
+    return true;
+  }
+
+private:
+  T mItems[kCapacity];
+  std::atomic<uint32_t> mWrite{0};
+  std::atomic<uint32_t> mRead{0};
+};
+
+// Folds frame, the count-th of a run of frames, into merged (a copy of the
+// first): the largest peaks, and the RMS over the whole run, the frames
+// covering equal intervals
+inline void MergeMeterFrames(MeterFrame& merged, const MeterFrame& frame,
+                             int count) {
+  auto rms = [count](float total, float next) {
+    return std::sqrt((total * total * (count - 1) + next * next) / count);
+  };
+  for (int c = 0; c < 2; c++) {
+    merged.inputPeak[c] = std::max(merged.inputPeak[c], frame.inputPeak[c]);
+    merged.inputRms[c] = rms(merged.inputRms[c], frame.inputRms[c]);
+    merged.outputPeak[c] = std::max(merged.outputPeak[c], frame.outputPeak[c]);
+    merged.outputRms[c] = rms(merged.outputRms[c], frame.outputRms[c]);
+    merged.outputTruePeak[c] =
+        std::max(merged.outputTruePeak[c], frame.outputTruePeak[c]);
+  }
+  merged.thdEnvelope = std::max(merged.thdEnvelope, frame.thdEnvelope);
+  merged.thdAmount = std::max(merged.thdAmount, frame.thdAmount);
+}
+
+class Meter {
+public:
+  static constexpr int kMaxChannels = 2;
+
+  // True-peak interpolation: 4x, kTruePeakTaps input samples per output.
+  // The windowed-sinc filter reads within 0.3 dB of the true peak of a
+  // sine up to 21 kHz at 48 kHz.
+  static constexpr int kTruePeakPhases = 4;
+  static constexpr int kTruePeakTaps = 12;
+
+  // Blocks are interpolated in chunks of this many samples; a chunk too
+  // quiet to exceed the peak already found is skipped
+  static constexpr int kTruePeakChunk = 32;
+
+  Meter() {
+    // Blackman-windowed sinc, centred between input samples so the four
+    // phases fall between them (the samples themselves are the sample
+    // peak); each phase normalized to unity gain at DC
+    constexpr int length = kTruePeakPhases * kTruePeakTaps;
+    constexpr double centre = (length - 1) * 0.5;
+    for (int p = 0; p < kTruePeakPhases; p++) {
+      double sum = 0.0;
+      double taps[kTruePeakTaps];
+      for (int k = 0; k < kTruePeakTaps; k++) {
+        const int n = k * kTruePeakPhases + p;
+        const double x = (n - centre) / kTruePeakPhases;
+        const double sinc = std::sin(M_PI * x) / (M_PI * x);
+        const double phase = 2.0 * M_PI * (n + 0.5) / length;
+        const double w =
+            0.42 - 0.5 * std::cos(phase) + 0.08 * std::cos(2.0 * phase);
+        taps[k] = sinc * w;
+        sum += taps[k];
+      }
+      double gain = 0.0;
+      for (int k = 0; k < kTruePeakTaps; k++) {
+        mTruePeakCoefficients[k][p] = (float)(taps[k] / sum);
+        gain += std::abs(taps[k] / sum);
+      }
+      mTruePeakGain = std::max(mTruePeakGain, (float)gain);
+    }
+    StartFrame();
+  }
+
+  // Allocation-free. frameSeconds is the interval of audio per frame.
+  void Reset(double sampleRate, double frameSeconds) {
+    mFrameLength = std::max(1, (int)(sampleRate * frameSeconds));
+    for (int c = 0; c < kMaxChannels; c++) {
+      std::fill(mHistory[c], mHistory[c] + 2 * kTruePeakTaps, 0.0f);
+      mHistoryPos[c] = 0;
+    }
+    StartFrame();
+  }
+
+  // Before the block is processed (the output may overwrite the input).
+  // nChans is 0 - 2; a single channel is shown on both sides.
+  void AddInput(const double* const* inputs, int nChans, int nFrames) {
+    for (int c = 0; c < std::min(nChans, kMaxChannels); c++) {
+      PeakAndPower(inputs[c], nFrames, mInputPeak[c], mInputPower[c]);
+    }
+  }
+
+  void AddOutput(const double* const* outputs, int nChans, int nFrames) {
+    mNumChannels = std::min(nChans, kMaxChannels);
+    for (int c = 0; c < mNumChannels; c++) {
+      PeakAndPower(outputs[c], nFrames, mOutputPeak[c], mOutputPower[c]);
+      const float peak = std::max(mTruePeak[c], (float)mOutputPeak[c]);
+      mTruePeak[c] = TruePeak(outputs[c], nFrames, c, peak);
+    }
+  }
+
+  // Once per block, after AddOutput, with the THD modulation at its end.
+  // Returns true when the interval is complete, with the frame in frame.
+  bool EndBlock(int nFrames, float thdEnvelope, float thdAmount,
+                MeterFrame& frame) {
+    mThdEnvelope = std::max(mThdEnvelope, thdEnvelope);
+    mThdAmount = std::max(mThdAmount, thdAmount);
+    mFrames += nFrames;
+    if (mFrames < mFrameLength) {
+      return false;
+    }
+    for (int c = 0; c < kMaxChannels; c++) {
+      const int source = mNumChannels == 1 ? 0 : c;
+      frame.inputPeak[c] = (float)mInputPeak[source];
+      frame.inputRms[c] = (float)std::sqrt(mInputPower[source] / mFrames);
+      frame.outputPeak[c] = (float)mOutputPeak[source];
+      frame.outputRms[c] = (float)std::sqrt(mOutputPower[source] / mFrames);
+      frame.outputTruePeak[c] = mTruePeak[source];
+    }
+    frame.thdEnvelope = mThdEnvelope;
+    frame.thdAmount = mThdAmount;
+    StartFrame();
+    return true;
+  }
+
+private:
+  void StartFrame() {
+    mFrames = 0;
+    for (int c = 0; c < kMaxChannels; c++) {
+      mInputPeak[c] = mInputPower[c] = 0.0;
+      mOutputPeak[c] = mOutputPower[c] = 0.0;
+      mTruePeak[c] = 0.0f;
+    }
+    mThdEnvelope = 0.0f;
+    mThdAmount = 0.0f;
+  }
+
+  // Peak magnitude and sum of squares, four samples per step in two
+  // registers of two lanes
+  static void PeakAndPower(const double* x, int n, double& peak,
+                           double& power) {
+    Double2 peak0(0.0), peak1(0.0);
+    Double2 power0(0.0), power1(0.0);
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+      const Double2 a = Double2::Load(x + i);
+      const Double2 b = Double2::Load(x + i + 2);
+      const Double2 absA = Abs(a);
+      const Double2 absB = Abs(b);
+      peak0 = Select(absA > peak0, absA, peak0);
+      peak1 = Select(absB > peak1, absB, peak1);
+      power0 += a * a;
+      power1 += b * b;
+    }
+    const Double2 peaks = Select(peak1 > peak0, peak1, peak0);
+    const Double2 powers = power0 + power1;
+    double lanes[2];
+    peaks.Store(lanes);
+    double blockPeak = std::max(lanes[0], lanes[1]);
+    powers.Store(lanes);
+    double blockPower = lanes[0] + lanes[1];
+    for (; i < n; i++) {
+      blockPeak = std::max(blockPeak, std::abs(x[i]));
+      blockPower += x[i] * x[i];
+    }
+    peak = std::max(peak, blockPeak);
+    power += blockPower;
+  }
+
+  // The larger of peak and the largest 4x-interpolated magnitude of
+  // channel c's block. The history holds each sample twice, newest first,
+  // so the taps of any position are contiguous; the four phases are the
+  // four lanes. No interpolated value exceeds mTruePeakGain times the
+  // largest of its taps, so a chunk below peak / mTruePeakGain, with the
+  // taps before it, only enters the history.
+  float TruePeak(const double* x, int n, int c, float peak) {
+    float* history = mHistory[c];
+    int pos = mHistoryPos[c];
+    Float4 peaks(peak);
+    for (int start = 0; start < n; start += kTruePeakChunk) {
+      const int end = std::min(n, start + kTruePeakChunk);
+      float bound = 0.0f;
+      for (int k = 0; k < kTruePeakTaps; k++) {
+        bound = std::max(bound, std::abs(history[pos + k]));
+      }
+      for (int i = start; i < end; i++) {
+        bound = std::max(bound, (float)std::abs(x[i]));
+      }
+      if (bound * mTruePeakGain <= peak) {
+        for (int i = std::max(start, end - kTruePeakTaps); i < end; i++) {
+          pos = pos == 0 ? kTruePeakTaps - 1 : pos - 1;
+          history[pos] = history[pos + kTruePeakTaps] = (float)x[i];
+        }
+        continue;
+      }
+      for (int i = start; i < end; i++) {
+        pos = pos == 0 ? kTruePeakTaps - 1 : pos - 1;
+        history[pos] = history[pos + kTruePeakTaps] = (float)x[i];
+        Float4 sum(0.0f);
+        for (int k = 0; k < kTruePeakTaps; k++) {
+          sum += Float4(history[pos + k]) *
+                 Float4::Load(mTruePeakCoefficients[k]);
+        }
+        const Float4 magnitude = Abs(sum);
+        peaks = Select(magnitude > peaks, magnitude, peaks);
+      }
+      alignas(16) float lanes[4];
+      peaks.Store(lanes);
+      peak = std::max(std::max(lanes[0], lanes[1]),
+                      std::max(lanes[2], lanes[3]));
+    }
+    mHistoryPos[c] = pos;
+    return peak;
+  }
+
+  alignas(16) float mTruePeakCoefficients[kTruePeakTaps][kTruePeakPhases];
+  float mTruePeakGain = 0.0f;
+  float mHistory[kMaxChannels][2 * kTruePeakTaps] = {};
+  int mHistoryPos[kMaxChannels] = {};
+
+  int mFrameLength = 735;
+  int mFrames = 0;
+  int mNumChannels = 0;
+  double mInputPeak[kMaxChannels];
+  double mInputPower[kMaxChannels];
+  double mOutputPeak[kMaxChannels];
+  double mOutputPower[kMaxChannels];
+  float mTruePeak[kMaxChannels];
+  float mThdEnvelope;
+  float mThdAmount;
+};
@@ -0,0 +1,486 @@
+// Oversampling.h
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+
+#include "Denormals.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+// ==========================================
+// Polyphase 2x halfband stages
+// ==========================================
+//
+// Both stage types are templated on the lane type V (float, double or
+// their SIMD lanes) so one instance carries the state of every channel in
+// a SIMD register. The coefficients stay float in either precision.
+// Each stage is used in one direction only: an upsampler and a
+// downsampler each need their own instance.
+
+// IIR halfband built from two chains of first-order allpass sections
+// (even coefficients on path 0, odd on path 1). Near-minimum phase; its
+// low-frequency group delay, rounded, is reported as latency.
+template <typename V> class PolyphaseIIR2x {
+public:
+  static constexpr int kMaxCoefs = 12;
+
+  void SetCoefficients(const float* coefs, int numCoefs) {
+    mNumCoefs = numCoefs;
+    for (int i = 0; i < numCoefs; i++)
+      mCoefs[i] = coefs[i];
+    Reset();
+  }
+
+  // Settled on a constant input (an allpass passes DC unchanged)
+  void Reset(V input = V(0.0f)) {
+    for (int i = 0; i < kMaxCoefs; i++) {
+      mX[i] = input;
+      mY[i] = input;
+    }
+  }
+
+  // Decayed allpass states to exact zero (see Denormals.h)
+  void FlushDenormals() {
+    for (int i = 0; i < mNumCoefs; i++) {
+      mX[i] = FlushDenormal(mX[i]);
+      mY[i] = FlushDenormal(mY[i]);
+    }
+  }
+
+  // The state as if every input so far had been lower by amount: the
+  // output drops by the same amount
+  void Shift(V amount) {
+    for (int i = 0; i < mNumCoefs; i++) {
+      mX[i] = mX[i] - amount;
+      mY[i] = mY[i] - amount;
+    }
+  }
+
+  void Upsample(V input, V& out0, V& out1) {
+    V path0 = input;
+    V path1 = input;
+    ProcessPaths(path0, path1);
+    out0 = path0;
+    out1 = path1;
+  }
+
+  V Downsample(V in0, V in1) {
+    V path0 = in1;
+    V path1 = in0;
+    ProcessPaths(path0, path1);
+    return (path0 + path1) * 0.5f;
+  }
+
+private:
+  void ProcessPaths(V& path0, V& path1) {
+    for (int i = 0; i < mNumCoefs; i += 2) {
+      V out0 = (path0 - mY[i]) * mCoefs[i] + mX[i];
+      mX[i] = path0;
+      mY[i] = out0;
+      path0 = out0;
+
+      if (i + 1 < mNumCoefs) {
+        V out1 = (path1 - mY[i + 1]) * mCoefs[i + 1] + mX[i + 1];
+        mX[i + 1] = path1;
+        mY[i + 1] = out1;
+        path1 = out1;
+      }
+    }
+  }
+
+  int mNumCoefs = 0;
+  float mCoefs[kMaxCoefs] = {};
+  V mX[kMaxCoefs];
+  V mY[kMaxCoefs];
+};
+
+// Linear-phase FIR halfband (length 2 * numBranchTaps - 1). Only the
+// non-trivial polyphase branch is stored; the other branch is the 0.5
+// centre tap, i.e. a plain delay.
+template <typename V> class HalfbandFIR2x {
+public:
+  static constexpr int kMaxBranchTaps = 64;
+
+  void SetCoefficients(const float* branch, int numBranchTaps) {
+    mNumTaps = numBranchTaps;
+    for (int i = 0; i < numBranchTaps; i++)
+      mBranch[i] = branch[i];
+    Reset();
+  }
+
+  // History filled with a constant input
+  void Reset(V input = V(0.0f)) {
+    mPos = 0;
+    for (int i = 0; i < 2 * mNumTaps; i++) {
+      mOdd[i] = input;
+      mEven[i] = input;
+    }
+  }
+
+  // Latency in samples at the higher rate, for one direction
+  int GetLatency() const { return mNumTaps - 1; }
+
+  void Upsample(V input, V& out0, V& out1) {
+    const V* history = Push(mOdd, input);
+    V acc = 0.0f;
+    for (int j = 0; j < mNumTaps; j++)
+      acc += history[mNumTaps - j] * mBranch[j];
+    out0 = acc * 2.0f;
+    out1 = history[mNumTaps / 2 + 1];
+    Advance();
+  }
+
+  V Downsample(V in0, V in1) {
+    const V* even = Push(mEven, in0);
+    const V* odd = Push(mOdd, in1);
+    V acc = odd[mNumTaps / 2] * 0.5f;
+    for (int j = 0; j < mNumTaps; j++)
+      acc += even[mNumTaps - j] * mBranch[j];
+    Advance();
+    return acc;
+  }
+
+private:
+  // Writes the newest sample twice so the last mNumTaps samples are
+  // always contiguous: returned[mNumTaps - j] is x[n - j]
+  const V* Push(V* buffer, V input) {
+    buffer[mPos] = input;
+    buffer[mPos + mNumTaps] = input;
+    return buffer + mPos;
+  }
+
+  void Advance() {
+    if (++mPos == mNumTaps)
+      mPos = 0;
+  }
+
+  int mNumTaps = 0;
+  int mPos = 0;
+  float mBranch[kMaxBranchTaps] = {};
+  V mOdd[2 * kMaxBranchTaps];
+  V mEven[2 * kMaxBranchTaps];
+};
+
+// ==========================================
+// Filter design (not realtime; run once per process, see HalfbandDesigns)
+// ==========================================
+
+// Zeroth-order modified Bessel function, for the Kaiser window
+inline double BesselI0(double x) {
+  double sum = 1.0;
+  double term = 1.0;
+  for (int k = 1; k < 50; k++) {
+    term *= (x / (2.0 * k)) * (x / (2.0 * k));
+    sum += term;
+    if (term < sum * 1e-12)
+      break;
+  }
+  return sum;
+}
+
+// Kaiser-windowed sinc halfband; fills the non-trivial polyphase branch
+inline void DesignHalfbandFIR(float* branch, int numBranchTaps,
+                              double attenuationDb) {
+  const int length = 2 * numBranchTaps - 1;
+  const int centre = numBranchTaps - 1;
+  const double beta = 0.1102 * (attenuationDb - 8.7);
+
+  double sum = 0.0;
+  double taps[HalfbandFIR2x<float>::kMaxBranchTaps];
+  for (int j = 0; j < numBranchTaps; j++) {
+    const int k = 2 * j;
+    const double offset = k - centre;
+    const double ratio = 2.0 * k / (length - 1) - 1.0;
+    const double window =
+        BesselI0(beta * std::sqrt(1.0 - ratio * ratio)) / BesselI0(beta);
+    const double sinc = std::sin(M_PI * offset / 2.0) / (M_PI * offset / 2.0);
+    taps[j] = 0.5 * sinc * window;
+    sum += taps[j];
+  }
+
+  // Unity gain at DC through the branch (the centre tap supplies the rest)
+  for (int j = 0; j < numBranchTaps; j++)
+    branch[j] = (float)(taps[j] * 0.5 / sum);
+}
+
+// Allpass coefficients for the polyphase IIR halfband, from the elliptic
+// filter closed form (Valenzuela & Constantinides). transitionBw is the
+// normalised transition bandwidth (0 - 0.5).
+inline void DesignHalfbandIIR(float* coefs, int numCoefs,
+                              double transitionBw) {
+  const int order = numCoefs * 2 + 1;
+
+  double k = std::tan((1.0 - transitionBw * 2.0) * M_PI / 4.0);
+  k *= k;
+  const double kksqrt = std::pow(1.0 - k * k, 0.25);
+  const double e = 0.5 * (1.0 - kksqrt) / (1.0 + kksqrt);
+  const double e4 = e * e * e * e;
+  const double q = e * (1.0 + e4 * (2.0 + e4 * (15.0 + 150.0 * e4)));
+
+  for (int index = 0; index < numCoefs; index++) {
+    const int c = index + 1;
+
+    double num = 0.0;
+    double sign = 1.0;
+    for (int i = 0; i < 32; i++) {
+      const double term = std::pow(q, (double)(i * (i + 1))) *
+                          std::sin((i * 2 + 1) * c * M_PI / order) * sign;
+      num += term;
+      sign = -sign;
+      if (std::abs(term) < 1e-100)
+        break;
+    }
+    num *= std::pow(q, 0.25);
+
+    double den = 0.0;
+    sign = -1.0;
+    for (int i = 1; i < 32; i++) {
+      const double term = std::pow(q, (double)(i * i)) *
+                          std::cos(i * 2 * c * M_PI / order) * sign;
+      den += term;
+      sign = -sign;
+      if (std::abs(term) < 1e-100)
+        break;
+    }
+    den += 0.5;
+
+    const double ww = num / den;
+    const double wwsq = ww * ww;
+    const double x = std::sqrt((1.0 - wwsq * k) * (1.0 - wwsq / k)) / (1.0 + wwsq);
+    coefs[index] = (float)((1.0 - x) / (1.0 + x));
+  }
+}
+
+// ==========================================
+// Oversampler: 1x / 2x / 4x / 8x cascade of halfband stages
+// ==========================================
+enum OversamplingFilter {
+  kMinimumPhaseIIR = 0, // Non-linear phase, 5 - 7 samples of latency
+  kLinearPhaseFIR       // Linear phase, 63 - 74 samples of latency
+};
+
+// Per-stage halfband designs, stage 0 being the one next to the base rate.
+// They do not depend on the sample rate, so they are designed once per
+// process and shared by every Oversampler.
+struct HalfbandDesigns {
+  static constexpr int kMaxStages = 3;
+  static constexpr int kIIRCoefs[kMaxStages] = {12, 6, 4};
+  static constexpr double kIIRTransition[kMaxStages] = {0.04, 0.18, 0.3};
+  static constexpr int kFIRBranchTaps[kMaxStages] = {64, 16, 12};
+  static constexpr double kFIRAttenuationDb = 96.0;
+
+  float iir[kMaxStages][PolyphaseIIR2x<float>::kMaxCoefs];
+  float fir[kMaxStages][HalfbandFIR2x<float>::kMaxBranchTaps];
+
+  // Group delay at DC of the IIR stage's up- and downsampler together, in
+  // samples at the base rate. A section with coefficient a delays DC by
+  // 2 (1 - a) / (1 + a) samples at twice the stage's input rate; the two
+  // paths are averaged, for each of the two filters.
+  double iirGroupDelay[kMaxStages];
+
+  static const HalfbandDesigns& Get() {
+    static const HalfbandDesigns designs;
+    return designs;
+  }
+
+private:
+  HalfbandDesigns() {
+    for (int s = 0; s < kMaxStages; s++) {
+      DesignHalfbandIIR(iir[s], kIIRCoefs[s], kIIRTransition[s]);
+      DesignHalfbandFIR(fir[s], kFIRBranchTaps[s], kFIRAttenuationDb);
+
+      iirGroupDelay[s] = 0.0;
+      for (int i = 0; i < kIIRCoefs[s]; i++)
+        iirGroupDelay[s] += (1.0 - iir[s][i]) / (1.0 + iir[s][i]);
+      iirGroupDelay[s] /= (double)(1 << s);
+    }
+  }
+};
+
+template <typename V> class Oversampler {
+public:
+  using Filter = OversamplingFilter;
+
+  static constexpr int kMaxStages = HalfbandDesigns::kMaxStages;
+
+  // Every stage keeps its coefficients; Setup only picks the stages
+  Oversampler() {
+    const HalfbandDesigns& designs = HalfbandDesigns::Get();
+    for (int s = 0; s < kMaxStages; s++) {
+      mIIRUp[s].SetCoefficients(designs.iir[s], HalfbandDesigns::kIIRCoefs[s]);
+      mIIRDown[s].SetCoefficients(designs.iir[s], HalfbandDesigns::kIIRCoefs[s]);
+      mFIRUp[s].SetCoefficients(designs.fir[s], HalfbandDesigns::kFIRBranchTaps[s]);
+      mFIRDown[s].SetCoefficients(designs.fir[s], HalfbandDesigns::kFIRBranchTaps[s]);
+    }
+    Setup(0, kMinimumPhaseIIR);
+  }
+
+  // numStages: 0 (off), 1 (2x), 2 (4x) or 3 (8x)
+  void Setup(int numStages, Filter filter) {
+    mNumStages = std::max(0, std::min(numStages, kMaxStages));
+    mFilter = filter;
+    mPadLength = PadLength(mNumStages, mFilter);
+    Reset();
+  }
+
+  // coreOutput is what the core returns for silence: the downsampling
+  // side starts settled on it, the upsampling side on silence. Only the
+  // stages in use are touched; Setup resets any it switches in.
+  void Reset(V coreOutput = V(0.0f)) {
+    for (int s = 0; s < mNumStages; s++) {
+      if (mFilter == kLinearPhaseFIR) {
+        mFIRUp[s].Reset();
+        mFIRDown[s].Reset(coreOutput);
+      } else {
+        mIIRUp[s].Reset();
+        mIIRDown[s].Reset();
+      }
+    }
+    for (int i = 0; i < kMaxPad; i++)
+      mPad[i] = coreOutput;
+    mPadPos = 0;
+    mCoreOutput = coreOutput;
+    mOffset = coreOutput;
+    mRecenterPhase = 0;
+  }
+
+  // Call between blocks; only the IIR stages hold recursive state
+  void FlushDenormals() {
+    if (mFilter == kLinearPhaseFIR)
+      return;
+    for (int s = 0; s < mNumStages; s++) {
+      mIIRUp[s].FlushDenormals();
+      mIIRDown[s].FlushDenormals();
+    }
+  }
+
+  int GetNumStages() const { return mNumStages; }
+  int GetFactor() const { return 1 << mNumStages; }
+  Filter GetFilter() const { return mFilter; }
+
+  // Round-trip latency at the base rate: exact for the FIR, the rounded
+  // low-frequency group delay for the IIR (its impulse peaks a sample or
+  // so later)
+  int GetLatency() const { return Latency(mNumStages, mFilter); }
+
+  static int Latency(int numStages, Filter filter) {
+    return (int)std::lround(Delay(numStages, filter));
+  }
+
+  // The same before rounding, for adding to other fractional delays
+  static double Delay(int numStages, Filter filter) {
+    numStages = std::max(0, std::min(numStages, kMaxStages));
+    if (filter != kLinearPhaseFIR) {
+      const HalfbandDesigns& designs = HalfbandDesigns::Get();
+      double delay = 0.0;
+      for (int s = 0; s < numStages; s++)
+        delay += designs.iirGroupDelay[s];
+      return delay;
+    }
+    return (HighRateLatency(numStages, filter) + PadLength(numStages, filter)) >>
+           numStages;
+  }
+
+  // Runs core(V) once per oversampled frame and returns the decimated
+  // result for one base-rate frame
+  template <typename Core> V Process(V input, Core& core) {
+    if (mNumStages == 0)
+      return core(input);
+    if (mFilter == kLinearPhaseFIR)
+      return ProcessStage(0, input, core);
+    const V output = ProcessStage(0, input, core) + mOffset;
+    if (++mRecenterPhase == kRecenterInterval)
+      Recenter();
+    return output;
+  }
+
+private:
+  static constexpr int kMaxPad = 8;
+
+  // The IIR downsamplers run on the core output less mOffset, added back
+  // after. On a constant core output (the THD's bias in silence) they
+  // would otherwise hold their rounding error in a limit cycle at Nyquist,
+  // about an epsilon of the constant, where it is never flushed. Every
+  // kRecenterInterval base-rate frames (counted across blocks, so the
+  // output does not depend on their sizes) the offset moves to the last
+  // core output and the states shift with it, leaving the output as it was.
+  static constexpr int kRecenterInterval = 64;
+
+  void Recenter() {
+    const V shift = mCoreOutput - mOffset;
+    for (int s = 0; s < mNumStages; s++)
+      mIIRDown[s].Shift(shift);
+    mOffset = mCoreOutput;
+    mRecenterPhase = 0;
+  }
+
+  template <typename Core> V ProcessStage(int stage, V input, Core& core) {
+    V a, b;
+    if (mFilter == kLinearPhaseFIR)
+      mFIRUp[stage].Upsample(input, a, b);
+    else
+      mIIRUp[stage].Upsample(input, a, b);
+
+    if (stage + 1 == mNumStages) {
+      a = Pad(core(a));
+      b = Pad(core(b));
+      if (mFilter != kLinearPhaseFIR) {
+        mCoreOutput = b;
+        a = a - mOffset;
+        b = b - mOffset;
+      }
+    } else {
+      a = ProcessStage(stage + 1, a, core);
+      b = ProcessStage(stage + 1, b, core);
+    }
+
+    if (mFilter == kLinearPhaseFIR)
+      return mFIRDown[stage].Downsample(a, b);
+    return mIIRDown[stage].Downsample(a, b);
+  }
+
+  // Delay at the highest rate that rounds the FIR latency up to a whole
+  // number of base-rate samples, so the dry path can be aligned exactly
+  V Pad(V input) {
+    if (mPadLength == 0)
+      return input;
+    V output = mPad[mPadPos];
+    mPad[mPadPos] = input;
+    if (++mPadPos == mPadLength)
+      mPadPos = 0;
+    return output;
+  }
+
+  static int HighRateLatency(int numStages, Filter filter) {
+    if (filter != kLinearPhaseFIR)
+      return 0;
+    int latency = 0;
+    for (int s = 0; s < numStages; s++)
+      latency += 2 * (HalfbandDesigns::kFIRBranchTaps[s] - 1) << (numStages - 1 - s);
+    return latency;
+  }
+
+  static int PadLength(int numStages, Filter filter) {
+    const int factor = 1 << numStages;
+    return (factor - HighRateLatency(numStages, filter) % factor) % factor;
+  }
+
+  int mNumStages = 0;
+  Filter mFilter = kMinimumPhaseIIR;
+
+  PolyphaseIIR2x<V> mIIRUp[kMaxStages];
+  PolyphaseIIR2x<V> mIIRDown[kMaxStages];
+  HalfbandFIR2x<V> mFIRUp[kMaxStages];
+  HalfbandFIR2x<V> mFIRDown[kMaxStages];
+
+  V mPad[kMaxPad];
+  int mPadLength = 0;
+  int mPadPos = 0;
+
+  V mCoreOutput = V(0.0f);
+  V mOffset = V(0.0f);
+  int mRecenterPhase = 0;
+};
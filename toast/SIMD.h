@@ -0,0 +1,424 @@
+// SIMD.h
+#pragma once
+
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) ||                                   \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define TOAST_SIMD_SSE2 1
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__) || defined(_M_ARM64)
+#include <arm_neon.h>
+#define TOAST_SIMD_NEON 1
+#endif
+
+// ==========================================
+// Float lanes in one SSE2 / NEON register (scalar fallback otherwise)
+// ==========================================
+//
+// N is the number of live lanes (2 or 4); the register always holds four.
+// Only the operations the DSP kernels need. Every operation is a plain
+// IEEE lane-wise op, so a kernel written for float and instantiated for
+// FloatVec produces the same numbers in every lane.
+
+template <int N> struct MaskVec {
+#if TOAST_SIMD_SSE2
+  __m128 v;
+#elif TOAST_SIMD_NEON
+  uint32x4_t v;
+#else
+  bool v[N];
+#endif
+};
+
+template <int N> struct FloatVec {
+  static_assert(N == 2 || N == 4, "FloatVec holds 2 or 4 lanes");
+  static constexpr int kSize = N;
+
+#if TOAST_SIMD_SSE2
+  __m128 v;
+  FloatVec() = default;
+  FloatVec(__m128 x) : v(x) {}
+  FloatVec(float x) : v(_mm_set1_ps(x)) {}
+  // Two lanes move as one 64-bit integer: the __m128i intrinsics may alias
+  // the floats, where a double access would break strict aliasing
+  static FloatVec Load(const float* p) {
+    if (N == 2)
+      return _mm_castsi128_ps(
+          _mm_loadl_epi64(reinterpret_cast<const __m128i*>(p)));
+    return _mm_loadu_ps(p);
+  }
+  void Store(float* p) const {
+    if (N == 2)
+      _mm_storel_epi64(reinterpret_cast<__m128i*>(p), _mm_castps_si128(v));
+    else
+      _mm_storeu_ps(p, v);
+  }
+#elif TOAST_SIMD_NEON
+  float32x4_t v;
+  FloatVec() = default;
+  FloatVec(float32x4_t x) : v(x) {}
+  FloatVec(float x) : v(vdupq_n_f32(x)) {}
+  static FloatVec Load(const float* p) {
+    if (N == 2)
+      return vcombine_f32(vld1_f32(p), vdup_n_f32(0.0f));
+    return vld1q_f32(p);
+  }
+  void Store(float* p) const {
+    if (N == 2)
+      vst1_f32(p, vget_low_f32(v));
+    else
+      vst1q_f32(p, v);
+  }
+#else
+  float v[N];
+  FloatVec() = default;
+  FloatVec(float x) {
+    for (int i = 0; i < N; i++)
+      v[i] = x;
+  }
+  static FloatVec Load(const float* p) {
+    FloatVec r;
+    for (int i = 0; i < N; i++)
+      r.v[i] = p[i];
+    return r;
+  }
+  void Store(float* p) const {
+    for (int i = 0; i < N; i++)
+      p[i] = v[i];
+  }
+#endif
+};
+
+using Float2 = FloatVec<2>;
+using Float4 = FloatVec<4>;
+
+#if TOAST_SIMD_SSE2
+template <int N> inline FloatVec<N> operator+(FloatVec<N> a, FloatVec<N> b) {
+  return _mm_add_ps(a.v, b.v);
+}
+template <int N> inline FloatVec<N> operator-(FloatVec<N> a, FloatVec<N> b) {
+  return _mm_sub_ps(a.v, b.v);
+}
+template <int N> inline FloatVec<N> operator*(FloatVec<N> a, FloatVec<N> b) {
+  return _mm_mul_ps(a.v, b.v);
+}
+template <int N> inline FloatVec<N> operator/(FloatVec<N> a, FloatVec<N> b) {
+  return _mm_div_ps(a.v, b.v);
+}
+template <int N> inline MaskVec<N> operator>(FloatVec<N> a, FloatVec<N> b) {
+  return {_mm_cmpgt_ps(a.v, b.v)};
+}
+template <int N> inline MaskVec<N> operator<(FloatVec<N> a, FloatVec<N> b) {
+  return {_mm_cmplt_ps(a.v, b.v)};
+}
+template <int N> inline FloatVec<N> Abs(FloatVec<N> a) {
+  return _mm_andnot_ps(_mm_set1_ps(-0.0f), a.v);
+}
+template <int N>
+inline FloatVec<N> Select(MaskVec<N> m, FloatVec<N> a, FloatVec<N> b) {
+  return _mm_or_ps(_mm_and_ps(m.v, a.v), _mm_andnot_ps(m.v, b.v));
+}
+template <int N> inline bool Any(MaskVec<N> m) {
+  return (_mm_movemask_ps(m.v) & ((1 << N) - 1)) != 0;
+}
+#elif TOAST_SIMD_NEON
+template <int N> inline FloatVec<N> operator+(FloatVec<N> a, FloatVec<N> b) {
+  return vaddq_f32(a.v, b.v);
+}
+template <int N> inline FloatVec<N> operator-(FloatVec<N> a, FloatVec<N> b) {
+  return vsubq_f32(a.v, b.v);
+}
+template <int N> inline FloatVec<N> operator*(FloatVec<N> a, FloatVec<N> b) {
+  return vmulq_f32(a.v, b.v);
+}
+template <int N> inline FloatVec<N> operator/(FloatVec<N> a, FloatVec<N> b) {
+#if defined(__aarch64__) || defined(_M_ARM64)
+  return vdivq_f32(a.v, b.v);
+#else
+  float x[4], y[4];
+  vst1q_f32(x, a.v);
+  vst1q_f32(y, b.v);
+  for (int i = 0; i < 4; i++)
+    x[i] /= y[i];
+  return vld1q_f32(x);
+#endif
+}
+template <int N> inline MaskVec<N> operator>(FloatVec<N> a, FloatVec<N> b) {
+  return {vcgtq_f32(a.v, b.v)};
+}
+template <int N> inline MaskVec<N> operator<(FloatVec<N> a, FloatVec<N> b) {
+  return {vcltq_f32(a.v, b.v)};
+}
+template <int N> inline FloatVec<N> Abs(FloatVec<N> a) {
+  return vabsq_f32(a.v);
+}
+template <int N>
+inline FloatVec<N> Select(MaskVec<N> m, FloatVec<N> a, FloatVec<N> b) {
+  return vbslq_f32(m.v, a.v, b.v);
+}
+template <int N> inline bool Any(MaskVec<N> m) {
+  uint32x2_t lo = vget_low_u32(m.v);
+  if (N == 2)
+    return (vget_lane_u32(lo, 0) | vget_lane_u32(lo, 1)) != 0;
+  uint32x2_t r = vorr_u32(lo, vget_high_u32(m.v));
+  return (vget_lane_u32(r, 0) | vget_lane_u32(r, 1)) != 0;
+}
+#else
+#define TOAST_FLOATVEC_BINARY(OP)                                              \
+  template <int N>                                                             \
+  inline FloatVec<N> operator OP(FloatVec<N> a, FloatVec<N> b) {               \
+    for (int i = 0; i < N; i++)                                                \
+      a.v[i] = a.v[i] OP b.v[i];                                               \
+    return a;                                                                  \
+  }
+TOAST_FLOATVEC_BINARY(+)
+TOAST_FLOATVEC_BINARY(-)
+TOAST_FLOATVEC_BINARY(*)
+TOAST_FLOATVEC_BINARY(/)
+#undef TOAST_FLOATVEC_BINARY
+template <int N> inline MaskVec<N> operator>(FloatVec<N> a, FloatVec<N> b) {
+  MaskVec<N> m;
+  for (int i = 0; i < N; i++)
+    m.v[i] = a.v[i] > b.v[i];
+  return m;
+}
+template <int N> inline MaskVec<N> operator<(FloatVec<N> a, FloatVec<N> b) {
+  return b > a;
+}
+template <int N> inline FloatVec<N> Abs(FloatVec<N> a) {
+  for (int i = 0; i < N; i++)
+    a.v[i] = std::abs(a.v[i]);
+  return a;
+}
+template <int N>
+inline FloatVec<N> Select(MaskVec<N> m, FloatVec<N> a, FloatVec<N> b) {
+  for (int i = 0; i < N; i++)
+    a.v[i] = m.v[i] ? a.v[i] : b.v[i];
+  return a;
+}
+template <int N> inline bool Any(MaskVec<N> m) {
+  for (int i = 0; i < N; i++)
+    if (m.v[i])
+      return true;
+  return false;
+}
+#endif
+
+template <int N> inline FloatVec<N> operator+(FloatVec<N> a, float b) {
+  return a + FloatVec<N>(b);
+}
+template <int N> inline FloatVec<N> operator+(float a, FloatVec<N> b) {
+  return FloatVec<N>(a) + b;
+}
+template <int N> inline FloatVec<N> operator-(FloatVec<N> a, float b) {
+  return a - FloatVec<N>(b);
+}
+template <int N> inline FloatVec<N> operator-(float a, FloatVec<N> b) {
+  return FloatVec<N>(a) - b;
+}
+template <int N> inline FloatVec<N> operator*(FloatVec<N> a, float b) {
+  return a * FloatVec<N>(b);
+}
+template <int N> inline FloatVec<N> operator*(float a, FloatVec<N> b) {
+  return FloatVec<N>(a) * b;
+}
+template <int N> inline FloatVec<N> operator/(FloatVec<N> a, float b) {
+  return a / FloatVec<N>(b);
+}
+template <int N> inline FloatVec<N> operator/(float a, FloatVec<N> b) {
+  return FloatVec<N>(a) / b;
+}
+template <int N> inline MaskVec<N> operator>(FloatVec<N> a, float b) {
+  return a > FloatVec<N>(b);
+}
+template <int N> inline MaskVec<N> operator<(FloatVec<N> a, float b) {
+  return a < FloatVec<N>(b);
+}
+template <int N>
+inline FloatVec<N>& operator+=(FloatVec<N>& a, FloatVec<N> b) {
+  return a = a + b;
+}
+template <int N> inline FloatVec<N>& operator+=(FloatVec<N>& a, float b) {
+  return a = a + b;
+}
+template <int N>
+inline FloatVec<N>& operator-=(FloatVec<N>& a, FloatVec<N> b) {
+  return a = a - b;
+}
+template <int N> inline FloatVec<N>& operator-=(FloatVec<N>& a, float b) {
+  return a = a - b;
+}
+
+// No vector tanh: evaluated per live lane, only where the kernels need it
+template <int N> inline FloatVec<N> Tanh(FloatVec<N> a) {
+  float x[4];
+  a.Store(x);
+  for (int i = 0; i < N; i++)
+    x[i] = std::tanh(x[i]);
+  return FloatVec<N>::Load(x);
+}
+
+// ==========================================
+// Two double lanes in one SSE2 / AArch64 NEON register (scalar otherwise)
+// ==========================================
+//
+// The FloatVec operations for the double-precision build, which fits half
+// as many lanes in a register.
+
+#if TOAST_SIMD_SSE2
+#define TOAST_SIMD_DOUBLE_SSE2 1
+#elif TOAST_SIMD_NEON && (defined(__aarch64__) || defined(_M_ARM64))
+#define TOAST_SIMD_DOUBLE_NEON 1
+#endif
+
+struct MaskDouble2 {
+#if TOAST_SIMD_DOUBLE_SSE2
+  __m128d v;
+#elif TOAST_SIMD_DOUBLE_NEON
+  uint64x2_t v;
+#else
+  bool v[2];
+#endif
+};
+
+struct Double2 {
+  static constexpr int kSize = 2;
+
+#if TOAST_SIMD_DOUBLE_SSE2
+  __m128d v;
+  Double2() = default;
+  Double2(__m128d x) : v(x) {}
+  Double2(double x) : v(_mm_set1_pd(x)) {}
+  static Double2 Load(const double* p) { return _mm_loadu_pd(p); }
+  void Store(double* p) const { _mm_storeu_pd(p, v); }
+#elif TOAST_SIMD_DOUBLE_NEON
+  float64x2_t v;
+  Double2() = default;
+  Double2(float64x2_t x) : v(x) {}
+  Double2(double x) : v(vdupq_n_f64(x)) {}
+  static Double2 Load(const double* p) { return vld1q_f64(p); }
+  void Store(double* p) const { vst1q_f64(p, v); }
+#else
+  double v[2];
+  Double2() = default;
+  Double2(double x) : v{x, x} {}
+  static Double2 Load(const double* p) {
+    Double2 r;
+    r.v[0] = p[0];
+    r.v[1] = p[1];
+    return r;
+  }
+  void Store(double* p) const {
+    p[0] = v[0];
+    p[1] = v[1];
+  }
+#endif
+};
+
+#if TOAST_SIMD_DOUBLE_SSE2
+inline Double2 operator+(Double2 a, Double2 b) { return _mm_add_pd(a.v, b.v); }
+inline Double2 operator-(Double2 a, Double2 b) { return _mm_sub_pd(a.v, b.v); }
+inline Double2 operator*(Double2 a, Double2 b) { return _mm_mul_pd(a.v, b.v); }
+inline Double2 operator/(Double2 a, Double2 b) { return _mm_div_pd(a.v, b.v); }
+inline MaskDouble2 operator>(Double2 a, Double2 b) {
+  return {_mm_cmpgt_pd(a.v, b.v)};
+}
+inline MaskDouble2 operator<(Double2 a, Double2 b) {
+  return {_mm_cmplt_pd(a.v, b.v)};
+}
+inline Double2 Abs(Double2 a) { return _mm_andnot_pd(_mm_set1_pd(-0.0), a.v); }
+inline Double2 Select(MaskDouble2 m, Double2 a, Double2 b) {
+  return _mm_or_pd(_mm_and_pd(m.v, a.v), _mm_andnot_pd(m.v, b.v));
+}
+inline bool Any(MaskDouble2 m) { return _mm_movemask_pd(m.v) != 0; }
+#elif TOAST_SIMD_DOUBLE_NEON
+inline Double2 operator+(Double2 a, Double2 b) { return vaddq_f64(a.v, b.v); }
+inline Double2 operator-(Double2 a, Double2 b) { return vsubq_f64(a.v, b.v); }
+inline Double2 operator*(Double2 a, Double2 b) { return vmulq_f64(a.v, b.v); }
+inline Double2 operator/(Double2 a, Double2 b) { return vdivq_f64(a.v, b.v); }
+inline MaskDouble2 operator>(Double2 a, Double2 b) {
+  return {vcgtq_f64(a.v, b.v)};
+}
+inline MaskDouble2 operator<(Double2 a, Double2 b) {
+  return {vcltq_f64(a.v, b.v)};
+}
+inline Double2 Abs(Double2 a) { return vabsq_f64(a.v); }
+inline Double2 Select(MaskDouble2 m, Double2 a, Double2 b) {
+  return vbslq_f64(m.v, a.v, b.v);
+}
+inline bool Any(MaskDouble2 m) {
+  return (vgetq_lane_u64(m.v, 0) | vgetq_lane_u64(m.v, 1)) != 0;
+}
+#else
+#define TOAST_DOUBLE2_BINARY(OP)                                               \
+  inline Double2 operator OP(Double2 a, Double2 b) {                           \
+    a.v[0] = a.v[0] OP b.v[0];                                                 \
+    a.v[1] = a.v[1] OP b.v[1];                                                 \
+    return a;                                                                  \
+  }
+TOAST_DOUBLE2_BINARY(+)
+TOAST_DOUBLE2_BINARY(-)
+TOAST_DOUBLE2_BINARY(*)
+TOAST_DOUBLE2_BINARY(/)
+#undef TOAST_DOUBLE2_BINARY
+inline MaskDouble2 operator>(Double2 a, Double2 b) {
+  return {{a.v[0] > b.v[0], a.v[1] > b.v[1]}};
+}
+inline MaskDouble2 operator<(Double2 a, Double2 b) { return b > a; }
+inline Double2 Abs(Double2 a) {
+  a.v[0] = std::abs(a.v[0]);
+  a.v[1] = std::abs(a.v[1]);
+  return a;
+}
+inline Double2 Select(MaskDouble2 m, Double2 a, Double2 b) {
+  a.v[0] = m.v[0] ? a.v[0] : b.v[0];
+  a.v[1] = m.v[1] ? a.v[1] : b.v[1];
+  return a;
+}
+inline bool Any(MaskDouble2 m) { return m.v[0] || m.v[1]; }
+#endif
+
+inline Double2 operator+(Double2 a, double b) { return a + Double2(b); }
+inline Double2 operator+(double a, Double2 b) { return Double2(a) + b; }
+inline Double2 operator-(Double2 a, double b) { return a - Double2(b); }
+inline Double2 operator-(double a, Double2 b) { return Double2(a) - b; }
+inline Double2 operator*(Double2 a, double b) { return a * Double2(b); }
+inline Double2 operator*(double a, Double2 b) { return Double2(a) * b; }
+inline Double2 operator/(Double2 a, double b) { return a / Double2(b); }
+inline Double2 operator/(double a, Double2 b) { return Double2(a) / b; }
+inline MaskDouble2 operator>(Double2 a, double b) { return a > Double2(b); }
+inline MaskDouble2 operator<(Double2 a, double b) { return a < Double2(b); }
+inline Double2& operator+=(Double2& a, Double2 b) { return a = a + b; }
+inline Double2& operator+=(Double2& a, double b) { return a = a + b; }
+inline Double2& operator-=(Double2& a, Double2 b) { return a = a - b; }
+inline Double2& operator-=(Double2& a, double b) { return a = a - b; }
+
+inline Double2 Tanh(Double2 a) {
+  double x[2];
+  a.Store(x);
+  x[0] = std::tanh(x[0]);
+  x[1] = std::tanh(x[1]);
+  return Double2::Load(x);
+}
+
+// Scalar overloads so the same kernel compiles for float and double
+inline float Abs(float a) { return std::abs(a); }
+inline float Select(bool m, float a, float b) { return m ? a : b; }
+inline bool Any(bool m) { return m; }
+inline float Tanh(float a) { return std::tanh(a); }
+inline double Abs(double a) { return std::abs(a); }
+inline double Select(bool m, double a, double b) { return m ? a : b; }
+inline double Tanh(double a) { return std::tanh(a); }
+
+// Lane types for the sample type T (float or double): one lane per
+// channel of a pair, and a full register for frame-parallel loops
+template <typename T> struct SampleLanes;
+template <> struct SampleLanes<float> {
+  using Pair = Float2;
+  using Full = Float4;
+};
+template <> struct SampleLanes<double> {
+  using Pair = Double2;
+  using Full = Double2;
+};
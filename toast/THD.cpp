@@ -1,169 +1,1397 @@
 // Source/DSP/TransformerTHD.cpp
-#include "TransformerTHD.h"
+#include "THD.h"
+#include "Denormals.h"
+#include "SIMD.h"
+
+#include <type_traits>
 
 #ifndef M_PI
 #define M_PI 3.14159265358979323846
 #endif
 
+namespace {
+
+constexpr float kDCBlockerFreq = 20.0f;
+constexpr float kLowShelfFreq = 100.0f;
+constexpr float kHighDampenFreq = 8000.0f;
+
+// Waveshaper blend: 0.7 of a rational tanh approximation, 0.3 of a cubic
+constexpr float kRationalShare = 0.7f;
+constexpr float kCubicShare = 0.3f;
+constexpr float kCubicCoef = 0.1f;
+
+// Soft limiter: linear up to the knee, then tanh into the remaining range
+constexpr float kLimiterKnee = 0.95f;
+constexpr float kLimiterRange = 0.05f;
+
+// The Magnetic model's high dampening follows the THD amount at a sixth of
+// the Classic depth
+constexpr float kMagneticDampenScale = 0.05f / 0.3f;
+
+// Each model's waveshaper: the shares of the rational and the cubic in its
+// blend, and how much of the bias it takes back out afterwards
+template <THDModel kModel> struct SaturationBlend {
+  static constexpr float kRational = kRationalShare;
+  static constexpr float kCubic = kCubicShare;
+  static constexpr float kBiasRemoval = 0.5f;
+};
+template <> struct SaturationBlend<kTHDMagnetic> {
+  static constexpr float kRational = 1.0f;
+  static constexpr float kCubic = 0.0f;
+  static constexpr float kBiasRemoval = 0.8f;
+};
+
+template <typename T> inline T Clamp01(T amount) {
+  return std::max(T(0), std::min(T(1), amount));
+}
+
+// Input clamp ahead of the stages
+template <typename T> inline T ClampInput(T sample) {
+  return std::max(T(-2), std::min(T(2), sample));
+}
+
+// Gains that follow the THD amount, which may change every sample
+template <typename T> struct AmountCoefficients {
+  T drive;
+  T dry;
+  T wet;
+  T dampen;
+};
+
+template <typename T>
+inline AmountCoefficients<T> MakeAmountCoefficients(T thdAmount) {
+  AmountCoefficients<T> c;
+  // More conservative drive range
+  c.drive = 1.0f + (thdAmount * 4.0f); // Reduced from 8.0f
+
+  // BETTER GAIN COMPENSATION - This is key!
+  T compensation =
+      1.0f / (1.0f + thdAmount * 3.5f); // More aggressive compensation
+
+  // Adjust wetness to start at 0 when THD is at 0
+  T wetness = thdAmount; // Linear from 0 to 1, no minimum wetness!
+  c.dry = 1.0f - wetness;
+  c.wet = wetness * compensation;
+
+  c.dampen = thdAmount * 0.3f;
+  return c;
+}
+
+template <typename T>
+inline THDCoefficients<T> MakeClassicCoefficients(T warmth, T asymmetry,
+                                                  T hysteresisAmount,
+                                                  T sampleRate) {
+  THDCoefficients<T> c = {};
+  T gain = 1.0f + (warmth * 0.3f);
+  c.lowShelfInputGain = 0.05f * gain;
+  c.lowShelfMix = warmth * 0.3f;
+
+  c.hysteresisThreshold = hysteresisAmount * 0.05f;
+  c.hysteresisWet = hysteresisAmount * 0.2f;
+  c.hysteresisDry = 1.0f - c.hysteresisWet;
+
+  // Asymmetry for even harmonics
+  c.saturationBias = asymmetry * 0.2f; // Reduced from 0.3f
+
+  c.highDampenAlpha = std::exp(-2.0f * M_PI * (kHighDampenFreq / sampleRate));
+  T dcBlockerAlpha =
+      1.0f / (1.0f + 2.0f * M_PI * (kDCBlockerFreq / sampleRate));
+  c.dcBlockerFeedback = 1.0f - dcBlockerAlpha;
+  c.kneeTable = nullptr;
+  return c;
+}
+
+template <typename T>
+inline THDCoefficients<T> MakeMagneticCoefficients(T warmth, T asymmetry,
+                                                   T hysteresisAmount,
+                                                   T sampleRate) {
+  THDCoefficients<T> c = {};
+  // Low shelf: bass below 200Hz, sub-bass below 80Hz
+  c.lowShelfActive = warmth >= 0.01f;
+  c.bassCoef = 1.0f - std::exp(-2.0f * M_PI * (200.0f / sampleRate));
+  c.subCoef = 1.0f - std::exp(-2.0f * M_PI * (80.0f / sampleRate));
+  c.subBoost = warmth * 0.25f;
+  c.bassBoost = warmth * 0.15f;
+  c.bassSaturation = warmth * 0.1f;
+
+  c.hysteresisActive = hysteresisAmount >= 0.01f;
+  c.hysteresisThreshold = 0.1f;
+  c.hysteresisFastRate = 0.8f - (hysteresisAmount * 0.3f);
+  c.hysteresisSlowRate = 0.4f - (hysteresisAmount * 0.3f);
+  c.hysteresisKnee = hysteresisAmount * 2.0f;
+  c.hysteresisWet = hysteresisAmount * 0.5f; // Never more than 50% wet
+  c.hysteresisDry = 1.0f - c.hysteresisWet;
+  c.hysteresisHighFreq = hysteresisAmount * 0.3f;
+
+  c.saturationBias = asymmetry * 0.15f;
+  // Very subtle 2nd harmonic only at high settings
+  c.secondHarmonic = asymmetry > 0.5f ? (asymmetry - 0.5f) * 0.05f : 0.0f;
+
+  c.highDampenAlpha = std::exp(-2.0f * M_PI * (15000.0f / sampleRate));
+  // Fixed pole rather than a corner frequency
+  c.dcBlockerFeedback = 0.999f;
+  c.kneeTable = nullptr;
+  return c;
+}
+
+template <typename T>
+inline THDCoefficients<T> MakeCoefficients(THDModel model, T warmth,
+                                           T asymmetry, T hysteresisAmount,
+                                           T sampleRate) {
+  if (model == kTHDMagnetic) {
+    return MakeMagneticCoefficients(warmth, asymmetry, hysteresisAmount,
+                                    sampleRate);
+  }
+  return MakeClassicCoefficients(warmth, asymmetry, hysteresisAmount,
+                                 sampleRate);
+}
+
+// tanh for the soft limiter's knee (kWaveshaperTable). It is within 3e-14
+// of 1 at the end of the range, where the table holds.
+constexpr double kKneeTableRange = 16.0;
+constexpr int kKneeTableSegments = 256;
+
+// Built on first use, which the THD constructors make sure is not on the
+// audio thread; read-only afterwards
+template <typename T> const WaveshaperTable<T>& KneeTable() {
+  static const WaveshaperTable<T> table = [] {
+    WaveshaperTable<T> t;
+    t.Build([](double x) { return std::tanh(x); },
+            [](double x) { return 1.0 - std::tanh(x) * std::tanh(x); },
+            kKneeTableRange, kKneeTableSegments);
+    return t;
+  }();
+  return table;
+}
+
+// THD amount sources for ProcessStages
+template <typename T> struct ConstantAmount {
+  AmountCoefficients<T> value;
+  explicit ConstantAmount(T amount) : value(MakeAmountCoefficients(amount)) {}
+  AmountCoefficients<T> operator[](int) const { return value; }
+  ConstantAmount Offset(int) const { return *this; }
+};
+
+template <typename T> struct AmountBuffer {
+  const T* values;
+  AmountCoefficients<T> operator[](int i) const {
+    return MakeAmountCoefficients(Clamp01(values[i]));
+  }
+  AmountBuffer Offset(int n) const { return {values + n}; }
+};
+
+// Gains for a lane pair whose THD amounts differ
+template <typename T> struct LaneAmountCoefficients {
+  using Lanes = typename SampleLanes<T>::Pair;
+  Lanes drive;
+  Lanes dry;
+  Lanes wet;
+  Lanes dampen;
+};
+
+// One amount buffer per lane, for ProcessStereo
+template <typename T> struct LaneAmountBuffers {
+  using Lanes = typename SampleLanes<T>::Pair;
+  const T* left;
+  const T* right;
+  LaneAmountCoefficients<T> operator[](int i) const {
+    const AmountCoefficients<T> l = MakeAmountCoefficients(Clamp01(left[i]));
+    const AmountCoefficients<T> r = MakeAmountCoefficients(Clamp01(right[i]));
+    alignas(16) const T drive[2] = {l.drive, r.drive};
+    alignas(16) const T dry[2] = {l.dry, r.dry};
+    alignas(16) const T wet[2] = {l.wet, r.wet};
+    alignas(16) const T dampen[2] = {l.dampen, r.dampen};
+    return {Lanes::Load(drive), Lanes::Load(dry), Lanes::Load(wet),
+            Lanes::Load(dampen)};
+  }
+  LaneAmountBuffers Offset(int n) const { return {left + n, right + n}; }
+};
+
+// Per-sample stage kernels, written once for scalars and SIMD lanes of
+// float or double, with amount gains shared by all lanes
+// (AmountCoefficients) or per lane.
+// State is passed by reference so the block loops can keep it in locals
+// (or registers) for the whole buffer.
+template <typename V, typename A, typename T>
+inline V AsymmetricSaturation(V input, const A& amount,
+                              const THDCoefficients<T>& c) {
+  V x = input * amount.drive;
+  x += c.saturationBias;
+
+  // Waveshaping
+  V x2 = x * x;
+  V x3 = x2 * x;
+
+  // Mix of different saturation curves
+  V tanh_sat = x * (27.0f + x2) / (27.0f + 9.0f * x2);
+  V cubic_sat = x - (x3 * kCubicCoef);
+
+  // Blend the two saturation types
+  V saturated = tanh_sat * kRationalShare + cubic_sat * kCubicShare;
+
+  // Remove DC offset from asymmetry
+  saturated -= c.saturationBias * 0.5f;
+
+  // When THD is 0, output = 100% dry (no volume change)
+  return input * amount.dry + saturated * amount.wet;
+}
+
+template <typename V, typename T>
+inline V Hysteresis(V input, V& state, const THDCoefficients<T>& c) {
+  V diff = input - state;
+
+  V rate = Select(Abs(diff) > c.hysteresisThreshold, V(0.8f), V(0.3f));
+  state += diff * rate;
+
+  return input * c.hysteresisDry + state * c.hysteresisWet;
+}
+
+template <typename V, typename T>
+inline V LowShelf(V input, V& state, const THDCoefficients<T>& c) {
+  state = state * 0.95f + input * c.lowShelfInputGain;
+  return input + state * c.lowShelfMix;
+}
+
+template <typename V, typename A, typename T>
+inline V HighDampening(V input, V& state, const A& amount,
+                       const THDCoefficients<T>& c) {
+  state = input * (1.0f - c.highDampenAlpha) + state * c.highDampenAlpha;
+
+  return input * (1.0f - amount.dampen) + state * amount.dampen;
+}
+
+template <typename V, typename T>
+inline V DCBlocker(V input, V& prevInput, V& prevOutput,
+                   const THDCoefficients<T>& c) {
+  V output = input - prevInput + prevOutput * c.dcBlockerFeedback;
+
+  prevInput = input;
+  prevOutput = output;
+
+  return output;
+}
+
+template <typename V, typename T>
+inline V SoftLimit(V input, const THDCoefficients<T>& c) {
+  V absInput = Abs(input);
+  auto over = absInput > kLimiterKnee;
+  if (!Any(over)) {
+    return input;
+  }
+  V sign = Select(input > 0.0f, V(1.0f), V(-1.0f));
+  V excess = absInput - kLimiterKnee;
+  V knee = c.kneeTable ? c.kneeTable->Evaluate(excess * 2.0f)
+                       : Tanh(excess * 2.0f);
+  return Select(over, sign * (kLimiterKnee + knee * kLimiterRange), input);
+}
+
+// ==========================================
+// Magnetic model
+// ==========================================
+
+// tanh, from the knee table when one is set (tanh is odd, so by magnitude)
+template <typename V, typename T>
+inline V KneeTanh(V x, const THDCoefficients<T>& c) {
+  if (!c.kneeTable) {
+    return Tanh(x);
+  }
+  V magnitude = c.kneeTable->Evaluate(Abs(x));
+  return Select(x < 0.0f, V(0.0f) - magnitude, magnitude);
+}
+
+// Bass and sub-bass shelves, the bass gently saturated for harmonics
+template <typename V, typename T>
+inline V MagneticLowShelf(V input, V& bass, V& sub,
+                          const THDCoefficients<T>& c) {
+  if (!c.lowShelfActive) {
+    return input;
+  }
+  bass += (input - bass) * c.bassCoef;
+  sub += (input - sub) * c.subCoef;
+
+  V subBoost = sub * c.subBoost;
+  V bassBoost = (bass - sub) * c.bassBoost;
+  V bassSaturated = KneeTanh(bass * 2.0f, c) * c.bassSaturation;
+  return input + subBoost + bassBoost + bassSaturated;
+}
+
+// Magnetic memory: a lag that is fast for large steps (transients) and
+// slow for sustained notes, soft-saturated above 0.3. It thickens rather
+// than filters: the highs the lag smooths away are added back.
+template <typename V, typename T>
+inline V MagneticHysteresis(V input, V& state, const THDCoefficients<T>& c) {
+  if (!c.hysteresisActive) {
+    state = input;
+    return input;
+  }
+  V diff = input - state;
+  V rate = Select(Abs(diff) > c.hysteresisThreshold, V(c.hysteresisFastRate),
+                  V(c.hysteresisSlowRate));
+  state += diff * rate;
+
+  V magnetic = state;
+  V absMagnetic = Abs(magnetic);
+  auto saturating = absMagnetic > 0.3f;
+  if (Any(saturating)) {
+    V sign = Select(magnetic > 0.0f, V(1.0f), V(-1.0f));
+    V excess = absMagnetic - 0.3f;
+    magnetic = Select(saturating,
+                      sign * (0.3f + excess / (1.0f + excess * c.hysteresisKnee)),
+                      magnetic);
+  }
+
+  V highFreqCompensation = (input - state) * c.hysteresisHighFreq;
+  return input * c.hysteresisDry + magnetic * c.hysteresisWet +
+         highFreqCompensation;
+}
+
+// A little tanh of the waveshaper input for even harmonics at high
+// asymmetry. At most 2.5% of the output, so antialiasing leaves it out.
+template <typename V, typename T>
+inline V AddSecondHarmonic(V saturated, V x, const THDCoefficients<T>& c) {
+  if (c.secondHarmonic > 0.0f) {
+    saturated += KneeTanh(x * 2.0f, c) * c.secondHarmonic;
+  }
+  return saturated;
+}
+
+template <typename V, typename A, typename T>
+inline V MagneticSaturation(V input, const A& amount,
+                            const THDCoefficients<T>& c) {
+  V x = input * amount.drive;
+  x += c.saturationBias;
+
+  V x2 = x * x;
+  V saturated = x * (27.0f + x2) / (27.0f + 9.0f * x2);
+  saturated -= c.saturationBias * SaturationBlend<kTHDMagnetic>::kBiasRemoval;
+  saturated = AddSecondHarmonic(saturated, x, c);
+
+  return input * amount.dry + saturated * amount.wet;
+}
+
+// ==========================================
+// Antiderivative antialiasing (ADAA)
+// ==========================================
+//
+// The waveshaper and the limiter are each the identity plus a residual
+// (the curve minus x). The residual is replaced by its average over the
+// step between consecutive inputs (first order), or a weighted average over
+// the last two steps (second order), taken from closed-form
+// antiderivatives; the same average of the identity is the mean of the
+// inputs. The waveshaper's output lags by half a sample (first order) or
+// one sample (second order) at the rate it runs. The limiter's identity
+// passes untouched, so signals below its knee are not delayed or filtered.
+
+// Below these input steps a difference quotient of antiderivatives has
+// lost too many digits, and a midpoint evaluation takes over
+constexpr double kFirstOrderTolerance = 1e-6;
+constexpr double kSecondOrderTolerance = 1e-3;
+
+constexpr double kSqrt3 = 1.73205080756887729;
+constexpr double kLn2 = 0.693147180559945309;
+
+// Lanes of V (or a scalar T) in memory, for per-lane scalar code
+template <typename V> struct LaneCount {
+  static constexpr int value = V::kSize;
+};
+template <> struct LaneCount<float> {
+  static constexpr int value = 1;
+};
+template <> struct LaneCount<double> {
+  static constexpr int value = 1;
+};
+
+template <typename T, typename V> struct LaneArray {
+  static constexpr int kSize = LaneCount<V>::value;
+  alignas(16) T lanes[4];
+
+  explicit LaneArray(V x) {
+    if constexpr (kSize == 1)
+      lanes[0] = x;
+    else
+      x.Store(lanes);
+  }
+  V Load() const {
+    if constexpr (kSize == 1)
+      return lanes[0];
+    else
+      return V::Load(lanes);
+  }
+  T& operator[](int i) { return lanes[i]; }
+};
+
+// The waveshaper residual g(x) - x (g is the model's blend before the
+// bias and the mix) and its first and second antiderivatives. The shares
+// add up to 1, so the rational part leaves -8/9 x + 8/3 x / (x^2 + 3).
+template <THDModel kModel> inline double SaturationResidual(double x) {
+  using Blend = SaturationBlend<kModel>;
+  const double x2 = x * x;
+  const double rational = x * (27.0 + x2) / (27.0 + 9.0 * x2);
+  return rational * Blend::kRational +
+         (x - x2 * x * kCubicCoef) * Blend::kCubic - x;
+}
+
+template <THDModel kModel> inline double SaturationResidualAD1(double x) {
+  using Blend = SaturationBlend<kModel>;
+  const double x2 = x * x;
+  return Blend::kRational * ((4.0 / 3.0) * std::log(x2 + 3.0) -
+                             (4.0 / 9.0) * x2) -
+         0.25 * Blend::kCubic * kCubicCoef * x2 * x2;
+}
+
+template <THDModel kModel> inline double SaturationResidualAD2(double x) {
+  using Blend = SaturationBlend<kModel>;
+  const double x2 = x * x;
+  const double logIntegral = x * std::log(x2 + 3.0) - 2.0 * x +
+                             2.0 * kSqrt3 * std::atan(x / kSqrt3);
+  return Blend::kRational * ((4.0 / 3.0) * logIntegral -
+                             (4.0 / 27.0) * x2 * x) -
+         0.05 * Blend::kCubic * kCubicCoef * x2 * x2 * x;
+}
+
+// atanh(t) / t for |t| < 1: a series up to |t| = 0.25, with enough terms
+// for T, and the log in the lanes beyond
+template <typename T, typename V> inline V AtanhRatio(V t) {
+  constexpr int kTerms = std::is_same<T, float>::value ? 7 : 14;
+  const V z = t * t;
+  V sum = V(T(1.0 / (2 * kTerms - 1)));
+  for (int k = kTerms - 2; k >= 0; k--) {
+    sum = sum * z + T(1.0 / (2 * k + 1));
+  }
+  if (Any(Abs(t) > 0.25f)) {
+    LaneArray<T, V> ts(t);
+    LaneArray<T, V> sums(sum);
+    for (int i = 0; i < LaneArray<T, V>::kSize; i++) {
+      if (std::abs(ts[i]) > T(0.25))
+        sums[i] = T(0.5) * std::log((T(1) + ts[i]) / (T(1) - ts[i])) / ts[i];
+    }
+    sum = sums.Load();
+  }
+  return sum;
+}
+
+// First-order ADAA of the waveshaper residual over the step x1 -> x. The
+// difference quotient of the log in its antiderivative reduces to
+// atanh(t) / t, and that of the polynomial terms to sums, so nothing
+// cancels as x1 approaches x and no fallback is needed.
+template <THDModel kModel, typename T, typename V>
+inline V SaturationResidualADAA1(V x, V x1) {
+  using Blend = SaturationBlend<kModel>;
+  const V sum = x + x1;
+  const V squares = x * x + x1 * x1;
+  const V ratio = sum / (squares + 6.0f);
+  const V t = (x - x1) * ratio;
+  const V rational =
+      ratio * AtanhRatio<T>(t) * (8.0f / 3.0f) - sum * (4.0f / 9.0f);
+  return rational * Blend::kRational -
+         sum * squares * (0.25f * Blend::kCubic * kCubicCoef);
+}
+
+// Second-order ADAA of the waveshaper residual for one lane, in double.
+// antiderivative and slope hold the second antiderivative at x1 and its
+// difference quotient over x2 -> x1, and are advanced to x.
+template <THDModel kModel>
+inline double SaturationResidualADAA2(double x, double x1, double x2,
+                                      double& antiderivative, double& slope) {
+  const double nextAntiderivative = SaturationResidualAD2<kModel>(x);
+  const double nextSlope =
+      std::abs(x - x1) < kSecondOrderTolerance
+          ? SaturationResidualAD1<kModel>(0.5 * (x + x1))
+          : (nextAntiderivative - antiderivative) / (x - x1);
+
+  double residual;
+  if (std::abs(x - x2) < kSecondOrderTolerance) {
+    // Back near x2, where the quotient of slopes cancels: expand around
+    // the midpoint instead (Parker, Zavalishin & Le Bivic, DAFx-16)
+    const double mid = 0.5 * (x + x2);
+    const double delta = mid - x1;
+    residual =
+        std::abs(delta) < kSecondOrderTolerance
+            ? SaturationResidual<kModel>(0.5 * (mid + x1))
+            : 2.0 / delta *
+                  (SaturationResidualAD1<kModel>(mid) +
+                   (antiderivative - SaturationResidualAD2<kModel>(mid)) /
+                       delta);
+  } else {
+    residual = 2.0 * (nextSlope - slope) / (x - x2);
+  }
+
+  antiderivative = nextAntiderivative;
+  slope = nextSlope;
+  return residual;
+}
+
+// The limiter residual SoftLimit(x) - x (0 up to the knee) and its
+// antiderivative
+inline double LimiterResidual(double x) {
+  const double excess = std::abs(x) - kLimiterKnee;
+  if (excess <= 0.0)
+    return 0.0;
+  const double limited =
+      kLimiterKnee + kLimiterRange * std::tanh(2.0 * excess);
+  return std::copysign(limited, x) - x;
+}
+
+inline double LimiterResidualAD1(double x) {
+  const double excess = std::abs(x) - kLimiterKnee;
+  if (excess <= 0.0)
+    return 0.0;
+  // log(cosh(z)) without overflowing cosh
+  const double z = 2.0 * excess;
+  const double logCosh = z + std::log1p(std::exp(-2.0 * z)) - kLn2;
+  const double knee = (double)kLimiterKnee;
+  return knee * excess + 0.5 * kLimiterRange * logCosh -
+         0.5 * (x * x - knee * knee);
+}
+
+inline double LimiterResidualADAA1(double x, double x1) {
+  if (std::abs(x - x1) < kFirstOrderTolerance)
+    return LimiterResidual(0.5 * (x + x1));
+  return (LimiterResidualAD1(x) - LimiterResidualAD1(x1)) / (x - x1);
+}
+
+// Recursive state of one channel (or one lane group)
+template <typename V> struct ChannelState {
+  V hysteresis;
+  V lowShelf;
+  V lowShelf2; // Magnetic sub-bass shelf
+  V highDampen;
+  V dcPrevInput;
+  V dcPrevOutput;
+
+  // Antialiasing history; the second-order terms are kept in double per
+  // lane (one or two)
+  V saturationInput1;
+  V saturationInput2;
+  double saturationAntiderivative[2];
+  double saturationSlope[2];
+  V limiterInput;
+};
+
+// Stages whose math differs between the models, for kModel
+template <THDModel kModel, typename V, typename T>
+inline V ShelfStage(V input, ChannelState<V>& state,
+                    const THDCoefficients<T>& c) {
+  if constexpr (kModel == kTHDMagnetic) {
+    return MagneticLowShelf(input, state.lowShelf, state.lowShelf2, c);
+  } else {
+    return LowShelf(input, state.lowShelf, c);
+  }
+}
+
+template <THDModel kModel, typename V, typename T>
+inline V HysteresisStage(V input, ChannelState<V>& state,
+                         const THDCoefficients<T>& c) {
+  if constexpr (kModel == kTHDMagnetic) {
+    return MagneticHysteresis(input, state.hysteresis, c);
+  } else {
+    return Hysteresis(input, state.hysteresis, c);
+  }
+}
+
+template <THDModel kModel, typename V, typename A, typename T>
+inline V DampenStage(V input, ChannelState<V>& state, const A& amount,
+                     const THDCoefficients<T>& c) {
+  if constexpr (kModel == kTHDMagnetic) {
+    A gentler = amount;
+    gentler.dampen = amount.dampen * kMagneticDampenScale;
+    return HighDampening(input, state.highDampen, gentler, c);
+  } else {
+    return HighDampening(input, state.highDampen, amount, c);
+  }
+}
+
+// The waveshaper without antialiasing
+template <THDModel kModel, typename V, typename A, typename T>
+inline V Waveshape(V input, const A& amount, const THDCoefficients<T>& c) {
+  if constexpr (kModel == kTHDMagnetic) {
+    return MagneticSaturation(input, amount, c);
+  } else {
+    return AsymmetricSaturation(input, amount, c);
+  }
+}
+
+// The waveshaper, its residual antialiased at kMode's order
+template <THDModel kModel, Antialiasing kMode, typename V, typename A,
+          typename T>
+inline V Saturate(V input, const A& amount, const THDCoefficients<T>& c,
+                  ChannelState<V>& state) {
+  if constexpr (kMode == kAntialiasingOff) {
+    return Waveshape<kModel>(input, amount, c);
+  } else {
+    const V x = input * amount.drive + c.saturationBias;
+    V residual;
+    V average;
+    if constexpr (kMode == kADAAFirstOrder) {
+      residual =
+          SaturationResidualADAA1<kModel, T>(x, state.saturationInput1);
+      average = (x + state.saturationInput1) * 0.5f;
+    } else {
+      LaneArray<T, V> lanes(x);
+      LaneArray<T, V> x1(state.saturationInput1);
+      LaneArray<T, V> x2(state.saturationInput2);
+      static_assert(LaneArray<T, V>::kSize <= 2, "two lanes of history");
+      for (int i = 0; i < LaneArray<T, V>::kSize; i++) {
+        lanes[i] = (T)SaturationResidualADAA2<kModel>(
+            lanes[i], x1[i], x2[i], state.saturationAntiderivative[i],
+            state.saturationSlope[i]);
+      }
+      residual = lanes.Load();
+      average =
+          (x + state.saturationInput1 + state.saturationInput2) * (1.0f / 3.0f);
+      state.saturationInput2 = state.saturationInput1;
+    }
+    state.saturationInput1 = x;
+
+    // As Waveshape, with g(x) = x + residual. The linear terms are
+    // averaged the same way, so they keep in step with the residual: at
+    // high drive the two nearly cancel.
+    V saturated = average + residual;
+    saturated -= c.saturationBias * SaturationBlend<kModel>::kBiasRemoval;
+    if constexpr (kModel == kTHDMagnetic) {
+      saturated = AddSecondHarmonic(saturated, average, c);
+    }
+    const V dry = (average - c.saturationBias) / amount.drive;
+    return dry * amount.dry + saturated * amount.wet;
+  }
+}
+
+// The soft limiter, antialiased at first order in either ADAA mode. Below
+// the knee the residual is 0, so only steps touching it cost anything.
+template <Antialiasing kMode, typename V, typename T>
+inline V Limit(V input, ChannelState<V>& state, const THDCoefficients<T>& c) {
+  if constexpr (kMode == kAntialiasingOff) {
+    return SoftLimit(input, c);
+  } else {
+    const V previous = state.limiterInput;
+    state.limiterInput = input;
+    if (!Any(Abs(input) > kLimiterKnee) && !Any(Abs(previous) > kLimiterKnee)) {
+      return input;
+    }
+    LaneArray<T, V> lanes(input);
+    LaneArray<T, V> x1(previous);
+    for (int i = 0; i < LaneArray<T, V>::kSize; i++) {
+      lanes[i] += (T)LimiterResidualADAA1(lanes[i], x1[i]);
+    }
+    return lanes.Load();
+  }
+}
+
+// Stages before the waveshaper
+template <THDModel kModel, typename V, typename T>
+inline V ProcessPre(V sample, ChannelState<V>& state,
+                    const THDCoefficients<T>& c) {
+  sample = ShelfStage<kModel>(sample, state, c);
+  return HysteresisStage<kModel>(sample, state, c);
+}
+
+// Stages after the waveshaper. These stay at the base rate when
+// oversampling: the DC blocker's response depends on the sample rate.
+template <THDModel kModel, Antialiasing kMode, typename V, typename A,
+          typename T>
+inline V ProcessPost(V sample, ChannelState<V>& state, const A& amount,
+                     const THDCoefficients<T>& c) {
+  sample = DampenStage<kModel>(sample, state, amount, c);
+  sample = DCBlocker(sample, state.dcPrevInput, state.dcPrevOutput, c);
+  return Limit<kMode>(sample, state, c);
+}
+
+// Full chain for one frame, in the same order as ProcessStages
+template <THDModel kModel, Antialiasing kMode, typename V, typename A,
+          typename T>
+inline V ProcessFrame(V sample, ChannelState<V>& state, const A& amount,
+                      const THDCoefficients<T>& c) {
+  sample = ProcessPre<kModel>(sample, state, c);
+  sample = Saturate<kModel, kMode>(sample, amount, c, state);
+  return ProcessPost<kModel, kMode>(sample, state, amount, c);
+}
+
+// Calls process with the model and the antialiasing mode as compile-time
+// constants (std::integral_constant), so every combination runs a loop of
+// its own with no per-sample branch
+template <typename Process>
+inline void DispatchModes(THDModel model, Antialiasing mode,
+                          Process process) {
+  auto withMode = [&](auto modelConstant) {
+    switch (mode) {
+    case kADAAFirstOrder:
+      process(modelConstant,
+              std::integral_constant<Antialiasing, kADAAFirstOrder>());
+      break;
+    case kADAASecondOrder:
+      process(modelConstant,
+              std::integral_constant<Antialiasing, kADAASecondOrder>());
+      break;
+    default:
+      process(modelConstant,
+              std::integral_constant<Antialiasing, kAntialiasingOff>());
+      break;
+    }
+  };
+  if (model == kTHDMagnetic) {
+    withMode(std::integral_constant<THDModel, kTHDMagnetic>());
+  } else {
+    withMode(std::integral_constant<THDModel, kTHDClassic>());
+  }
+}
+
+// The silence offset and antialiasing antiderivatives for a model chosen
+// at run time
+template <typename T>
+inline T WaveshapeSilence(THDModel model, const AmountCoefficients<T>& amount,
+                          const THDCoefficients<T>& c) {
+  return model == kTHDMagnetic ? Waveshape<kTHDMagnetic>(T(0), amount, c)
+                               : Waveshape<kTHDClassic>(T(0), amount, c);
+}
+
+inline double SaturationResidualAD1(THDModel model, double x) {
+  return model == kTHDMagnetic ? SaturationResidualAD1<kTHDMagnetic>(x)
+                               : SaturationResidualAD1<kTHDClassic>(x);
+}
+
+inline double SaturationResidualAD2(THDModel model, double x) {
+  return model == kTHDMagnetic ? SaturationResidualAD2<kTHDMagnetic>(x)
+                               : SaturationResidualAD2<kTHDClassic>(x);
+}
+
+} // namespace
+
 // Define static constants
-const float TransformerTHD::DC_BLOCKER_FREQ = 20.0f;
-const float TransformerTHD::LOW_SHELF_FREQ = 100.0f;
-const float TransformerTHD::HIGH_DAMPEN_FREQ = 8000.0f;
+template <typename T>
+const float TransformerTHD<T>::DC_BLOCKER_FREQ = kDCBlockerFreq;
+template <typename T>
+const float TransformerTHD<T>::LOW_SHELF_FREQ = kLowShelfFreq;
+template <typename T>
+const float TransformerTHD<T>::HIGH_DAMPEN_FREQ = kHighDampenFreq;
 
 // Constructor
-TransformerTHD::TransformerTHD()
+template <typename T>
+TransformerTHD<T>::TransformerTHD()
     : sampleRate(44100.0f), hysteresisState(0.0f), dcBlockerState(0.0f),
       dcBlockerPrevInput(0.0f), dcBlockerPrevOutput(0.0f), lowShelfState1(0.0f),
       lowShelfState2(0.0f), highDampenState(0.0f), thdAmount(0.3f),
-      warmth(0.5f), asymmetry(0.15f), hysteresisAmount(0.2f) {}
+      warmth(0.5f), asymmetry(0.15f), hysteresisAmount(0.2f),
+      model(kTHDClassic), waveshaper(kWaveshaperAnalytic),
+      antialiasing(kAntialiasingOff), coefficientsDirty(true) {
+  KneeTable<T>();
+  ResetAntialiasing();
+}
 
-void TransformerTHD::Initialize(float newSampleRate) {
-  sampleRate = newSampleRate;
+template <typename T> void TransformerTHD<T>::Initialize(T newSampleRate) {
+  if (newSampleRate != sampleRate) {
+    sampleRate = newSampleRate;
+    coefficientsDirty = true;
+  }
   Reset();
 }
 
-void TransformerTHD::Reset() {
+template <typename T> void TransformerTHD<T>::Reset() {
+  const T offset = SilenceOffset(thdAmount);
   hysteresisState = 0.0f;
   dcBlockerState = 0.0f;
-  dcBlockerPrevInput = 0.0f;
+  dcBlockerPrevInput = offset;
   dcBlockerPrevOutput = 0.0f;
   lowShelfState1 = 0.0f;
   lowShelfState2 = 0.0f;
-  highDampenState = 0.0f;
+  highDampenState = offset;
+  ResetAntialiasing();
+}
+
+// Silence reaches the waveshaper as the bias and the limiter as 0
+template <typename T> void TransformerTHD<T>::ResetAntialiasing() {
+  UpdateCoefficients();
+  saturationInput1 = coefficients.saturationBias;
+  saturationInput2 = coefficients.saturationBias;
+  saturationAntiderivative =
+      SaturationResidualAD2(model, coefficients.saturationBias);
+  saturationSlope = SaturationResidualAD1(model, coefficients.saturationBias);
+  limiterInput = 0.0f;
+}
+
+template <typename T> T TransformerTHD<T>::SilenceOffset(T amount) {
+  UpdateCoefficients();
+  return WaveshapeSilence(model, MakeAmountCoefficients(amount), coefficients);
+}
+
+template <typename T> void TransformerTHD<T>::SetTHDAmount(T amount) {
+  thdAmount = Clamp01(amount);
+}
+
+template <typename T> void TransformerTHD<T>::SetWarmth(T amount) {
+  SetCoefficientParam(warmth, amount);
+}
+
+template <typename T> void TransformerTHD<T>::SetAsymmetry(T amount) {
+  SetCoefficientParam(asymmetry, amount);
+}
+
+template <typename T> void TransformerTHD<T>::SetHysteresis(T amount) {
+  SetCoefficientParam(hysteresisAmount, amount);
+}
+
+template <typename T> void TransformerTHD<T>::SetModel(THDModel newModel) {
+  if (newModel != model) {
+    model = newModel;
+    coefficientsDirty = true;
+    Reset();
+  }
 }
 
-void TransformerTHD::SetTHDAmount(float amount) {
-  thdAmount = std::max(0.0f, std::min(1.0f, amount));
+template <typename T> void TransformerTHD<T>::SetWaveshaper(WaveshaperMode mode) {
+  if (mode != waveshaper) {
+    waveshaper = mode;
+    coefficientsDirty = true;
+  }
+}
+
+template <typename T>
+void TransformerTHD<T>::SetAntialiasing(Antialiasing mode) {
+  if (mode != antialiasing) {
+    antialiasing = mode;
+    ResetAntialiasing();
+  }
 }
 
-void TransformerTHD::SetWarmth(float amount) {
-  warmth = std::max(0.0f, std::min(1.0f, amount));
+template <typename T>
+void TransformerTHD<T>::SetCoefficientParam(T& param, T amount) {
+  amount = Clamp01(amount);
+  if (amount != param) {
+    param = amount;
+    coefficientsDirty = true;
+  }
 }
 
-void TransformerTHD::SetAsymmetry(float amount) {
-  asymmetry = std::max(0.0f, std::min(1.0f, amount));
+template <typename T> void TransformerTHD<T>::UpdateCoefficients() {
+  if (coefficientsDirty) {
+    coefficients = MakeCoefficients(model, warmth, asymmetry,
+                                    hysteresisAmount, sampleRate);
+    if (waveshaper == kWaveshaperTable) {
+      coefficients.kneeTable = &KneeTable<T>();
+    }
+    coefficientsDirty = false;
+  }
 }
 
-void TransformerTHD::SetHysteresis(float amount) {
-  hysteresisAmount = std::max(0.0f, std::min(1.0f, amount));
+template <typename T> T TransformerTHD<T>::ProcessSample(T inputSample) {
+  T output;
+  ProcessBlock(&inputSample, &output, 1);
+  return output;
 }
 
-float TransformerTHD::ProcessSample(float inputSample) {
-  // Safety check for invalid input
-  if (std::isnan(inputSample) || std::isinf(inputSample)) {
-    return 0.0f;
+template <typename T>
+void TransformerTHD<T>::ProcessBlock(const T* input, T* output, int nFrames) {
+  UpdateCoefficients();
+
+  bool allFinite = true;
+  for (int i = 0; i < nFrames; i++) {
+    allFinite &= std::isfinite(input[i]);
   }
 
-  // Clamp input to prevent extreme values
-  float sample = std::max(-2.0f, std::min(2.0f, inputSample));
+  if (allFinite) {
+    // Clamp input to prevent extreme values
+    for (int i = 0; i < nFrames; i++) {
+      output[i] = ClampInput(input[i]);
+    }
+    ProcessStages(output, ConstantAmount<T>{thdAmount}, nFrames);
+    return;
+  }
+
+  // Invalid samples output silence and leave the state untouched
+  const ConstantAmount<T> amount{thdAmount};
+  for (int i = 0; i < nFrames; i++) {
+    if (!std::isfinite(input[i])) {
+      output[i] = 0.0f;
+      continue;
+    }
+    output[i] = ClampInput(input[i]);
+    ProcessStages(output + i, amount, 1);
+  }
+}
+
+template <typename T>
+void TransformerTHD<T>::ProcessBlock(const T* input, T* output,
+                                     const T* thdAmounts, int nFrames) {
+  if (nFrames <= 0) {
+    return;
+  }
+  UpdateCoefficients();
+
+  bool allFinite = true;
+  for (int i = 0; i < nFrames; i++) {
+    allFinite &= std::isfinite(input[i]);
+  }
+
+  if (allFinite) {
+    for (int i = 0; i < nFrames; i++) {
+      output[i] = ClampInput(input[i]);
+    }
+    ProcessStages(output, AmountBuffer<T>{thdAmounts}, nFrames);
+  } else {
+    for (int i = 0; i < nFrames; i++) {
+      if (!std::isfinite(input[i])) {
+        output[i] = 0.0f;
+        continue;
+      }
+      output[i] = ClampInput(input[i]);
+      ProcessStages(output + i, AmountBuffer<T>{thdAmounts + i}, 1);
+    }
+  }
+
+  // Leave the last amount in place for subsequent ProcessSample calls
+  thdAmount = Clamp01(thdAmounts[nFrames - 1]);
+}
+
+template <typename T>
+template <typename AmountSource>
+void TransformerTHD<T>::ProcessStages(T* buffer, AmountSource amounts,
+                                      int nFrames) {
+  DispatchModes(model, antialiasing, [&](auto kModel, auto kMode) {
+    ProcessStagesWith<decltype(kModel)::value, decltype(kMode)::value>(
+        buffer, amounts, nFrames);
+  });
+}
+
+template <typename T>
+template <THDModel kModel, Antialiasing kMode, typename AmountSource>
+void TransformerTHD<T>::ProcessStagesWith(T* buffer, AmountSource amounts,
+                                          int nFrames) {
+  const THDCoefficients<T> c = coefficients;
+  ChannelState<T> state;
+  state.lowShelf = lowShelfState1;
+  state.lowShelf2 = lowShelfState2;
+  state.hysteresis = hysteresisState;
+  state.highDampen = highDampenState;
+  state.dcPrevInput = dcBlockerPrevInput;
+  state.dcPrevOutput = dcBlockerPrevOutput;
+  state.saturationInput1 = saturationInput1;
+  state.saturationInput2 = saturationInput2;
+  state.saturationAntiderivative[0] = saturationAntiderivative;
+  state.saturationSlope[0] = saturationSlope;
+  state.limiterInput = limiterInput;
 
   // Stage 1: Pre-emphasis (frequency shaping)
-  sample = ApplyLowShelf(sample);
+  for (int i = 0; i < nFrames; i++) {
+    buffer[i] = ShelfStage<kModel>(buffer[i], state, c);
+  }
 
   // Stage 2: Harmonic Generation
-  sample = ApplyHysteresis(sample);
-  sample = ApplyAsymmetricSaturation(sample);
+  for (int i = 0; i < nFrames; i++) {
+    buffer[i] = HysteresisStage<kModel>(buffer[i], state, c);
+  }
+  for (int i = 0; i < nFrames; i++) {
+    buffer[i] = Saturate<kModel, kMode>(buffer[i], amounts[i], c, state);
+  }
 
   // Stage 3: Post-processing
-  sample = ApplyHighDampening(sample);
-  sample = ApplyDCBlocker(sample);
-  sample = SoftLimit(sample);
+  for (int i = 0; i < nFrames; i++) {
+    buffer[i] = DampenStage<kModel>(buffer[i], state, amounts[i], c);
+  }
+  for (int i = 0; i < nFrames; i++) {
+    buffer[i] = DCBlocker(buffer[i], state.dcPrevInput, state.dcPrevOutput, c);
+  }
+  for (int i = 0; i < nFrames; i++) {
+    buffer[i] = Limit<kMode>(buffer[i], state, c);
+  }
 
-  return sample;
+  lowShelfState1 = FlushDenormal(state.lowShelf);
+  lowShelfState2 = FlushDenormal(state.lowShelf2);
+  hysteresisState = FlushDenormal(state.hysteresis);
+  highDampenState = FlushDenormal(state.highDampen);
+  dcBlockerPrevInput = FlushDenormal(state.dcPrevInput);
+  dcBlockerPrevOutput = FlushDenormal(state.dcPrevOutput);
+  saturationInput1 = state.saturationInput1;
+  saturationInput2 = state.saturationInput2;
+  saturationAntiderivative = state.saturationAntiderivative[0];
+  saturationSlope = state.saturationSlope[0];
+  limiterInput = state.limiterInput;
 }
 
-float TransformerTHD::ApplyAsymmetricSaturation(float input) {
-  // More conservative drive range
-  float drive = 1.0f + (thdAmount * 4.0f); // Reduced from 8.0f
-  float x = input * drive;
+// ==========================================
+// StereoTHD
+// ==========================================
 
-  // Asymmetry for even harmonics
-  float bias = asymmetry * 0.2f; // Reduced from 0.3f
-  x += bias;
+template <typename T>
+StereoTHD<T>::StereoTHD()
+    : sampleRate(44100.0f), thdAmount(0.3f), warmth(0.5f), asymmetry(0.15f),
+      hysteresisAmount(0.2f), model(kTHDClassic),
+      waveshaper(kWaveshaperAnalytic), antialiasing(kAntialiasingOff),
+      coefficientsDirty(true) {
+  KneeTable<T>();
+  Reset();
+}
 
-  // Waveshaping
-  float x2 = x * x;
-  float x3 = x2 * x;
+template <typename T> void StereoTHD<T>::Initialize(T newSampleRate) {
+  if (newSampleRate != sampleRate) {
+    sampleRate = newSampleRate;
+    coefficientsDirty = true;
+  }
+  Reset();
+}
 
-  // Mix of different saturation curves
-  float tanh_sat = x * (27.0f + x2) / (27.0f + 9.0f * x2);
-  float cubic_sat = x - (x3 * 0.1f);
+template <typename T> void StereoTHD<T>::Reset() {
+  const T offset = SilenceOffset(thdAmount);
+  for (int lane = 0; lane < kNumChannels; lane++) {
+    hysteresisState[lane] = 0.0f;
+    dcBlockerState[lane] = 0.0f;
+    dcBlockerPrevInput[lane] = offset;
+    dcBlockerPrevOutput[lane] = 0.0f;
+    lowShelfState1[lane] = 0.0f;
+    lowShelfState2[lane] = 0.0f;
+    highDampenState[lane] = offset;
+  }
+  oversampler.Reset(Lanes(offset));
+  ResetAntialiasing();
+}
 
-  // Blend the two saturation types
-  float saturated = tanh_sat * 0.7f + cubic_sat * 0.3f;
+template <typename T> void StereoTHD<T>::ResetAntialiasing() {
+  UpdateCoefficients();
+  const T bias = coefficients.saturationBias;
+  for (int lane = 0; lane < kNumChannels; lane++) {
+    saturationInput1[lane] = bias;
+    saturationInput2[lane] = bias;
+    saturationAntiderivative[lane] = SaturationResidualAD2(model, bias);
+    saturationSlope[lane] = SaturationResidualAD1(model, bias);
+    limiterInput[lane] = 0.0f;
+  }
+}
 
-  // Remove DC offset from asymmetry
-  saturated -= bias * 0.5f;
+template <typename T> T StereoTHD<T>::SilenceOffset(T amount) {
+  UpdateCoefficients();
+  return WaveshapeSilence(model, MakeAmountCoefficients(amount), coefficients);
+}
 
-  // BETTER GAIN COMPENSATION - This is key!
-  float compensation =
-      1.0f / (1.0f + thdAmount * 3.5f); // More aggressive compensation
+template <typename T> void StereoTHD<T>::SetTHDAmount(T amount) {
+  thdAmount = Clamp01(amount);
+}
 
-  // Adjust wetness to start at 0 when THD is at 0
-  float wetness = thdAmount; // Linear from 0 to 1, no minimum wetness!
+template <typename T> void StereoTHD<T>::SetWarmth(T amount) {
+  SetCoefficientParam(warmth, amount);
+}
 
-  // When THD is 0, output = 100% dry (no volume change)
-  return input * (1.0f - wetness) + saturated * wetness * compensation;
+template <typename T> void StereoTHD<T>::SetAsymmetry(T amount) {
+  SetCoefficientParam(asymmetry, amount);
+}
+
+template <typename T> void StereoTHD<T>::SetHysteresis(T amount) {
+  SetCoefficientParam(hysteresisAmount, amount);
+}
+
+template <typename T> void StereoTHD<T>::SetModel(THDModel newModel) {
+  if (newModel != model) {
+    model = newModel;
+    coefficientsDirty = true;
+    Reset();
+  }
+}
+
+template <typename T> void StereoTHD<T>::SetWaveshaper(WaveshaperMode mode) {
+  if (mode != waveshaper) {
+    waveshaper = mode;
+    coefficientsDirty = true;
+  }
+}
+
+template <typename T> void StereoTHD<T>::SetAntialiasing(Antialiasing mode) {
+  if (mode != antialiasing) {
+    antialiasing = mode;
+    ResetAntialiasing();
+  }
+}
+
+template <typename T>
+void StereoTHD<T>::SetCoefficientParam(T& param, T amount) {
+  amount = Clamp01(amount);
+  if (amount != param) {
+    param = amount;
+    coefficientsDirty = true;
+  }
+}
+
+template <typename T> void StereoTHD<T>::UpdateCoefficients() {
+  if (coefficientsDirty) {
+    coefficients = MakeCoefficients(model, warmth, asymmetry,
+                                    hysteresisAmount, sampleRate);
+    if (waveshaper == kWaveshaperTable) {
+      coefficients.kneeTable = &KneeTable<T>();
+    }
+    coefficientsDirty = false;
+  }
+}
+
+template <typename T>
+void StereoTHD<T>::SetOversampling(int numStages, OversamplingFilter filter) {
+  oversampler.Setup(numStages, filter);
+}
+
+template <typename T> int StereoTHD<T>::GetLatency() const {
+  return Latency(oversampler.GetNumStages(), oversampler.GetFilter(),
+                 antialiasing);
 }
-float TransformerTHD::ApplyHysteresis(float input) {
-  float hyst = hysteresisAmount * 0.05f;
-  float diff = input - hysteresisState;
 
-  if (std::abs(diff) > hyst) {
-    hysteresisState += diff * 0.8f;
+template <typename T>
+int StereoTHD<T>::Latency(int numStages, OversamplingFilter filter,
+                          Antialiasing mode) {
+  double delay = Oversampler<Lanes>::Delay(numStages, filter);
+  if (mode == kADAASecondOrder) {
+    numStages = std::max(0, std::min(numStages, Oversampler<Lanes>::kMaxStages));
+    delay += 1.0 / (double)(1 << numStages);
+  }
+  return (int)std::lround(delay);
+}
+
+template <typename T>
+void StereoTHD<T>::ProcessBlock(const T* const* inputs, T* const* outputs,
+                                int nChannels, int nFrames) {
+  UpdateCoefficients();
+
+  bool allFinite = true;
+  for (int c = 0; c < nChannels; c++) {
+    for (int i = 0; i < nFrames; i++) {
+      allFinite &= std::isfinite(inputs[c][i]);
+    }
+  }
+
+  if (nChannels == 2 && allFinite) {
+    ProcessStereo(inputs, outputs, ConstantAmount<T>{thdAmount}, nFrames);
+    return;
+  }
+
+  if (oversampler.GetNumStages() > 0) {
+    ProcessSanitized(inputs, outputs, nChannels, ConstantAmount<T>{thdAmount},
+                     nFrames);
+    return;
+  }
+
+  for (int c = 0; c < nChannels; c++) {
+    ProcessLane(c, inputs[c], outputs[c], ConstantAmount<T>{thdAmount},
+                nFrames);
+  }
+}
+
+template <typename T>
+void StereoTHD<T>::ProcessBlock(const T* const* inputs, T* const* outputs,
+                                int nChannels, const T* thdAmounts,
+                                int nFrames) {
+  if (nFrames <= 0) {
+    return;
+  }
+  UpdateCoefficients();
+
+  bool allFinite = true;
+  for (int c = 0; c < nChannels; c++) {
+    for (int i = 0; i < nFrames; i++) {
+      allFinite &= std::isfinite(inputs[c][i]);
+    }
+  }
+
+  if (nChannels == 2 && allFinite) {
+    ProcessStereo(inputs, outputs, AmountBuffer<T>{thdAmounts}, nFrames);
+  } else if (oversampler.GetNumStages() > 0) {
+    ProcessSanitized(inputs, outputs, nChannels, AmountBuffer<T>{thdAmounts},
+                     nFrames);
   } else {
-    hysteresisState += diff * 0.3f;
+    for (int c = 0; c < nChannels; c++) {
+      ProcessLane(c, inputs[c], outputs[c], AmountBuffer<T>{thdAmounts},
+                  nFrames);
+    }
   }
 
-  return input * (1.0f - hysteresisAmount * 0.2f) +
-         hysteresisState * (hysteresisAmount * 0.2f);
+  thdAmount = Clamp01(thdAmounts[nFrames - 1]);
 }
 
-float TransformerTHD::ApplyLowShelf(float input) {
-  float freq = LOW_SHELF_FREQ / sampleRate;
-  float w = 2.0f * M_PI * freq;
-  float cosw = std::cos(w);
-  float sinw = std::sin(w);
+template <typename T>
+void StereoTHD<T>::ProcessBlock(const T* const* inputs, T* const* outputs,
+                                int nChannels, const T* const* thdAmounts,
+                                int nFrames) {
+  // Shared amounts take the cheaper path
+  if (nChannels < 2 || thdAmounts[0] == thdAmounts[1]) {
+    ProcessBlock(inputs, outputs, nChannels, thdAmounts[0], nFrames);
+    return;
+  }
+  if (nFrames <= 0) {
+    return;
+  }
+  UpdateCoefficients();
 
-  float gain = 1.0f + (warmth * 0.3f);
-  float S = 1.0f;
-  float A = std::sqrt(gain);
+  bool allFinite = true;
+  for (int c = 0; c < nChannels; c++) {
+    for (int i = 0; i < nFrames; i++) {
+      allFinite &= std::isfinite(inputs[c][i]);
+    }
+  }
 
-  float alpha = sinw / 2.0f * std::sqrt((A + 1 / A) * (1 / S - 1) + 2);
-  float a0 = (A + 1) + (A - 1) * cosw + 2 * std::sqrt(A) * alpha;
+  const LaneAmountBuffers<T> amounts{thdAmounts[0], thdAmounts[1]};
+  if (allFinite) {
+    ProcessStereo(inputs, outputs, amounts, nFrames);
+  } else if (oversampler.GetNumStages() > 0) {
+    ProcessSanitized(inputs, outputs, nChannels, amounts, nFrames);
+  } else {
+    for (int c = 0; c < nChannels; c++) {
+      ProcessLane(c, inputs[c], outputs[c], AmountBuffer<T>{thdAmounts[c]},
+                  nFrames);
+    }
+  }
 
-  lowShelfState1 = lowShelfState1 * 0.95f + input * 0.05f * gain;
-  return input + lowShelfState1 * warmth * 0.3f;
+  thdAmount = Clamp01(thdAmounts[0][nFrames - 1]);
 }
 
-float TransformerTHD::ApplyHighDampening(float input) {
-  float freq = HIGH_DAMPEN_FREQ / sampleRate;
-  float alpha = std::exp(-2.0f * M_PI * freq);
-  float dampenAmount = thdAmount * 0.3f;
+template <typename T>
+template <typename AmountSource>
+void StereoTHD<T>::ProcessStereo(const T* const* inputs, T* const* outputs,
+                                 AmountSource amounts, int nFrames) {
+  DispatchModes(model, antialiasing, [&](auto kModel, auto kMode) {
+    ProcessStereoWith<decltype(kModel)::value, decltype(kMode)::value>(
+        inputs, outputs, amounts, nFrames);
+  });
+}
 
-  highDampenState = input * (1.0f - alpha) + highDampenState * alpha;
+template <typename T>
+template <THDModel kModel, Antialiasing kMode, typename AmountSource>
+void StereoTHD<T>::ProcessStereoWith(const T* const* inputs,
+                                     T* const* outputs, AmountSource amounts,
+                                     int nFrames) {
+  ChannelState<Lanes> state;
+  state.hysteresis = Lanes::Load(hysteresisState);
+  state.lowShelf = Lanes::Load(lowShelfState1);
+  state.lowShelf2 = Lanes::Load(lowShelfState2);
+  state.highDampen = Lanes::Load(highDampenState);
+  state.dcPrevInput = Lanes::Load(dcBlockerPrevInput);
+  state.dcPrevOutput = Lanes::Load(dcBlockerPrevOutput);
+  if constexpr (kMode != kAntialiasingOff) {
+    state.saturationInput1 = Lanes::Load(saturationInput1);
+    state.saturationInput2 = Lanes::Load(saturationInput2);
+    state.limiterInput = Lanes::Load(limiterInput);
+    for (int lane = 0; lane < kNumChannels; lane++) {
+      state.saturationAntiderivative[lane] = saturationAntiderivative[lane];
+      state.saturationSlope[lane] = saturationSlope[lane];
+    }
+  }
+  const THDCoefficients<T> c = coefficients;
+
+  alignas(16) T frame[kNumChannels];
+  for (int i = 0; i < nFrames; i++) {
+    frame[0] = ClampInput(inputs[0][i]);
+    frame[1] = ClampInput(inputs[1][i]);
+
+    // Only the waveshaper runs oversampled
+    const auto amount = amounts[i];
+    auto saturate = [&](Lanes x) {
+      return Saturate<kModel, kMode>(x, amount, c, state);
+    };
+    Lanes sample = ProcessPre<kModel>(Lanes::Load(frame), state, c);
+    sample = oversampler.Process(sample, saturate);
+    sample = ProcessPost<kModel, kMode>(sample, state, amount, c);
+    sample.Store(frame);
+
+    outputs[0][i] = frame[0];
+    outputs[1][i] = frame[1];
+  }
 
-  return input * (1.0f - dampenAmount) + highDampenState * dampenAmount;
+  FlushDenormal(state.hysteresis).Store(hysteresisState);
+  FlushDenormal(state.lowShelf).Store(lowShelfState1);
+  FlushDenormal(state.lowShelf2).Store(lowShelfState2);
+  FlushDenormal(state.highDampen).Store(highDampenState);
+  FlushDenormal(state.dcPrevInput).Store(dcBlockerPrevInput);
+  FlushDenormal(state.dcPrevOutput).Store(dcBlockerPrevOutput);
+  oversampler.FlushDenormals();
+  if constexpr (kMode != kAntialiasingOff) {
+    state.saturationInput1.Store(saturationInput1);
+    state.saturationInput2.Store(saturationInput2);
+    state.limiterInput.Store(limiterInput);
+    for (int lane = 0; lane < kNumChannels; lane++) {
+      saturationAntiderivative[lane] = state.saturationAntiderivative[lane];
+      saturationSlope[lane] = state.saturationSlope[lane];
+    }
+  }
 }
 
-float TransformerTHD::ApplyDCBlocker(float input) {
-  float freq = DC_BLOCKER_FREQ / sampleRate;
-  float alpha = 1.0f / (1.0f + 2.0f * M_PI * freq);
+// Scalar path for mono and for blocks containing invalid samples
+template <typename T>
+template <typename AmountSource>
+void StereoTHD<T>::ProcessLane(int lane, const T* input, T* output,
+                               AmountSource amounts, int nFrames) {
+  DispatchModes(model, antialiasing, [&](auto kModel, auto kMode) {
+    ProcessLaneWith<decltype(kModel)::value, decltype(kMode)::value>(
+        lane, input, output, amounts, nFrames);
+  });
+}
 
-  float output =
-      input - dcBlockerPrevInput + dcBlockerPrevOutput * (1.0f - alpha);
+template <typename T>
+template <THDModel kModel, Antialiasing kMode, typename AmountSource>
+void StereoTHD<T>::ProcessLaneWith(int lane, const T* input, T* output,
+                                   AmountSource amounts, int nFrames) {
+  ChannelState<T> state;
+  state.hysteresis = hysteresisState[lane];
+  state.lowShelf = lowShelfState1[lane];
+  state.lowShelf2 = lowShelfState2[lane];
+  state.highDampen = highDampenState[lane];
+  state.dcPrevInput = dcBlockerPrevInput[lane];
+  state.dcPrevOutput = dcBlockerPrevOutput[lane];
+  state.saturationInput1 = saturationInput1[lane];
+  state.saturationInput2 = saturationInput2[lane];
+  state.saturationAntiderivative[0] = saturationAntiderivative[lane];
+  state.saturationSlope[0] = saturationSlope[lane];
+  state.limiterInput = limiterInput[lane];
+  const THDCoefficients<T> c = coefficients;
 
-  dcBlockerPrevInput = input;
-  dcBlockerPrevOutput = output;
+  for (int i = 0; i < nFrames; i++) {
+    if (!std::isfinite(input[i])) {
+      output[i] = 0.0f;
+      continue;
+    }
+    output[i] =
+        ProcessFrame<kModel, kMode>(ClampInput(input[i]), state, amounts[i],
+                                    c);
+  }
 
-  return output;
+  hysteresisState[lane] = FlushDenormal(state.hysteresis);
+  lowShelfState1[lane] = FlushDenormal(state.lowShelf);
+  lowShelfState2[lane] = FlushDenormal(state.lowShelf2);
+  highDampenState[lane] = FlushDenormal(state.highDampen);
+  dcBlockerPrevInput[lane] = FlushDenormal(state.dcPrevInput);
+  dcBlockerPrevOutput[lane] = FlushDenormal(state.dcPrevOutput);
+  saturationInput1[lane] = state.saturationInput1;
+  saturationInput2[lane] = state.saturationInput2;
+  saturationAntiderivative[lane] = state.saturationAntiderivative[0];
+  saturationSlope[lane] = state.saturationSlope[0];
+  limiterInput[lane] = state.limiterInput;
 }
 
-float TransformerTHD::SoftLimit(float input) {
-  if (std::abs(input) > 0.95f) {
-    float sign = (input > 0) ? 1.0f : -1.0f;
-    float excess = std::abs(input) - 0.95f;
-    return sign * (0.95f + std::tanh(excess * 2.0f) * 0.05f);
+// The oversampling filters hold both lanes together, so with oversampling
+// on, mono and invalid input still go through the stereo path: missing or
+// invalid samples are fed as silence and output silence.
+template <typename T>
+template <typename AmountSource>
+void StereoTHD<T>::ProcessSanitized(const T* const* inputs, T* const* outputs,
+                                    int nChannels, AmountSource amounts,
+                                    int nFrames) {
+  constexpr int kChunkSize = 64;
+  T buffer[kNumChannels][kChunkSize];
+  const T* bufferIn[kNumChannels] = {buffer[0], buffer[1]};
+  T* bufferOut[kNumChannels] = {buffer[0], buffer[1]};
+
+  for (int start = 0; start < nFrames; start += kChunkSize) {
+    const int chunkFrames = std::min(kChunkSize, nFrames - start);
+
+    for (int c = 0; c < kNumChannels; c++) {
+      for (int i = 0; i < chunkFrames; i++) {
+        const T sample = c < nChannels ? inputs[c][start + i] : T(0);
+        buffer[c][i] = std::isfinite(sample) ? sample : T(0);
+      }
+    }
+
+    ProcessStereo(bufferIn, bufferOut, amounts.Offset(start), chunkFrames);
+
+    for (int c = 0; c < nChannels; c++) {
+      for (int i = 0; i < chunkFrames; i++) {
+        const bool valid = std::isfinite(inputs[c][start + i]);
+        outputs[c][start + i] = valid ? buffer[c][i] : T(0);
+      }
+    }
   }
-  return input;
 }
+
+template class TransformerTHD<float>;
+template class TransformerTHD<double>;
+template class StereoTHD<float>;
+template class StereoTHD<double>;
@@ -4,23 +4,93 @@
 #include <algorithm>
 #include <cmath>
 
-class TransformerTHD {
+#include "Oversampling.h"
+#include "SIMD.h"
+#include "Waveshaper.h"
+
+// Both THD classes run in float or double (T), chosen by the engine at
+// compile time; THD.cpp instantiates both.
+
+// The transformer models. Both run the same chain (low shelf, hysteresis,
+// waveshaper, high dampening, DC blocker, soft limiter) with their own
+// stage math; each block runs a loop compiled for the selected model.
+enum THDModel {
+  kTHDClassic = 0, // Rational/cubic blend, one-pole shelf, dark dampening
+  kTHDMagnetic     // Rational waveshaper, saturating hysteresis, bass and
+                   // sub shelves, gentler dampening
+};
+
+// Per-sample constants derived from the parameters and the sample rate.
+// Setters only mark them dirty; they are rebuilt at the next block.
+template <typename T> struct THDCoefficients {
+  T lowShelfInputGain;
+  T lowShelfMix;
+  T hysteresisThreshold;
+  T hysteresisDry;
+  T hysteresisWet;
+  T saturationBias;
+  T highDampenAlpha;
+  T dcBlockerFeedback;
+  // tanh knee of the soft limiter, evaluated exactly when null
+  const WaveshaperTable<T>* kneeTable;
+
+  // Magnetic model only
+  bool lowShelfActive;
+  T bassCoef;
+  T subCoef;
+  T bassBoost;
+  T subBoost;
+  T bassSaturation;
+  bool hysteresisActive;
+  T hysteresisFastRate;
+  T hysteresisSlowRate;
+  T hysteresisKnee;
+  T hysteresisHighFreq;
+  T secondHarmonic;
+};
+
+// Antiderivative antialiasing of the waveshaper and the soft limiter: much
+// cheaper than oversampling, and the two combine (the waveshaper is then
+// antialiased at the oversampled rate)
+enum Antialiasing {
+  kAntialiasingOff = 0,
+  kADAAFirstOrder, // Waveshaper and limiter first order
+  kADAASecondOrder // Waveshaper second order, limiter first order
+};
+
+template <typename T> class TransformerTHD {
 private:
   // State Variables
-  float sampleRate;
-  float hysteresisState;
-  float dcBlockerState;
-  float dcBlockerPrevInput;
-  float dcBlockerPrevOutput;
-  float lowShelfState1;
-  float lowShelfState2;
-  float highDampenState;
+  T sampleRate;
+  T hysteresisState;
+  T dcBlockerState;
+  T dcBlockerPrevInput;
+  T dcBlockerPrevOutput;
+  T lowShelfState1;
+  T lowShelfState2;
+  T highDampenState;
+
+  // Antialiasing history: the last two waveshaper inputs, the second-order
+  // antiderivative at the last one and its slope over the two, and the
+  // last limiter input
+  T saturationInput1;
+  T saturationInput2;
+  double saturationAntiderivative;
+  double saturationSlope;
+  T limiterInput;
 
   // User Parameters
-  float thdAmount;
-  float warmth;
-  float asymmetry;
-  float hysteresisAmount;
+  T thdAmount;
+  T warmth;
+  T asymmetry;
+  T hysteresisAmount;
+
+  THDModel model;
+  WaveshaperMode waveshaper;
+  Antialiasing antialiasing;
+
+  THDCoefficients<T> coefficients;
+  bool coefficientsDirty;
 
   // Internal Constants
   static const float DC_BLOCKER_FREQ;
@@ -32,20 +102,153 @@ public:
   TransformerTHD();
 
   // Public methods
-  void Initialize(float newSampleRate);
+  void Initialize(T newSampleRate);
+  // Settles on silence at the current THD amount (see StereoTHD::Reset)
   void Reset();
-  void SetTHDAmount(float amount);
-  void SetWarmth(float amount);
-  void SetAsymmetry(float amount);
-  void SetHysteresis(float amount);
-  float ProcessSample(float inputSample);
+  void SetTHDAmount(T amount);
+  void SetWarmth(T amount);
+  void SetAsymmetry(T amount);
+  void SetHysteresis(T amount);
+  // Classic by default; a change resets (see StereoTHD::SetModel)
+  void SetModel(THDModel newModel);
+  // Analytic by default
+  void SetWaveshaper(WaveshaperMode mode);
+  // Off by default; a change restarts the antialiasing history from silence
+  void SetAntialiasing(Antialiasing mode);
+  T ProcessSample(T inputSample);
+
+  // Block processing (in and out may alias)
+  void ProcessBlock(const T* input, T* output, int nFrames);
+
+  // Block processing with a per-sample THD amount (0-1)
+  void ProcessBlock(const T* input, T* output, const T* thdAmounts,
+                    int nFrames);
 
 private:
   // Private methods
-  float ApplyAsymmetricSaturation(float input);
-  float ApplyHysteresis(float input);
-  float ApplyLowShelf(float input);
-  float ApplyHighDampening(float input);
-  float ApplyDCBlocker(float input);
-  float SoftLimit(float input);
+  void SetCoefficientParam(T& param, T amount);
+  void UpdateCoefficients();
+  T SilenceOffset(T amount);
+  void ResetAntialiasing();
+  template <typename AmountSource>
+  void ProcessStages(T* buffer, AmountSource amounts, int nFrames);
+  template <THDModel kModel, Antialiasing kMode, typename AmountSource>
+  void ProcessStagesWith(T* buffer, AmountSource amounts, int nFrames);
+};
+
+// Two TransformerTHD channels sharing one set of parameters, processed
+// together with each channel's state in its own SIMD lane. The engine runs
+// one per channel pair.
+template <typename T> class StereoTHD {
+private:
+  static constexpr int kNumChannels = 2;
+
+  // Both channels in one register: Float2 or Double2
+  using Lanes = typename SampleLanes<T>::Pair;
+
+  T sampleRate;
+
+  // Per-channel state, one SIMD lane each
+  alignas(16) T hysteresisState[kNumChannels];
+  alignas(16) T dcBlockerState[kNumChannels];
+  alignas(16) T dcBlockerPrevInput[kNumChannels];
+  alignas(16) T dcBlockerPrevOutput[kNumChannels];
+  alignas(16) T lowShelfState1[kNumChannels];
+  alignas(16) T lowShelfState2[kNumChannels];
+  alignas(16) T highDampenState[kNumChannels];
+
+  // Antialiasing history (see TransformerTHD), at the rate each curve runs
+  alignas(16) T saturationInput1[kNumChannels];
+  alignas(16) T saturationInput2[kNumChannels];
+  double saturationAntiderivative[kNumChannels];
+  double saturationSlope[kNumChannels];
+  alignas(16) T limiterInput[kNumChannels];
+
+  // User Parameters
+  T thdAmount;
+  T warmth;
+  T asymmetry;
+  T hysteresisAmount;
+
+  THDModel model;
+  WaveshaperMode waveshaper;
+  Antialiasing antialiasing;
+
+  THDCoefficients<T> coefficients;
+  bool coefficientsDirty;
+
+  // Runs the nonlinear stages at 1x - 8x; both channels in one instance
+  Oversampler<Lanes> oversampler;
+
+public:
+  StereoTHD();
+
+  // Recomputes the coefficients only when the sample rate changes
+  void Initialize(T newSampleRate);
+
+  // Settles on silence at the current THD amount and settings. Silence
+  // comes out of the waveshaper as its bias offset; the state is set as if
+  // that offset had long passed the DC blocker, so the output is silent
+  // from the first sample without a warm-up.
+  void Reset();
+  void SetTHDAmount(T amount);
+  void SetWarmth(T amount);
+  void SetAsymmetry(T amount);
+  void SetHysteresis(T amount);
+
+  // Classic by default. A change resets the THD (Reset), since the models
+  // keep different state; no allocation, so it may be called from the
+  // audio thread.
+  void SetModel(THDModel newModel);
+
+  // Analytic by default; the table mode reads the soft limiter's tanh (and
+  // the Magnetic model's) from a table shared by every instance. Marks the
+  // coefficients dirty only on a change, so it may be called every block.
+  void SetWaveshaper(WaveshaperMode mode);
+
+  // Off by default. A change restarts the antialiasing history from
+  // silence, as SetOversampling restarts the filters; no allocation.
+  void SetAntialiasing(Antialiasing mode);
+
+  // numStages: 0 (off), 1 (2x), 2 (4x) or 3 (8x). Resets the filter state
+  // but no allocation, so it may be called from the audio thread.
+  void SetOversampling(int numStages, OversamplingFilter filter);
+
+  // Latency in samples added by the current oversampling and antialiasing
+  // settings: the oversampling filters' delay plus, for second-order ADAA,
+  // one sample at the rate the waveshaper runs, rounded. First-order ADAA
+  // lags by half a sample, which is left out.
+  int GetLatency() const;
+  static int Latency(int numStages, OversamplingFilter filter,
+                     Antialiasing mode);
+
+  // nChannels is 1 or 2; in and out may alias
+  void ProcessBlock(const T* const* inputs, T* const* outputs, int nChannels,
+                    int nFrames);
+  void ProcessBlock(const T* const* inputs, T* const* outputs, int nChannels,
+                    const T* thdAmounts, int nFrames);
+  // One amount buffer per channel (the two may be the same buffer)
+  void ProcessBlock(const T* const* inputs, T* const* outputs, int nChannels,
+                    const T* const* thdAmounts, int nFrames);
+
+private:
+  void SetCoefficientParam(T& param, T amount);
+  void UpdateCoefficients();
+  T SilenceOffset(T amount);
+  void ResetAntialiasing();
+  template <typename AmountSource>
+  void ProcessStereo(const T* const* inputs, T* const* outputs,
+                     AmountSource amounts, int nFrames);
+  template <THDModel kModel, Antialiasing kMode, typename AmountSource>
+  void ProcessStereoWith(const T* const* inputs, T* const* outputs,
+                         AmountSource amounts, int nFrames);
+  template <typename AmountSource>
+  void ProcessLane(int lane, const T* input, T* output, AmountSource amounts,
+                   int nFrames);
+  template <THDModel kModel, Antialiasing kMode, typename AmountSource>
+  void ProcessLaneWith(int lane, const T* input, T* output,
+                       AmountSource amounts, int nFrames);
+  template <typename AmountSource>
+  void ProcessSanitized(const T* const* inputs, T* const* outputs,
+                        int nChannels, AmountSource amounts, int nFrames);
 };
@@ -0,0 +1,977 @@
+#include "ToastEngine.h"
+
+#include <cstring>
+#include <type_traits>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+namespace {
+
+// Link group sizes for kLinkGrouped by channel count, in the SMPTE / VST3
+// channel order: front L R C, LFE, surrounds, heights (0 ends the list)
+constexpr int kLinkGroupSizes[ToastEngine::kMaxChannels + 1][4] = {
+    {0},          {1},          {2},          {3},          // mono - LCR
+    {2, 2},       {3, 2},       {3, 1, 2},    {3, 1, 3},    // quad - 6.1
+    {3, 1, 4},    {3, 1, 4, 1}, {3, 1, 2, 4}, {3, 1, 4, 3}, // 7.1 - 7.1.3
+    {3, 1, 4, 4}, {3, 1, 4, 5}, {3, 1, 4, 6}, {3, 1, 6, 5}, // 7.1.4 - 9.1.5
+    {3, 1, 6, 6},                                           // 9.1.6
+};
+
+// A host buffer in the engine's precision: the buffer itself when that is
+// double, else converted into scratch
+template <typename T>
+const T* ToSample(const double* host, T* scratch, int nFrames)
+{
+    if constexpr (std::is_same<T, double>::value) {
+        return host;
+    } else {
+        for (int i = 0; i < nFrames; i++) {
+            scratch[i] = (T)host[i];
+        }
+        return scratch;
+    }
+}
+
+// A smoothed gain in dB as a gain in the engine's precision: the fast
+// approximation in the float build (within 5e-4 dB of the exact gain the
+// settled path uses), exact in the double build, so the reference settles
+// without a step
+template <typename T>
+T DBToGain(double dB)
+{
+    if constexpr (std::is_same<T, double>::value) {
+        return std::pow(10.0, dB / 20.0);
+    } else {
+        return FastDBToAmp((float)dB);
+    }
+}
+
+} // namespace
+
+ToastEngine::ToastEngine()
+{
+}
+
+void ToastEngine::ProcessBlock(double** inputs, double** outputs, int nChans, int nFrames,
+                               double** sidechain, int nSidechainChans)
+{
+    // Decaying filter states would otherwise run through denormals
+    ScopedFlushDenormals flushDenormals;
+    
+    // Oversampling changes are applied here so mTHD is only reconfigured on
+    // the audio thread
+    const int oversamplingStages = mRequestedOversamplingStages.load(std::memory_order_relaxed);
+    const auto oversamplingFilter = (OversamplingFilter)mRequestedOversamplingFilter.load(std::memory_order_relaxed);
+    if (oversamplingStages != mOversamplingStages || oversamplingFilter != mOversamplingFilter) {
+        ApplyOversampling(oversamplingStages, oversamplingFilter);
+    }
+    const auto model = (THDModel)mRequestedModel.load(std::memory_order_relaxed);
+    if (model != mModel) {
+        ApplyModel(model);
+    }
+    const auto waveshaper = (WaveshaperMode)mRequestedWaveshaper.load(std::memory_order_relaxed);
+    if (waveshaper != mWaveshaper) {
+        ApplyWaveshaper(waveshaper);
+    }
+    const auto antialiasing = (Antialiasing)mRequestedAntialiasing.load(std::memory_order_relaxed);
+    if (antialiasing != mAntialiasing) {
+        ApplyAntialiasing(antialiasing);
+    }
+    const int lookaheadSamples = LookaheadSamples(mRequestedLookaheadMs.load(std::memory_order_relaxed));
+    if (lookaheadSamples != mLookaheadSamples) {
+        ApplyLookahead(lookaheadSamples);
+    }
+    const double detectorHighPass = mRequestedDetectorHighPass.load(std::memory_order_relaxed);
+    const double detectorLowPass = mRequestedDetectorLowPass.load(std::memory_order_relaxed);
+    if (detectorHighPass != mDetectorHighPass || detectorLowPass != mDetectorLowPass) {
+        mDetectorHighPass = detectorHighPass;
+        mDetectorLowPass = detectorLowPass;
+        mDetectorFilter.Setup(mDetectorHighPass, mDetectorLowPass, mSampleRate);
+    }
+    mThresholdDb = mRequestedThresholdDb.load(std::memory_order_relaxed);
+    const double attackMs = mRequestedAttackMs.load(std::memory_order_relaxed);
+    const double releaseMs = mRequestedReleaseMs.load(std::memory_order_relaxed);
+    const double curve = mRequestedCurve.load(std::memory_order_relaxed);
+    if (attackMs != mAttackMs || releaseMs != mReleaseMs || curve != mCurveValue) {
+        ApplyEnvelopeSettings(attackMs, releaseMs, curve);
+    }
+    if (!sidechain) {
+        nSidechainChans = 0;
+    }
+    // Channels beyond those allocated for in Reset pass through
+    for (int c = mNumChannels; c < nChans; c++) {
+        if (outputs[c] != inputs[c]) {
+            std::memcpy(outputs[c], inputs[c], nFrames * sizeof(double));
+        }
+    }
+    nChans = std::min(nChans, mNumChannels);
+    const auto requestedLink = (EnvelopeLink)mRequestedEnvelopeLink.load(std::memory_order_relaxed);
+    const EnvelopeLink link = nSidechainChans > 0 ? kLinkMax : requestedLink;
+    if (link != mEnvelopeLink || nChans != mLinkChannels) {
+        ApplyEnvelopeLink(link, nChans);
+    }
+    const int bypassFadeSamples = BypassFadeSamples(mRequestedBypassFadeMs.load(std::memory_order_relaxed));
+    const auto bypassCurve = (BypassCurve)mRequestedBypassCurve.load(std::memory_order_relaxed);
+    if (bypassFadeSamples != mBypassFadeLength || bypassCurve != mBypassCurve) {
+        ApplyBypassFade(bypassFadeSamples, bypassCurve);
+    }
+    
+    // One snapshot of the smoothed parameter targets per block
+    const ParamSnapshot targets = LoadParamTargets();
+    if (!(targets == mParams)) {
+        mParams = targets;
+        mParamsSettled = false;
+    }
+    
+    // Bypass when the host deactivates or soft-bypasses the plugin
+    const bool shouldBypass = !mHostIsActive.load(std::memory_order_relaxed) ||
+                              mHostBypassed.load(std::memory_order_relaxed);
+    
+    // Detect bypass state changes; reversing a fade in progress continues
+    // from the current mix
+    if (shouldBypass != mBypassState) {
+        mBypassState = shouldBypass;
+        mBypassFadeCounter = mBypassFading ? mBypassFadeLength - mBypassFadeCounter : 0;
+        mBypassFading = true;
+    }
+    
+    // Skip everything once the input has been silent for longer than the
+    // tail; the first sound afterwards resumes from the decayed state. True
+    // bypass (once the fade is over) still passes the input through, and
+    // keeps counting, so the delays stay current for the fade back in.
+    const bool trueBypass = mBypassState && !mBypassFading;
+    if (IsSilent(inputs, nChans, nFrames)) {
+        if (mSilentFrames >= GetTailSamples() && !trueBypass) {
+            ProcessIdle(outputs, nChans, nFrames);
+            return;
+        }
+        mSilentFrames += std::min(nFrames, std::numeric_limits<int>::max() - mSilentFrames);
+    } else {
+        mSilentFrames = 0;
+        mIdle = false;
+    }
+    
+    if (trueBypass) {
+        ProcessBypassed(inputs, outputs, nChans, nFrames);
+        return;
+    }
+    mBypassSuspended = false;
+    
+    ProcessFrames(inputs, outputs, nChans, nFrames, sidechain, nSidechainChans);
+    
+    if (!mParamsSettled) {
+        UpdateParamSettled();
+    }
+}
+
+void ToastEngine::ProcessFrames(double** inputs, double** outputs, int nChans, int nFrames,
+                                double** sidechain, int nSidechainChans)
+{
+    Sample* const* converted = mChunkBuffers[kChunkConverted];
+    Sample* const* filtered = mChunkBuffers[kChunkFiltered];
+    Sample* const* dry = mChunkBuffers[kChunkDry];
+    Sample* const* thdInput = mChunkBuffers[kChunkTHDInput];
+    Sample* const* thdOutput = mChunkBuffers[kChunkTHDOutput];
+    Sample* const* thdAmounts = mChunkBuffers[kChunkTHDAmounts];
+    Sample* const* envelopes = mChunkBuffers[kChunkEnvelopes];
+    
+    // Process in chunks: control signals, THD per channel pair, then the
+    // output stage straight into the host buffers. The channel buffers of a
+    // chunk are the scratch allocated in Reset, so any block size runs
+    // without allocating.
+    for (int start = 0; start < nFrames; start += kTHDChunkSize) {
+        const int chunkFrames = std::min(kTHDChunkSize, nFrames - start);
+        
+        Sample driveGains[kTHDChunkSize];
+        Sample thdBaseAmounts[kTHDChunkSize];
+        Sample dynamicsAmounts[kTHDChunkSize];
+        Sample outputGains[kTHDChunkSize];
+        Sample dryGains[kTHDChunkSize];
+        Sample wetGains[kTHDChunkSize];
+        
+        // The host input (and sidechain) in the engine's precision
+        const Sample* chunkInputs[kMaxChannels];
+        const Sample* chunkSidechain[2];
+        for (int c = 0; c < nChans; c++) {
+            chunkInputs[c] = ToSample(inputs[c] + start, converted[c], chunkFrames);
+        }
+        for (int c = 0; c < nSidechainChans; c++) {
+            chunkSidechain[c] = ToSample(sidechain[c] + start, converted[mNumChannels + c], chunkFrames);
+        }
+        
+        // Smoothed parameters; constant once every smoother has settled
+        if (mParamsSettled) {
+            for (int i = 0; i < chunkFrames; i++) {
+                driveGains[i] = mSettledDriveGain;
+                thdBaseAmounts[i] = (Sample)mParams.thdAmount;
+                dynamicsAmounts[i] = (Sample)mParams.dynamics;
+                outputGains[i] = mSettledOutputGain;
+                dryGains[i] = (Sample)(1.0 - mParams.mix);
+                wetGains[i] = (Sample)mParams.mix;
+            }
+        } else {
+            for (int i = 0; i < chunkFrames; i++) {
+                mSmoothedParams.driveDB = mDriveSmooth.Process(mParams.driveDB);
+                mSmoothedParams.outputDB = mOutputSmooth.Process(mParams.outputDB);
+                mSmoothedParams.thdAmount = mTHDAmountSmooth.Process(mParams.thdAmount);
+                mSmoothedParams.dynamics = mDynamicsSmooth.Process(mParams.dynamics);
+                mSmoothedParams.mix = mMixSmooth.Process(mParams.mix);
+                
+                driveGains[i] = DBToGain<Sample>(mSmoothedParams.driveDB);
+                thdBaseAmounts[i] = (Sample)mSmoothedParams.thdAmount;
+                dynamicsAmounts[i] = (Sample)mSmoothedParams.dynamics;
+                outputGains[i] = DBToGain<Sample>(mSmoothedParams.outputDB);
+                dryGains[i] = (Sample)(1.0 - mSmoothedParams.mix);
+                wetGains[i] = (Sample)mSmoothedParams.mix;
+            }
+        }
+        
+        // Envelope at audio rate, skipped while nothing uses it: with the
+        // dynamics settled at 0 the modulation is 0 for any envelope
+        const bool envelopeActive = nChans > 0 && !(mParamsSettled && mParams.dynamics == 0.0);
+        if (envelopeActive) {
+            if (!mEnvelopeActive) {
+                // Restart from silence; the dynamics ramp covers the attack
+                for (int g = 0; g < mNumLinkGroups; g++) {
+                    mEnvelopeFollowers[g].Reset();
+                }
+                mDetectorFilter.Reset();
+            }
+            
+            // The sidechain when there is one (then there is one group),
+            // else the input
+            const Sample* const* detector = nSidechainChans > 0 ? chunkSidechain : chunkInputs;
+            const int detectorChans = nSidechainChans > 0 ? nSidechainChans : nChans;
+            const Sample* envelopeInputs[kMaxChannels];
+            for (int c = 0; c < detectorChans; c++) {
+                envelopeInputs[c] = detector[c];
+            }
+            
+            if (mDetectorFilter.IsActive()) {
+                mDetectorFilter.ProcessBlock(envelopeInputs, filtered, detectorChans, chunkFrames);
+                for (int c = 0; c < detectorChans; c++) {
+                    envelopeInputs[c] = filtered[c];
+                }
+            }
+            
+            if (nSidechainChans > 0) {
+                mEnvelopeFollowers[0].ProcessBlock(envelopeInputs, detectorChans, envelopes[0], chunkFrames);
+            } else {
+                for (int g = 0; g < mNumLinkGroups; g++) {
+                    mEnvelopeFollowers[g].ProcessBlock(envelopeInputs + mLinkGroupFirst[g], mLinkGroupSize[g],
+                                                       envelopes[g], chunkFrames);
+                }
+            }
+        }
+        mEnvelopeActive = envelopeActive;
+        
+        // THD modulation at control rate: a control point at the start of
+        // each interval, ramped to linearly over the interval. The grid runs
+        // on across chunks and blocks, so it does not depend on their sizes.
+        int modulationPhase = mModulationPhase;
+        for (int g = 0; g < mNumLinkGroups; g++) {
+            int phase = mModulationPhase;
+            for (int segment = 0; segment < chunkFrames; ) {
+                if (phase == 0) {
+                    Sample envelopeDb = -120;
+                    if (envelopeActive && envelopes[g][segment] > 0.000001f) {
+                        envelopeDb = FastAmpToDB((float)envelopes[g][segment]);
+                    }
+                    
+                    Sample thresholdedEnvelope = 0;
+                    if (envelopeDb > mThresholdDb) {
+                        Sample headroom = 0 - (Sample)mThresholdDb;
+                        Sample aboveThreshold = envelopeDb - (Sample)mThresholdDb;
+                        thresholdedEnvelope = std::min(Sample(1), aboveThreshold / headroom);
+                    }
+                    
+                    Sample modulatedThd = thdBaseAmounts[segment];
+                    Sample modulation = thresholdedEnvelope * dynamicsAmounts[segment];
+                    modulatedThd = std::max(Sample(0), std::min(modulatedThd + modulation, Sample(1)));
+                    
+                    mEnvelopeValue[g] = thresholdedEnvelope;
+                    mModulationFrom[g] = mModulatedTHDAmount[g];
+                    mModulationTo[g] = modulatedThd;
+                }
+                
+                const int length = std::min(kTHDModulationInterval - phase, chunkFrames - segment);
+                const Sample from = mModulationFrom[g];
+                const Sample step = (mModulationTo[g] - from) / (Sample)kTHDModulationInterval;
+                for (int i = 0; i < length; i++) {
+                    thdAmounts[g][segment + i] = from + step * (Sample)(phase + i + 1);
+                }
+                phase += length;
+                segment += length;
+                if (phase == kTHDModulationInterval) {
+                    thdAmounts[g][segment - 1] = mModulationTo[g];
+                    phase = 0;
+                }
+                mModulatedTHDAmount[g] = thdAmounts[g][segment - 1];
+            }
+            modulationPhase = phase;
+        }
+        mModulationPhase = modulationPhase;
+        
+        // The THD and the dry path get the input from mLookaheadSamples ago
+        // (the envelope above already saw this chunk), and the dry path is
+        // delayed further by the THD latency. Both delays hold the host's
+        // doubles, so a true bypass through them stays bit-transparent.
+        for (int c = 0; c < nChans; c++) {
+            if (mLookaheadSamples == 0 && mDryDelayLength == 0) {
+                for (int i = 0; i < chunkFrames; i++) {
+                    dry[c][i] = chunkInputs[c][i];
+                    thdInput[c][i] = chunkInputs[c][i] * driveGains[i];
+                }
+                continue;
+            }
+            const double* input = inputs[c] + start;
+            double* ring = mLookaheadBuffer[c].data();
+            int writePos = mLookaheadWritePos;
+            int readPos = writePos - mLookaheadSamples;
+            if (readPos < 0) {
+                readPos += mLookaheadCapacity;
+            }
+            int delayPos = mDryDelayPos;
+            for (int i = 0; i < chunkFrames; i++) {
+                double sample = input[i];
+                if (mLookaheadSamples > 0) {
+                    ring[writePos] = sample;
+                    sample = ring[readPos];
+                    if (++writePos == mLookaheadCapacity) {
+                        writePos = 0;
+                    }
+                    if (++readPos == mLookaheadCapacity) {
+                        readPos = 0;
+                    }
+                }
+                thdInput[c][i] = (Sample)sample * driveGains[i];
+                if (mDryDelayLength > 0) {
+                    std::swap(sample, mDryDelay[c][delayPos]);
+                    if (++delayPos == mDryDelayLength) {
+                        delayPos = 0;
+                    }
+                }
+                dry[c][i] = (Sample)sample;
+            }
+        }
+        if (mLookaheadSamples > 0) {
+            mLookaheadWritePos = (mLookaheadWritePos + chunkFrames) % mLookaheadCapacity;
+        }
+        if (mDryDelayLength > 0) {
+            mDryDelayPos = (mDryDelayPos + chunkFrames) % mDryDelayLength;
+        }
+        
+        // Each pair takes its channels' group amounts; channels of one group
+        // share a buffer, which keeps the pair on the shared-amount path
+        for (int c = 0; c < nChans; c += 2) {
+            const int pairChans = std::min(2, nChans - c);
+            const Sample* pairInputs[2] = { thdInput[c], thdInput[c + pairChans - 1] };
+            Sample* pairOutputs[2] = { thdOutput[c], thdOutput[c + pairChans - 1] };
+            const Sample* pairAmounts[2] = { thdAmounts[mChannelLinkGroup[c]],
+                                            thdAmounts[mChannelLinkGroup[c + pairChans - 1]] };
+            mTHD[c / 2].ProcessBlock(pairInputs, pairOutputs, pairChans, pairAmounts, chunkFrames);
+        }
+        
+        // Shares of the processed and dry signal in the output, the same for
+        // every channel: the fade table while a bypass change is fading,
+        // then all of one
+        Sample processedShares[kTHDChunkSize];
+        Sample dryShares[kTHDChunkSize];
+        const int fadeFrames = mBypassFading ? std::min(chunkFrames, mBypassFadeLength - mBypassFadeCounter) : 0;
+        for (int i = 0; i < fadeFrames; i++) {
+            const Sample fadeIn = mBypassFadeTable[mBypassFadeCounter + i];
+            const Sample fadeOut = mBypassFadeTable[mBypassFadeLength - mBypassFadeCounter - i];
+            processedShares[i] = mBypassState ? fadeOut : fadeIn;
+            dryShares[i] = mBypassState ? fadeIn : fadeOut;
+        }
+        for (int i = fadeFrames; i < chunkFrames; i++) {
+            processedShares[i] = mBypassState ? 0 : 1;
+            dryShares[i] = mBypassState ? 1 : 0;
+        }
+        
+        // Output stage in one pass per channel: output gain, dry/wet mix,
+        // DC blocker and the bypass crossfade
+        const Sample dcPole = (Sample)kOutputDCPole;
+        for (int c = 0; c < nChans; c++) {
+            Sample dcInput = mOutputDCInput[c];
+            Sample dcOutput = mOutputDCOutput[c];
+            double* output = outputs[c] + start;
+            for (int i = 0; i < chunkFrames; i++) {
+                const Sample wet = thdOutput[c][i] * outputGains[i];
+                const Sample mixed = (dry[c][i] * dryGains[i]) + (wet * wetGains[i]);
+                const Sample processed = mixed - dcInput + dcPole * dcOutput;
+                dcInput = mixed;
+                dcOutput = processed;
+                output[i] = processed * processedShares[i] + dry[c][i] * dryShares[i];
+            }
+            mOutputDCInput[c] = FlushDenormal(dcInput);
+            mOutputDCOutput[c] = FlushDenormal(dcOutput);
+        }
+        if (mBypassFading) {
+            mBypassFadeCounter += fadeFrames;
+            if (mBypassFadeCounter >= mBypassFadeLength) mBypassFading = false;
+        }
+    }
+}
+
+void ToastEngine::Reset(double sampleRate, int nChans)
+{
+    ScopedFlushDenormals flushDenormals;
+    
+    mSampleRate = sampleRate;
+    
+    // One chunk of every channel buffer, for the channels in use
+    mNumChannels = std::max(1, std::min(nChans, (int)kMaxChannels));
+    const int chunkRows = mNumChannels + 2;
+    mChunkScratch.assign((size_t)kNumChunkBuffers * chunkRows * kTHDChunkSize, Sample(0));
+    for (int b = 0; b < kNumChunkBuffers; b++) {
+        for (int c = 0; c < kMaxChannels + 2; c++) {
+            mChunkBuffers[b][c] = c < chunkRows
+                ? mChunkScratch.data() + ((size_t)b * chunkRows + c) * kTHDChunkSize
+                : nullptr;
+        }
+    }
+    
+    // Initialize THD processors; the character settings are fixed, so
+    // only a new sample rate recomputes their coefficients
+    for (StereoTHD<Sample>& thd : mTHD) {
+        thd.Initialize(mSampleRate);
+        thd.SetWarmth(mWarmth);
+        thd.SetAsymmetry(mAsymmetry);
+        thd.SetHysteresis(mHysteresis);
+    }
+    ApplyOversampling(mRequestedOversamplingStages.load(std::memory_order_relaxed),
+                      (OversamplingFilter)mRequestedOversamplingFilter.load(std::memory_order_relaxed));
+    ApplyModel((THDModel)mRequestedModel.load(std::memory_order_relaxed));
+    ApplyWaveshaper((WaveshaperMode)mRequestedWaveshaper.load(std::memory_order_relaxed));
+    ApplyAntialiasing((Antialiasing)mRequestedAntialiasing.load(std::memory_order_relaxed));
+    
+    // Room for the longest lookahead at this sample rate
+    mLookaheadCapacity = (int)std::ceil(kMaxLookaheadMs * 0.001 * mSampleRate) + 1;
+    for (int c = 0; c < kMaxChannels; c++) {
+        mLookaheadBuffer[c].assign(mLookaheadCapacity, 0.0);
+    }
+    ApplyLookahead(LookaheadSamples(mRequestedLookaheadMs.load(std::memory_order_relaxed)));
+    
+    // Room for the longest bypass fade at this sample rate; the table is
+    // only rebuilt when its length or curve changes
+    const int bypassFadeSamples = BypassFadeSamples(mRequestedBypassFadeMs.load(std::memory_order_relaxed));
+    const auto bypassCurve = (BypassCurve)mRequestedBypassCurve.load(std::memory_order_relaxed);
+    const size_t bypassFadeCapacity = BypassFadeSamples(kMaxBypassFadeMs) + 1;
+    if (mBypassFadeTable.size() != bypassFadeCapacity || bypassFadeSamples != mBypassFadeLength ||
+        bypassCurve != mBypassCurve) {
+        mBypassFadeTable.resize(bypassFadeCapacity);
+        ApplyBypassFade(bypassFadeSamples, bypassCurve);
+    }
+    
+    // Configure envelope followers
+    mThresholdDb = mRequestedThresholdDb.load(std::memory_order_relaxed);
+    mAttackMs = mRequestedAttackMs.load(std::memory_order_relaxed);
+    mReleaseMs = mRequestedReleaseMs.load(std::memory_order_relaxed);
+    mCurveValue = mRequestedCurve.load(std::memory_order_relaxed);
+    for (EnvelopeFollower<Sample>& follower : mEnvelopeFollowers) {
+        follower.Initialize(mSampleRate);
+        follower.SetMode(EnvelopeFollower<Sample>::RMS);
+        follower.SetSensitivity(1.0f);
+        follower.SetAttack(mAttackMs);
+        follower.SetRelease(mReleaseMs);
+        follower.SetSmoothing(1.0f);
+        follower.SetCurve(mCurveValue);
+        follower.SetAmount(1.0f);
+        follower.Reset();
+    }
+    mEnvelopeActive = true;
+    mLinkChannels = -1; // Groups are rebuilt for the first block
+    
+    mDetectorHighPass = mRequestedDetectorHighPass.load(std::memory_order_relaxed);
+    mDetectorLowPass = mRequestedDetectorLowPass.load(std::memory_order_relaxed);
+    mDetectorFilter.Setup(mDetectorHighPass, mDetectorLowPass, mSampleRate);
+    mDetectorFilter.Reset();
+    
+    // Initialize smoothers
+    const double gainSmoothingMs = 50.0;
+    const double paramSmoothingMs = 30.0;
+    
+    mParams = LoadParamTargets();
+    
+    double initialDriveDB = mParams.driveDB;
+    double initialOutputDB = mParams.outputDB;
+    double initialTHDAmount = mParams.thdAmount;
+    double initialDynamics = mParams.dynamics;
+    double initialMix = mParams.mix;
+    
+    mDriveSmooth = iplug::LogParamSmooth<double>(gainSmoothingMs, initialDriveDB);
+    mDriveSmooth.SetSmoothTime(gainSmoothingMs, mSampleRate);
+    mDriveSmooth.SetValue(initialDriveDB);
+    
+    mOutputSmooth = iplug::LogParamSmooth<double>(gainSmoothingMs, initialOutputDB);
+    mOutputSmooth.SetSmoothTime(gainSmoothingMs, mSampleRate);
+    mOutputSmooth.SetValue(initialOutputDB);
+    
+    mTHDAmountSmooth = iplug::LogParamSmooth<double>(paramSmoothingMs, initialTHDAmount);
+    mTHDAmountSmooth.SetSmoothTime(paramSmoothingMs, mSampleRate);
+    mTHDAmountSmooth.SetValue(initialTHDAmount);
+    
+    mDynamicsSmooth = iplug::LogParamSmooth<double>(paramSmoothingMs, initialDynamics);
+    mDynamicsSmooth.SetSmoothTime(paramSmoothingMs, mSampleRate);
+    mDynamicsSmooth.SetValue(initialDynamics);
+    
+    mMixSmooth = iplug::LogParamSmooth<double>(paramSmoothingMs, initialMix);
+    mMixSmooth.SetSmoothTime(paramSmoothingMs, mSampleRate);
+    mMixSmooth.SetValue(initialMix);
+    
+    // The smoothers start on their targets
+    mSmoothedParams = mParams;
+    UpdateParamSettled();
+    
+    // Reset state. The THD starts settled on silence at the initial amount,
+    // which takes the place of running silence through it.
+    for (StereoTHD<Sample>& thd : mTHD) {
+        thd.SetTHDAmount((Sample)initialTHDAmount);
+        thd.Reset();
+    }
+    for (int g = 0; g < kMaxChannels; g++) {
+        mEnvelopeValue[g] = 0;
+        mModulatedTHDAmount[g] = (Sample)initialTHDAmount;
+    }
+    mModulationPhase = 0;
+    
+    std::fill(mOutputDCInput, mOutputDCInput + kMaxChannels, Sample(0));
+    std::fill(mOutputDCOutput, mOutputDCOutput + kMaxChannels, Sample(0));
+    
+    mBypassState = false;
+    mBypassFading = false;
+    mBypassSuspended = false;
+    mBypassFadeCounter = 0;
+    mHostIsActive.store(true, std::memory_order_relaxed);
+    
+    mSilentFrames = 0;
+    mIdle = false;
+}
+
+void ToastEngine::SetParamTargets(const ParamSnapshot& targets)
+{
+    mDriveDBTarget.store(targets.driveDB, std::memory_order_relaxed);
+    mOutputDBTarget.store(targets.outputDB, std::memory_order_relaxed);
+    mTHDAmountTarget.store(targets.thdAmount, std::memory_order_relaxed);
+    mDynamicsTarget.store(targets.dynamics, std::memory_order_relaxed);
+    mMixTarget.store(targets.mix, std::memory_order_relaxed);
+}
+
+void ToastEngine::SetOversampling(int numStages, OversamplingFilter filter)
+{
+    mRequestedOversamplingStages.store(numStages, std::memory_order_relaxed);
+    mRequestedOversamplingFilter.store(filter, std::memory_order_relaxed);
+}
+
+void ToastEngine::SetModel(THDModel model)
+{
+    mRequestedModel.store(model, std::memory_order_relaxed);
+}
+
+void ToastEngine::SetWaveshaper(WaveshaperMode mode)
+{
+    mRequestedWaveshaper.store(mode, std::memory_order_relaxed);
+}
+
+void ToastEngine::SetAntialiasing(Antialiasing mode)
+{
+    mRequestedAntialiasing.store(mode, std::memory_order_relaxed);
+}
+
+void ToastEngine::SetThreshold(double thresholdDb)
+{
+    mRequestedThresholdDb.store(thresholdDb, std::memory_order_relaxed);
+}
+
+void ToastEngine::SetAttack(double attackMs)
+{
+    mRequestedAttackMs.store(attackMs, std::memory_order_relaxed);
+}
+
+void ToastEngine::SetRelease(double releaseMs)
+{
+    mRequestedReleaseMs.store(releaseMs, std::memory_order_relaxed);
+}
+
+void ToastEngine::SetCurve(double curve)
+{
+    mRequestedCurve.store(curve, std::memory_order_relaxed);
+}
+
+void ToastEngine::SetEnvelopeLink(EnvelopeLink link)
+{
+    mRequestedEnvelopeLink.store(link, std::memory_order_relaxed);
+}
+
+void ToastEngine::SetDetectorFilters(double highPassHz, double lowPassHz)
+{
+    mRequestedDetectorHighPass.store(highPassHz, std::memory_order_relaxed);
+    mRequestedDetectorLowPass.store(lowPassHz, std::memory_order_relaxed);
+}
+
+void ToastEngine::SetLookahead(double lookaheadMs)
+{
+    mRequestedLookaheadMs.store(std::max(0.0, std::min(lookaheadMs, kMaxLookaheadMs)),
+                                std::memory_order_relaxed);
+}
+
+void ToastEngine::SetActive(bool active)
+{
+    mHostIsActive.store(active, std::memory_order_relaxed);
+}
+
+void ToastEngine::SetBypassed(bool bypassed)
+{
+    mHostBypassed.store(bypassed, std::memory_order_relaxed);
+}
+
+void ToastEngine::SetBypassFade(double fadeMs, BypassCurve curve)
+{
+    mRequestedBypassFadeMs.store(std::max(kMinBypassFadeMs, std::min(fadeMs, kMaxBypassFadeMs)),
+                                 std::memory_order_relaxed);
+    mRequestedBypassCurve.store(curve, std::memory_order_relaxed);
+}
+
+int ToastEngine::GetLatency() const
+{
+    const int numStages = mRequestedOversamplingStages.load(std::memory_order_relaxed);
+    const auto filter = (OversamplingFilter)mRequestedOversamplingFilter.load(std::memory_order_relaxed);
+    const double lookaheadMs = mRequestedLookaheadMs.load(std::memory_order_relaxed);
+    const auto antialiasing = (Antialiasing)mRequestedAntialiasing.load(std::memory_order_relaxed);
+    return StereoTHD<Sample>::Latency(numStages, filter, antialiasing) + LookaheadSamples(lookaheadMs);
+}
+
+int ToastEngine::GetTailSamples() const
+{
+    const double nepersPerDb = std::log(10.0) / 20.0;
+    
+    // Audio: the slowest filters are the THD's 20 Hz DC blocker and the
+    // output DC blocker (pole at kOutputDCPole), decayed by kTailDecayDb
+    const double dcBlockerSamples = std::max(mSampleRate / (2.0 * M_PI * 20.0), 1.0 / (1.0 - kOutputDCPole));
+    const double audioSamples = dcBlockerSamples * kTailDecayDb * nepersPerDb;
+    
+    // Envelope: the RMS window (20 ms in amplitude), the release and the
+    // 1 ms output smoothing, from full scale down to the threshold
+    const double releaseMs = mRequestedReleaseMs.load(std::memory_order_relaxed);
+    const double thresholdDb = mRequestedThresholdDb.load(std::memory_order_relaxed);
+    const double envelopeSamples = (20.0 + releaseMs + 1.0) * 0.001 * mSampleRate;
+    const double envelopeDecay = envelopeSamples * std::max(0.0, -thresholdDb) * nepersPerDb;
+    
+    return GetLatency() + (int)std::ceil(std::max(audioSamples, envelopeDecay));
+}
+
+double ToastEngine::GetEnvelopeActivity() const
+{
+    Sample activity = 0;
+    for (int g = 0; g < mNumLinkGroups; g++) {
+        activity = std::max(activity, mEnvelopeValue[g]);
+    }
+    return activity;
+}
+
+double ToastEngine::GetModulatedTHDAmount() const
+{
+    Sample amount = 0;
+    for (int g = 0; g < mNumLinkGroups; g++) {
+        amount = std::max(amount, mModulatedTHDAmount[g]);
+    }
+    return amount;
+}
+
+ToastEngine::ParamSnapshot ToastEngine::LoadParamTargets() const
+{
+    ParamSnapshot targets;
+    targets.driveDB = mDriveDBTarget.load(std::memory_order_relaxed);
+    targets.outputDB = mOutputDBTarget.load(std::memory_order_relaxed);
+    targets.thdAmount = mTHDAmountTarget.load(std::memory_order_relaxed);
+    targets.dynamics = mDynamicsTarget.load(std::memory_order_relaxed);
+    targets.mix = mMixTarget.load(std::memory_order_relaxed);
+    return targets;
+}
+
+void ToastEngine::UpdateParamSettled()
+{
+    auto reached = [](double value, double target) {
+        return std::abs(value - target) < kParamSettleThreshold;
+    };
+    if (!reached(mSmoothedParams.driveDB, mParams.driveDB) ||
+        !reached(mSmoothedParams.outputDB, mParams.outputDB) ||
+        !reached(mSmoothedParams.thdAmount, mParams.thdAmount) ||
+        !reached(mSmoothedParams.dynamics, mParams.dynamics) ||
+        !reached(mSmoothedParams.mix, mParams.mix)) {
+        return;
+    }
+    
+    // Land exactly on the targets so smoothing resumes from them
+    mDriveSmooth.SetValue(mParams.driveDB);
+    mOutputSmooth.SetValue(mParams.outputDB);
+    mTHDAmountSmooth.SetValue(mParams.thdAmount);
+    mDynamicsSmooth.SetValue(mParams.dynamics);
+    mMixSmooth.SetValue(mParams.mix);
+    mSmoothedParams = mParams;
+    
+    mSettledDriveGain = (Sample)std::pow(10.0, mParams.driveDB / 20.0);
+    mSettledOutputGain = (Sample)std::pow(10.0, mParams.outputDB / 20.0);
+    mParamsSettled = true;
+}
+
+void ToastEngine::ApplyOversampling(int numStages, OversamplingFilter filter)
+{
+    mOversamplingStages = numStages;
+    mOversamplingFilter = filter;
+    for (StereoTHD<Sample>& thd : mTHD) {
+        thd.SetOversampling(numStages, filter);
+    }
+    ResetDryDelay();
+}
+
+void ToastEngine::ResetDryDelay()
+{
+    // Delay the dry path by the THD latency so Mix and bypass stay aligned
+    mDryDelayLength = mTHD[0].GetLatency();
+    mDryDelayPos = 0;
+    for (int c = 0; c < kMaxChannels; c++) {
+        std::fill(mDryDelay[c], mDryDelay[c] + kMaxDryDelay, 0.0);
+    }
+}
+
+void ToastEngine::ApplyModel(THDModel model)
+{
+    mModel = model;
+    for (StereoTHD<Sample>& thd : mTHD) {
+        thd.SetModel(model);
+    }
+}
+
+void ToastEngine::ApplyWaveshaper(WaveshaperMode mode)
+{
+    mWaveshaper = mode;
+    for (StereoTHD<Sample>& thd : mTHD) {
+        thd.SetWaveshaper(mode);
+    }
+}
+
+void ToastEngine::ApplyAntialiasing(Antialiasing mode)
+{
+    mAntialiasing = mode;
+    for (StereoTHD<Sample>& thd : mTHD) {
+        thd.SetAntialiasing(mode);
+    }
+    // Second-order ADAA delays the wet path by a sample at the THD's rate
+    if (mTHD[0].GetLatency() != mDryDelayLength) {
+        ResetDryDelay();
+    }
+}
+
+int ToastEngine::LookaheadSamples(double lookaheadMs) const
+{
+    return (int)std::lround(lookaheadMs * 0.001 * mSampleRate);
+}
+
+void ToastEngine::ApplyLookahead(int lookaheadSamples)
+{
+    // Restart the delay empty rather than replaying old input at the new offset
+    mLookaheadSamples = std::min(lookaheadSamples, std::max(mLookaheadCapacity - 1, 0));
+    mLookaheadWritePos = 0;
+    for (int c = 0; c < kMaxChannels; c++) {
+        std::fill(mLookaheadBuffer[c].begin(), mLookaheadBuffer[c].end(), 0.0);
+    }
+}
+
+int ToastEngine::BypassFadeSamples(double fadeMs) const
+{
+    return std::max(1, (int)std::lround(fadeMs * 0.001 * mSampleRate));
+}
+
+void ToastEngine::ApplyBypassFade(int fadeSamples, BypassCurve curve)
+{
+    // A fade in progress keeps its position relative to the new length
+    const double progress = (double)mBypassFadeCounter / (double)mBypassFadeLength;
+    mBypassFadeLength = std::max(1, std::min(fadeSamples, (int)mBypassFadeTable.size() - 1));
+    mBypassFadeCounter = std::min((int)std::lround(progress * mBypassFadeLength), mBypassFadeLength);
+    mBypassCurve = curve;
+    
+    for (int i = 0; i <= mBypassFadeLength && i < (int)mBypassFadeTable.size(); i++) {
+        const double t = (double)i / (double)mBypassFadeLength;
+        double gain = t;
+        if (curve == kBypassEqualPower) {
+            gain = std::sin(0.5 * M_PI * t);
+        } else if (curve == kBypassRaisedCosine) {
+            gain = 0.5 * (1.0 - std::cos(M_PI * t));
+        }
+        mBypassFadeTable[i] = (Sample)gain;
+    }
+}
+
+void ToastEngine::ApplyEnvelopeSettings(double attackMs, double releaseMs, double curve)
+{
+    mAttackMs = attackMs;
+    mReleaseMs = releaseMs;
+    mCurveValue = curve;
+    for (EnvelopeFollower<Sample>& follower : mEnvelopeFollowers) {
+        follower.SetAttack(mAttackMs);
+        follower.SetRelease(mReleaseMs);
+        follower.SetCurve(mCurveValue);
+    }
+}
+
+void ToastEngine::ApplyEnvelopeLink(EnvelopeLink link, int nChans)
+{
+    mEnvelopeLink = link;
+    mLinkChannels = nChans;
+    
+    mNumLinkGroups = 0;
+    if (link == kLinkPerChannel) {
+        for (int c = 0; c < nChans; c++) {
+            mLinkGroupFirst[mNumLinkGroups] = c;
+            mLinkGroupSize[mNumLinkGroups++] = 1;
+        }
+    } else if (link == kLinkGrouped) {
+        int first = 0;
+        for (int size : kLinkGroupSizes[nChans]) {
+            if (size == 0) {
+                break;
+            }
+            mLinkGroupFirst[mNumLinkGroups] = first;
+            mLinkGroupSize[mNumLinkGroups++] = size;
+            first += size;
+        }
+    }
+    if (mNumLinkGroups == 0) {
+        mLinkGroupFirst[0] = 0;
+        mLinkGroupSize[0] = std::max(nChans, 1);
+        mNumLinkGroups = 1;
+    }
+    for (int g = 0; g < mNumLinkGroups; g++) {
+        for (int c = mLinkGroupFirst[g]; c < mLinkGroupFirst[g] + mLinkGroupSize[g]; c++) {
+            mChannelLinkGroup[c] = g;
+        }
+    }
+    
+    // New groups start from silence, continuing the current THD amount
+    for (int g = 0; g < mNumLinkGroups; g++) {
+        mEnvelopeFollowers[g].Reset();
+        mEnvelopeValue[g] = mEnvelopeValue[0];
+        mModulatedTHDAmount[g] = mModulatedTHDAmount[0];
+        mModulationFrom[g] = mModulationFrom[0];
+        mModulationTo[g] = mModulationTo[0];
+    }
+}
+
+bool ToastEngine::IsSilent(double** inputs, int nChans, int nFrames) const
+{
+    for (int c = 0; c < nChans; c++) {
+        for (int s = 0; s < nFrames; s++) {
+            if (std::abs(inputs[c][s]) > kSilenceThreshold) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+void ToastEngine::SettleSkippedState()
+{
+    // Settle the envelopes and the modulation where silence would take
+    // them, so processing resumes from rest
+    for (int g = 0; g < mNumLinkGroups; g++) {
+        mEnvelopeFollowers[g].Reset();
+        mEnvelopeValue[g] = 0;
+        mModulatedTHDAmount[g] = (Sample)mParams.thdAmount;
+    }
+    mModulationPhase = 0;
+    mDetectorFilter.Reset();
+}
+
+void ToastEngine::ProcessIdle(double** outputs, int nChans, int nFrames)
+{
+    if (!mIdle) {
+        SettleSkippedState();
+        mIdle = true;
+    }
+    
+    // Nothing is audible, so the smoothers jump to their targets and a
+    // bypass fade is over
+    if (!mParamsSettled) {
+        mSmoothedParams = mParams;
+        UpdateParamSettled();
+    }
+    mBypassFading = false;
+    
+    for (int c = 0; c < nChans; c++) {
+        std::fill(outputs[c], outputs[c] + nFrames, 0.0);
+    }
+}
+
+void ToastEngine::ProcessBypassed(double** inputs, double** outputs, int nChans, int nFrames)
+{
+    if (!mBypassSuspended) {
+        // Nothing processed is audible until the fade back in, which then
+        // starts from cleared filters rather than from before the bypass
+        SettleSkippedState();
+        for (StereoTHD<Sample>& thd : mTHD) {
+            thd.Reset();
+        }
+        std::fill(mOutputDCInput, mOutputDCInput + kMaxChannels, Sample(0));
+        std::fill(mOutputDCOutput, mOutputDCOutput + kMaxChannels, Sample(0));
+        mBypassSuspended = true;
+    }
+    if (!mParamsSettled) {
+        mSmoothedParams = mParams;
+        UpdateParamSettled();
+    }
+    
+    // Without latency the dry signal is the input: a copy, or nothing at all
+    // in place
+    if (mLookaheadSamples == 0 && mDryDelayLength == 0) {
+        for (int c = 0; c < nChans; c++) {
+            if (outputs[c] != inputs[c]) {
+                std::memcpy(outputs[c], inputs[c], nFrames * sizeof(double));
+            }
+        }
+        return;
+    }
+    
+    // Otherwise only the lookahead and dry delays run, so the output keeps
+    // the reported latency and the delays are current when the fade starts.
+    // They hold doubles, so the host's samples come out unrounded in either
+    // precision.
+    for (int c = 0; c < nChans; c++) {
+        double* ring = mLookaheadBuffer[c].data();
+        int writePos = mLookaheadWritePos;
+        int readPos = writePos - mLookaheadSamples;
+        if (readPos < 0) {
+            readPos += mLookaheadCapacity;
+        }
+        int delayPos = mDryDelayPos;
+        for (int s = 0; s < nFrames; s++) {
+            double sample = inputs[c][s];
+            if (mLookaheadSamples > 0) {
+                ring[writePos] = sample;
+                sample = ring[readPos];
+                if (++writePos == mLookaheadCapacity) {
+                    writePos = 0;
+                }
+                if (++readPos == mLookaheadCapacity) {
+                    readPos = 0;
+                }
+            }
+            if (mDryDelayLength > 0) {
+                std::swap(sample, mDryDelay[c][delayPos]);
+                if (++delayPos == mDryDelayLength) {
+                    delayPos = 0;
+                }
+            }
+            outputs[c][s] = sample;
+        }
+    }
+    if (mLookaheadSamples > 0) {
+        mLookaheadWritePos = (int)((mLookaheadWritePos + (long long)nFrames) % mLookaheadCapacity);
+    }
+    if (mDryDelayLength > 0) {
+        mDryDelayPos = (int)((mDryDelayPos + (long long)nFrames) % mDryDelayLength);
+    }
+}
@@ -0,0 +1,335 @@
+#pragma once
+
+#include <atomic>
+#include <limits>
+#include <vector>
+
+#include "Smoothers.h"
+
+#include "THD.h"
+#include "EnvelopeFollower.h"
+#include "DetectorFilter.h"
+#include "Denormals.h"
+#include "FastMath.h"
+
+// The toast signal chain without a host: drive, envelope-modulated THD,
+// output gain, dry/wet mix, DC blocking and the bypass crossfade. The
+// plugin and the offline renderer (cli/) both run it.
+class ToastEngine
+{
+public:
+    // Up to 7.1.4 and 9.1.6 beds; the THD runs the channels in pairs
+    static constexpr int kMaxChannels = 16;
+
+    // Precision of the signal path, fixed at compile time: float by
+    // default, double when built with TOAST_DOUBLE_PRECISION, the reference
+    // the float build nulls against to below -90 dBFS. Host buffers are
+    // double either way and are converted once on the way in and out; the
+    // parameter smoothers stay in double so they settle exactly on their
+    // targets.
+#if TOAST_DOUBLE_PRECISION
+    using Sample = double;
+#else
+    using Sample = float;
+#endif
+
+    // Which channels share an envelope: all of them (following the loudest
+    // channel), each channel its own, or the groups of the channel layout
+    // (see kLinkGroupSizes in ToastEngine.cpp)
+    enum EnvelopeLink
+    {
+        kLinkMax = 0,
+        kLinkPerChannel,
+        kLinkGrouped,
+        kNumEnvelopeLinks
+    };
+
+    // Gain curve of the bypass crossfade: sine / cosine (constant power),
+    // a linear ramp (constant amplitude) or a raised cosine
+    enum BypassCurve
+    {
+        kBypassEqualPower = 0,
+        kBypassLinear,
+        kBypassRaisedCosine,
+        kNumBypassCurves
+    };
+    
+    // Targets of the smoothed parameters
+    struct ParamSnapshot
+    {
+        double driveDB = 0.0;
+        double outputDB = 0.0;
+        double thdAmount = 0.3;
+        double dynamics = 0.0;
+        double mix = 1.0;
+
+        bool operator==(const ParamSnapshot& other) const
+        {
+            return driveDB == other.driveDB && outputDB == other.outputDB &&
+                   thdAmount == other.thdAmount && dynamics == other.dynamics &&
+                   mix == other.mix;
+        }
+    };
+
+    ToastEngine();
+
+    // Allocates for nChans channels (1 - kMaxChannels); call before
+    // processing and whenever the sample rate or channel count changes.
+    // Smoothers start on the current targets; blocks of any size can follow.
+    void Reset(double sampleRate, int nChans);
+
+    // May be called from any thread; picked up at the next block
+    void SetParamTargets(const ParamSnapshot& targets);
+    void SetOversampling(int numStages, OversamplingFilter filter);
+    
+    // Classic (the default) or Magnetic transformer model. A change resets
+    // the THD, as a change of oversampling does. May be called from any
+    // thread.
+    void SetModel(THDModel model);
+
+    // Table (the default) or exact evaluation of the THD's transcendental
+    // curves; the tables are within 1e-8 of the exact curves. May be called
+    // from any thread.
+    void SetWaveshaper(WaveshaperMode mode);
+    // Antiderivative antialiasing of the THD's saturation and limiter, a
+    // cheaper alternative to oversampling. Second order adds latency (see
+    // StereoTHD::GetLatency). May be called from any thread.
+    void SetAntialiasing(Antialiasing mode);
+
+    // Envelope settings. May be called from any thread; picked up at the
+    // next block.
+    void SetThreshold(double thresholdDb);
+    void SetAttack(double attackMs);
+    void SetRelease(double releaseMs);
+    void SetCurve(double curve);
+    
+    // May be called from any thread. A sidechain always drives every
+    // channel with one envelope.
+    void SetEnvelopeLink(EnvelopeLink link);
+    
+    // High-pass / low-pass on the detector input, 0 Hz for off. May be
+    // called from any thread.
+    void SetDetectorFilters(double highPassHz, double lowPassHz);
+    
+    // Runs the envelope detector ahead of the audio by 0 - kMaxLookaheadMs,
+    // delaying the wet and dry paths. May be called from any thread.
+    void SetLookahead(double lookaheadMs);
+    static constexpr double kMaxLookaheadMs = 10.0;
+
+    // Inactive or bypassed crossfades to the dry signal; once the fade is
+    // over only the latency delays run and the output is the input bit for
+    // bit (the fade itself is in the engine's precision, rounded to float
+    // in the default build). May be called from any thread.
+    void SetActive(bool active);
+    void SetBypassed(bool bypassed);
+    
+    // Length and curve of the bypass crossfade. May be called from any
+    // thread; picked up at the next block.
+    void SetBypassFade(double fadeMs, BypassCurve curve);
+    static constexpr double kMinBypassFadeMs = 1.0;
+    static constexpr double kMaxBypassFadeMs = 50.0;
+
+    // Latency of the requested oversampling, antialiasing and lookahead
+    // settings, in samples at the rate passed to Reset
+    int GetLatency() const;
+
+    // Output that follows the end of the input: the latency, then the decay
+    // of the filters and of the envelope down to the threshold. Once the
+    // input has been silent this long the engine is idle: it outputs zeros
+    // without processing (in true bypass it passes the input on instead).
+    // Call from the same thread as the setters.
+    int GetTailSamples() const;
+
+    // THD modulation at the end of the last block, the largest over the
+    // link groups: the envelope above the threshold (0 - 1) and the THD
+    // amount it drove (0 - 1). Call from the audio thread after
+    // ProcessBlock.
+    double GetEnvelopeActivity() const;
+    double GetModulatedTHDAmount() const;
+
+    // nChans is 0 - the count passed to Reset (any more pass through
+    // unprocessed); any block size. With a sidechain (1 or 2 channels) the
+    // envelope follows it instead of the input.
+    void ProcessBlock(double** inputs, double** outputs, int nChans, int nFrames,
+                      double** sidechain = nullptr, int nSidechainChans = 0);
+
+private:
+    void ApplyOversampling(int numStages, OversamplingFilter filter);
+    void ResetDryDelay();
+    void ApplyModel(THDModel model);
+    void ApplyWaveshaper(WaveshaperMode mode);
+    void ApplyAntialiasing(Antialiasing mode);
+    void ApplyLookahead(int lookaheadSamples);
+    void ApplyEnvelopeLink(EnvelopeLink link, int nChans);
+    void ApplyEnvelopeSettings(double attackMs, double releaseMs, double curve);
+    bool IsSilent(double** inputs, int nChans, int nFrames) const;
+    void ProcessIdle(double** outputs, int nChans, int nFrames);
+    void ProcessBypassed(double** inputs, double** outputs, int nChans, int nFrames);
+    void SettleSkippedState();
+    void ApplyBypassFade(int fadeSamples, BypassCurve curve);
+    int BypassFadeSamples(double fadeMs) const;
+    int LookaheadSamples(double lookaheadMs) const;
+    void ProcessFrames(double** inputs, double** outputs, int nChans, int nFrames,
+                       double** sidechain, int nSidechainChans);
+
+    ParamSnapshot LoadParamTargets() const;
+    void UpdateParamSettled();
+
+    // Channels 2k and 2k + 1 share mTHD[k], one SIMD lane each
+    StereoTHD<Sample> mTHD[kMaxChannels / 2];
+
+    // One follower per link group; the groups are runs of adjacent channels
+    EnvelopeFollower<Sample> mEnvelopeFollowers[kMaxChannels];
+    bool mEnvelopeActive = true; // False while skipped at 0 dynamics
+    std::atomic<int> mRequestedEnvelopeLink{kLinkMax};
+    EnvelopeLink mEnvelopeLink = kLinkMax;
+    int mLinkChannels = 0;  // Channel count the groups were built for
+    int mNumLinkGroups = 1;
+    int mLinkGroupFirst[kMaxChannels] = {};
+    int mLinkGroupSize[kMaxChannels] = { kMaxChannels };
+    int mChannelLinkGroup[kMaxChannels] = {};
+    
+    // Requested (any thread) and applied detector filter frequencies
+    DetectorFilter<Sample> mDetectorFilter;
+    std::atomic<double> mRequestedDetectorHighPass{0.0};
+    std::atomic<double> mRequestedDetectorLowPass{0.0};
+    double mDetectorHighPass = 0.0;
+    double mDetectorLowPass = 0.0;
+
+    // Parameter smoothing using LogParamSmooth
+    iplug::LogParamSmooth<double> mDriveSmooth;
+    iplug::LogParamSmooth<double> mOutputSmooth;
+    iplug::LogParamSmooth<double> mTHDAmountSmooth;
+    iplug::LogParamSmooth<double> mDynamicsSmooth;
+    iplug::LogParamSmooth<double> mMixSmooth;
+
+    // Written by SetParamTargets from any thread, read once per block
+    std::atomic<double> mDriveDBTarget{0.0};
+    std::atomic<double> mOutputDBTarget{0.0};
+    std::atomic<double> mTHDAmountTarget{0.3};
+    std::atomic<double> mDynamicsTarget{0.0};
+    std::atomic<double> mMixTarget{1.0};
+
+    // Audio thread only: this block's targets, the last smoothed values,
+    // and whether every smoother has reached its target (smoothing skipped)
+    ParamSnapshot mParams;
+    ParamSnapshot mSmoothedParams;
+    bool mParamsSettled = false;
+    Sample mSettledDriveGain = 1;
+    Sample mSettledOutputGain = 1;
+    static constexpr double kParamSettleThreshold = 1e-6;
+
+    // Parameter modulation system, per link group: the last envelope
+    // control point and THD amount, and the ramp between control points,
+    // mModulationPhase frames into the interval
+    Sample mEnvelopeValue[kMaxChannels] = {};
+    Sample mModulatedTHDAmount[kMaxChannels] = {};
+    Sample mModulationFrom[kMaxChannels] = {};
+    Sample mModulationTo[kMaxChannels] = {};
+    int mModulationPhase = 0;
+
+    // User parameters: the envelope settings as requested (any thread) and
+    // as applied to the followers
+    double mSampleRate = 44100.0;
+    std::atomic<double> mRequestedThresholdDb{-20.0};
+    std::atomic<double> mRequestedAttackMs{1.0};
+    std::atomic<double> mRequestedReleaseMs{120.0};
+    std::atomic<double> mRequestedCurve{0.5};
+    double mThresholdDb = -20.0;
+    double mAttackMs = 1.0;
+    double mReleaseMs = 120.0;
+    double mCurveValue = 0.5;
+
+    // Hardcoded THD settings
+    const double mWarmth = 1.0;
+    const double mAsymmetry = 0.75;
+    const double mHysteresis = 0.75;
+
+    // Silence detection: frames of input at or below kSilenceThreshold so
+    // far, and whether the tail has passed and processing is skipped
+    int mSilentFrames = 0;
+    bool mIdle = false;
+    static constexpr double kSilenceThreshold = 1e-9; // -180 dB
+    static constexpr double kTailDecayDb = 120.0;
+
+    // Bypass handling: the requested state (any thread), the applied one
+    // and the crossfade position. mBypassFadeTable holds the fade-in gain
+    // at 0 - mBypassFadeLength frames; the fade-out gain is the same table
+    // read backwards (every curve is symmetric). The table holds
+    // kMaxBypassFadeMs at the current sample rate, allocated in Reset.
+    std::atomic<bool> mHostIsActive{true};
+    std::atomic<bool> mHostBypassed{false};
+    std::atomic<double> mRequestedBypassFadeMs{5.0};
+    std::atomic<int> mRequestedBypassCurve{kBypassRaisedCosine};
+    bool mBypassState = false;
+    bool mBypassFading = false;
+    bool mBypassSuspended = false; // Processing state cleared for true bypass
+    int mBypassFadeCounter = 0;
+    int mBypassFadeLength = 1;
+    BypassCurve mBypassCurve = kBypassRaisedCosine;
+    std::vector<Sample> mBypassFadeTable;
+
+    // Frames per TransformerTHD::ProcessBlock call
+    static constexpr int kTHDChunkSize = 64;
+
+    // Per-channel buffers of one chunk for ProcessFrames (the per-group
+    // ones indexed by link group), kTHDChunkSize frames each. The sidechain
+    // and the detector filter may need two rows past a mono input, so each
+    // buffer has mNumChannels + 2 rows, all in mChunkScratch, allocated in
+    // Reset.
+    enum ChunkBuffer
+    {
+        kChunkConverted = 0, // Host input, then the sidechain
+        kChunkFiltered,      // Detector input after the HPF / LPF
+        kChunkDry,
+        kChunkTHDInput,
+        kChunkTHDOutput,
+        kChunkTHDAmounts,    // Per link group
+        kChunkEnvelopes,     // Per link group
+        kNumChunkBuffers
+    };
+    std::vector<Sample> mChunkScratch;
+    Sample* mChunkBuffers[kNumChunkBuffers][kMaxChannels + 2] = {};
+    int mNumChannels = 0;
+
+    // Frames between THD modulation control points (1 = audio rate); the
+    // amount is ramped linearly from one to the next over an interval
+    static constexpr int kTHDModulationInterval = 16;
+
+    // Requested oversampling, model, waveshaper and antialiasing mode (any
+    // thread), and what is
+    // applied to mTHD, with the dry delay matching its latency
+    std::atomic<int> mRequestedOversamplingStages{0};
+    std::atomic<int> mRequestedOversamplingFilter{kMinimumPhaseIIR};
+    int mOversamplingStages = 0;
+    OversamplingFilter mOversamplingFilter = kMinimumPhaseIIR;
+    std::atomic<int> mRequestedModel{kTHDClassic};
+    THDModel mModel = kTHDClassic;
+    std::atomic<int> mRequestedWaveshaper{kWaveshaperTable};
+    WaveshaperMode mWaveshaper = kWaveshaperTable;
+    std::atomic<int> mRequestedAntialiasing{kAntialiasingOff};
+    Antialiasing mAntialiasing = kAntialiasingOff;
+    static constexpr int kMaxDryDelay = 128; // Longest latency is 74 (8x FIR)
+    double mDryDelay[kMaxChannels][kMaxDryDelay] = {}; // Host precision, see mLookaheadBuffer
+    int mDryDelayLength = 0;
+    int mDryDelayPos = 0;
+
+    // Lookahead: the input delayed by mLookaheadSamples feeds the THD and
+    // the dry path, while the envelope sees it undelayed. The ring holds
+    // kMaxLookaheadMs at the current sample rate, allocated in Reset. It
+    // holds the host's doubles, so true bypass through it is bit-transparent
+    // in the float build too.
+    std::atomic<double> mRequestedLookaheadMs{0.0};
+    std::vector<double> mLookaheadBuffer[kMaxChannels];
+    int mLookaheadCapacity = 0;
+    int mLookaheadSamples = 0;
+    int mLookaheadWritePos = 0;
+    
+    // Output DC blocker on the mixed signal, one pole at kOutputDCPole (as
+    // iplug::DCBlocker), run inside the fused output loop. The wet path has
+    // already been DC blocked ahead of the THD's soft limiter; this one also
+    // covers the dry share of the mix.
+    Sample mOutputDCInput[kMaxChannels] = {};
+    Sample mOutputDCOutput[kMaxChannels] = {};
+    static constexpr double kOutputDCPole = 0.995;
+};
@@ -0,0 +1,77 @@
+// Waveshaper.h
+#pragma once
+
+#include <algorithm>
+#include <vector>
+
+// ==========================================
+// Tabulated waveshaping curves
+// ==========================================
+//
+// A smooth curve sampled with its slope at evenly spaced points on
+// [0, range] and evaluated by cubic Hermite interpolation between them, so
+// the curve and its first derivative stay continuous. Each segment stores
+// its cubic as four polynomial coefficients, read with one load and three
+// multiply-adds. Worth it for curves that need a transcendental per sample
+// (tanh); a short rational evaluates faster than the lookup.
+
+enum WaveshaperMode {
+  kWaveshaperAnalytic = 0, // Curves evaluated exactly (the reference)
+  kWaveshaperTable         // Transcendental curves read from tables
+};
+
+template <typename T> class WaveshaperTable {
+public:
+  // Samples curve(x) and slope(x) at numSegments + 1 points. Allocates, so
+  // build tables off the audio thread.
+  template <typename Curve, typename Slope>
+  void Build(Curve curve, Slope slope, double range, int numSegments) {
+    mRange = (T)range;
+    mLastSegment = numSegments - 1;
+    mSegmentsPerUnit = (T)(numSegments / range);
+    mCoefs.resize(4 * numSegments);
+    const double step = range / numSegments;
+    for (int i = 0; i < numSegments; i++) {
+      const double x0 = i * step;
+      const double y0 = curve(x0);
+      const double y1 = curve(x0 + step);
+      const double d0 = slope(x0) * step;
+      const double d1 = slope(x0 + step) * step;
+      T* c = &mCoefs[4 * i];
+      c[0] = (T)y0;
+      c[1] = (T)d0;
+      c[2] = (T)(3.0 * (y1 - y0) - 2.0 * d0 - d1);
+      c[3] = (T)(2.0 * (y0 - y1) + d0 + d1);
+    }
+    mEnd = (T)curve(range);
+  }
+
+  // x below 0 reads the first point; x at or beyond the range reads the
+  // curve's value at the range
+  T Evaluate(T x) const {
+    if (!(x < mRange)) {
+      return mEnd;
+    }
+    const T position = std::max(x, T(0)) * mSegmentsPerUnit;
+    const int segment = std::min((int)position, mLastSegment);
+    const T f = position - (T)segment;
+    const T* c = &mCoefs[4 * segment];
+    return ((c[3] * f + c[2]) * f + c[1]) * f + c[0];
+  }
+
+  // SIMD lanes of T, one lookup per lane
+  template <typename V> V Evaluate(V x) const {
+    T lanes[4];
+    x.Store(lanes);
+    for (int i = 0; i < V::kSize; i++)
+      lanes[i] = Evaluate(lanes[i]);
+    return V::Load(lanes);
+  }
+
+private:
+  std::vector<T> mCoefs;
+  T mRange = 0;
+  T mSegmentsPerUnit = 0;
+  T mEnd = 0;
+  int mLastSegment = 0;
+};
@@ -0,0 +1,874 @@
+// ToastBench.cpp
+//
+// Benchmarks every DSP stage and the full chain at a range of block sizes
+// and sample rates, and reports the cost in ns per sample frame. The
+// lifecycle/ entries time instantiating and resetting engines instead and
+// report ns per instance.
+//
+//   toast-bench [--filter <text>] [--block-sizes 16,64,...]
+//               [--sample-rates 44100,...] [--min-time <ms>]
+//               [--json <file>]
+//
+// The THD stage kernels are file-local, so THD.cpp is compiled as part of
+// this file instead of being linked.
+
+#include "../THD.cpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "EnvelopeFollower.h"
+#include "Metering.h"
+#include "Smoothers.h"
+#include "ToastEngine.h"
+
+#ifndef TOAST_BENCH_REVISION
+#define TOAST_BENCH_REVISION "unknown"
+#endif
+
+namespace {
+
+// The plugin's fixed THD character and default amount
+constexpr float kWarmth = 1.0f;
+constexpr float kAsymmetry = 0.75f;
+constexpr float kHysteresis = 0.75f;
+constexpr float kTHDAmount = 0.3f;
+
+constexpr int kRepetitions = 5;
+
+// The components run at the engine's precision
+using Sample = ToastEngine::Sample;
+
+// Keeps results alive so the optimizer cannot drop the work
+volatile float gSink;
+
+// 220 Hz sine under a slow tremolo plus a little noise: keeps the
+// hysteresis and soft limiter branches busy without denormals
+template <typename T>
+void FillTestSignal(std::vector<T>& buffer, double sampleRate, int channel) {
+  uint32_t seed = 0x12345678u + channel;
+  for (size_t i = 0; i < buffer.size(); i++) {
+    seed = seed * 1664525u + 1013904223u;
+    const double noise = (double)(seed >> 8) / (double)(1 << 24) - 0.5;
+    const double t = (double)i / sampleRate;
+    const double tremolo = 0.6 + 0.4 * std::sin(2.0 * M_PI * 3.0 * t);
+    buffer[i] = (T)(0.8 * tremolo * std::sin(2.0 * M_PI * 220.0 * t + channel) +
+                    0.02 * noise);
+  }
+}
+
+class Benchmark {
+public:
+  virtual ~Benchmark() = default;
+
+  // Called once per sample rate / block size before timing
+  virtual void Setup(double sampleRate, int blockSize) = 0;
+  // Processes one block
+  virtual void Run() = 0;
+  virtual int GetNumChannels() const { return 1; }
+  // What one Run is divided into for the ns/sample column
+  virtual int GetUnitsPerRun(int blockSize) const { return blockSize; }
+  // False to measure at the first block size only
+  virtual bool DependsOnBlockSize() const { return true; }
+};
+
+// ==========================================
+// TransformerTHD stages
+// ==========================================
+
+// One THD kernel over a mono block, with the state carried across blocks
+// and the coefficients of the given model.
+// Process(input, output, nFrames, state, amount, coefficients)
+template <typename Process> class StageBenchmark : public Benchmark {
+public:
+  StageBenchmark(Process process, THDModel model)
+      : mProcess(process), mModel(model) {}
+
+  void Setup(double sampleRate, int blockSize) override {
+    mCoefficients = MakeCoefficients<Sample>(mModel, kWarmth, kAsymmetry,
+                                             kHysteresis, sampleRate);
+    mAmount = MakeAmountCoefficients<Sample>(kTHDAmount);
+    mState = ChannelState<Sample>();
+    mInput.resize(blockSize);
+    mOutput.resize(blockSize);
+    FillTestSignal(mInput, sampleRate, 0);
+  }
+
+  void Run() override {
+    mProcess(mInput.data(), mOutput.data(), (int)mInput.size(), mState,
+             mAmount, mCoefficients);
+    gSink = mOutput.back();
+  }
+
+private:
+  Process mProcess;
+  THDModel mModel;
+  THDCoefficients<Sample> mCoefficients;
+  AmountCoefficients<Sample> mAmount;
+  ChannelState<Sample> mState;
+  std::vector<Sample> mInput;
+  std::vector<Sample> mOutput;
+};
+
+template <typename Process>
+std::unique_ptr<Benchmark> MakeStageBenchmark(Process process,
+                                              THDModel model = kTHDClassic) {
+  return std::make_unique<StageBenchmark<Process>>(process, model);
+}
+
+// TransformerTHD::ProcessBlock, with a constant or per-sample amount
+class TransformerTHDBenchmark : public Benchmark {
+public:
+  explicit TransformerTHDBenchmark(bool modulated) : mModulated(modulated) {}
+
+  void Setup(double sampleRate, int blockSize) override {
+    mTHD.Initialize((Sample)sampleRate);
+    mTHD.SetWarmth(kWarmth);
+    mTHD.SetAsymmetry(kAsymmetry);
+    mTHD.SetHysteresis(kHysteresis);
+    mTHD.SetTHDAmount(kTHDAmount);
+    mInput.resize(blockSize);
+    mOutput.resize(blockSize);
+    mAmounts.resize(blockSize);
+    FillTestSignal(mInput, sampleRate, 0);
+    for (int i = 0; i < blockSize; i++)
+      mAmounts[i] = kTHDAmount + 0.2f * (float)i / (float)blockSize;
+  }
+
+  void Run() override {
+    if (mModulated)
+      mTHD.ProcessBlock(mInput.data(), mOutput.data(), mAmounts.data(),
+                        (int)mInput.size());
+    else
+      mTHD.ProcessBlock(mInput.data(), mOutput.data(), (int)mInput.size());
+    gSink = mOutput.back();
+  }
+
+private:
+  bool mModulated;
+  TransformerTHD<Sample> mTHD;
+  std::vector<Sample> mInput;
+  std::vector<Sample> mOutput;
+  std::vector<Sample> mAmounts;
+};
+
+// StereoTHD as the engine runs it: per-sample amounts, both channels
+class StereoTHDBenchmark : public Benchmark {
+public:
+  StereoTHDBenchmark(int numStages, OversamplingFilter filter,
+                     Antialiasing antialiasing = kAntialiasingOff,
+                     THDModel model = kTHDClassic)
+      : mNumStages(numStages), mFilter(filter), mAntialiasing(antialiasing),
+        mModel(model) {}
+
+  void Setup(double sampleRate, int blockSize) override {
+    mTHD.Initialize((Sample)sampleRate);
+    mTHD.SetWarmth(kWarmth);
+    mTHD.SetAsymmetry(kAsymmetry);
+    mTHD.SetHysteresis(kHysteresis);
+    mTHD.SetModel(mModel);
+    mTHD.SetOversampling(mNumStages, mFilter);
+    mTHD.SetAntialiasing(mAntialiasing);
+    for (int c = 0; c < 2; c++) {
+      mInput[c].resize(blockSize);
+      mOutput[c].resize(blockSize);
+      FillTestSignal(mInput[c], sampleRate, c);
+    }
+    mAmounts.assign(blockSize, kTHDAmount);
+  }
+
+  void Run() override {
+    const Sample* inputs[2] = {mInput[0].data(), mInput[1].data()};
+    Sample* outputs[2] = {mOutput[0].data(), mOutput[1].data()};
+    mTHD.ProcessBlock(inputs, outputs, 2, mAmounts.data(),
+                      (int)mAmounts.size());
+    gSink = mOutput[1].back();
+  }
+
+  int GetNumChannels() const override { return 2; }
+
+private:
+  int mNumStages;
+  OversamplingFilter mFilter;
+  Antialiasing mAntialiasing;
+  THDModel mModel;
+  StereoTHD<Sample> mTHD;
+  std::vector<Sample> mInput[2];
+  std::vector<Sample> mOutput[2];
+  std::vector<Sample> mAmounts;
+};
+
+// Two TransformerTHD objects on the same block as StereoTHDBenchmark at
+// 1x: the scalar path StereoTHD's SIMD lanes replace
+class TransformerPairBenchmark : public Benchmark {
+public:
+  void Setup(double sampleRate, int blockSize) override {
+    for (int c = 0; c < 2; c++) {
+      mTHD[c].Initialize((Sample)sampleRate);
+      mTHD[c].SetWarmth(kWarmth);
+      mTHD[c].SetAsymmetry(kAsymmetry);
+      mTHD[c].SetHysteresis(kHysteresis);
+      mInput[c].resize(blockSize);
+      mOutput[c].resize(blockSize);
+      FillTestSignal(mInput[c], sampleRate, c);
+    }
+    mAmounts.assign(blockSize, kTHDAmount);
+  }
+
+  void Run() override {
+    for (int c = 0; c < 2; c++)
+      mTHD[c].ProcessBlock(mInput[c].data(), mOutput[c].data(),
+                           mAmounts.data(), (int)mAmounts.size());
+    gSink = mOutput[1].back();
+  }
+
+  int GetNumChannels() const override { return 2; }
+
+private:
+  TransformerTHD<Sample> mTHD[2];
+  std::vector<Sample> mInput[2];
+  std::vector<Sample> mOutput[2];
+  std::vector<Sample> mAmounts;
+};
+
+// ==========================================
+// EnvelopeFollower and smoothers
+// ==========================================
+
+class EnvelopeBenchmark : public Benchmark {
+public:
+  // block: ProcessBlock on a block of input, as the engine calls it
+  EnvelopeBenchmark(EnvelopeFollower<Sample>::Mode mode, bool stereo, bool block)
+      : mMode(mode), mStereo(stereo), mBlock(block) {}
+
+  void Setup(double sampleRate, int blockSize) override {
+    // Same configuration as ToastEngine::Reset
+    mFollower.Initialize((Sample)sampleRate);
+    mFollower.SetMode(mMode);
+    mFollower.SetSensitivity(1.0f);
+    mFollower.SetAttack(1.0f);
+    mFollower.SetRelease(120.0f);
+    mFollower.SetSmoothing(1.0f);
+    mFollower.SetCurve(0.5f);
+    mFollower.SetAmount(1.0f);
+    mFollower.Reset();
+    for (int c = 0; c < 2; c++) {
+      mInput[c].resize(blockSize);
+      mBlockInput[c].resize(blockSize);
+      FillTestSignal(mInput[c], sampleRate, c);
+      FillTestSignal(mBlockInput[c], sampleRate, c);
+    }
+    mEnvelopes.resize(blockSize);
+  }
+
+  void Run() override {
+    const int nFrames = (int)mInput[0].size();
+    Sample envelope = 0;
+    if (mBlock) {
+      const Sample* inputs[2] = {mBlockInput[0].data(), mBlockInput[1].data()};
+      mFollower.ProcessBlock(inputs, mStereo ? 2 : 1, mEnvelopes.data(),
+                             nFrames);
+      envelope = mEnvelopes.back();
+    } else if (mStereo) {
+      for (int i = 0; i < nFrames; i++)
+        envelope += mFollower.ProcessStereo(mInput[0][i], mInput[1][i]);
+    } else {
+      for (int i = 0; i < nFrames; i++)
+        envelope += mFollower.ProcessSample(mInput[0][i]);
+    }
+    gSink = envelope;
+  }
+
+  int GetNumChannels() const override { return mStereo ? 2 : 1; }
+
+private:
+  EnvelopeFollower<Sample>::Mode mMode;
+  bool mStereo;
+  bool mBlock;
+  EnvelopeFollower<Sample> mFollower;
+  std::vector<Sample> mInput[2];
+  std::vector<Sample> mBlockInput[2];
+  std::vector<Sample> mEnvelopes;
+};
+
+// One LogParamSmooth chasing a target that moves every block, as the
+// engine's five smoothers do while a parameter is automated
+class SmootherBenchmark : public Benchmark {
+public:
+  void Setup(double sampleRate, int blockSize) override {
+    mSmoother = iplug::LogParamSmooth<double>(30.0, 0.0);
+    mSmoother.SetSmoothTime(30.0, sampleRate);
+    mBlockSize = blockSize;
+    mTarget = 0.0;
+  }
+
+  void Run() override {
+    mTarget = mTarget > 0.5 ? 0.0 : 1.0;
+    double sum = 0.0;
+    for (int i = 0; i < mBlockSize; i++)
+      sum += mSmoother.Process(mTarget);
+    gSink = (float)sum;
+  }
+
+private:
+  iplug::LogParamSmooth<double> mSmoother;
+  int mBlockSize = 0;
+  double mTarget = 0.0;
+};
+
+// ==========================================
+// Metering
+// ==========================================
+
+// The plugin's meters on a stereo block: input and output peak / RMS, the
+// output true peak, one frame per 1/60 s of audio. The input is the output
+// scaled, so both are measured as the plugin measures them.
+class MeterBenchmark : public Benchmark {
+public:
+  void Setup(double sampleRate, int blockSize) override {
+    mMeter.Reset(sampleRate, 1.0 / 60.0);
+    for (int c = 0; c < 2; c++) {
+      std::vector<Sample> signal(blockSize);
+      FillTestSignal(signal, sampleRate, c);
+      mInput[c].assign(signal.begin(), signal.end());
+      mOutput[c].resize(blockSize);
+      for (int i = 0; i < blockSize; i++)
+        mOutput[c][i] = 1.4 * mInput[c][i];
+    }
+  }
+
+  void Run() override {
+    const double* inputs[2] = {mInput[0].data(), mInput[1].data()};
+    const double* outputs[2] = {mOutput[0].data(), mOutput[1].data()};
+    const int nFrames = (int)mInput[0].size();
+    mMeter.AddInput(inputs, 2, nFrames);
+    mMeter.AddOutput(outputs, 2, nFrames);
+    MeterFrame frame;
+    if (mMeter.EndBlock(nFrames, 0.5f, 0.3f, frame))
+      gSink = frame.outputTruePeak[0];
+  }
+
+  int GetNumChannels() const override { return 2; }
+
+private:
+  Meter mMeter;
+  std::vector<double> mInput[2];
+  std::vector<double> mOutput[2];
+};
+
+// ==========================================
+// Instance lifecycle
+// ==========================================
+
+// Loading a session: kInstances engines constructed, then each reset, as
+// hosts do when a project opens, and destroyed again. Reported per
+// instance.
+class LifecycleBenchmark : public Benchmark {
+public:
+  static constexpr int kInstances = 500;
+
+  void Setup(double sampleRate, int) override { mSampleRate = sampleRate; }
+
+  void Run() override {
+    std::vector<std::unique_ptr<ToastEngine>> engines(kInstances);
+    for (auto& engine : engines)
+      engine = std::make_unique<ToastEngine>();
+    for (auto& engine : engines)
+      engine->Reset(mSampleRate, 2);
+    gSink = (float)engines.back()->GetTailSamples();
+  }
+
+  int GetUnitsPerRun(int) const override { return kInstances; }
+  bool DependsOnBlockSize() const override { return false; }
+
+private:
+  double mSampleRate = 48000.0;
+};
+
+// ==========================================
+// Full chain
+// ==========================================
+
+class EngineBenchmark : public Benchmark {
+public:
+  enum Scenario {
+    kDefault,    // Default parameters, all smoothers settled
+    kDynamics,   // Envelope modulating the THD amount
+    kAutomation, // Input gain moving every block, smoothing never settles
+    kSilence,    // Silent input, idle once the tail has passed
+    kDecay,      // An impulse every 250 ms, filters decaying in between
+    kBypassed,   // Soft-bypassed, past the crossfade
+    kHot,        // Full drive at +12 dB, the THD's soft limiter engaged
+  };
+
+  EngineBenchmark(Scenario scenario, int numStages, OversamplingFilter filter,
+                  int numChannels = 2,
+                  ToastEngine::EnvelopeLink link = ToastEngine::kLinkMax,
+                  WaveshaperMode waveshaper = kWaveshaperTable)
+      : mScenario(scenario), mNumStages(numStages), mFilter(filter),
+        mNumChannels(numChannels), mLink(link), mWaveshaper(waveshaper) {}
+
+  void Setup(double sampleRate, int blockSize) override {
+    mEngine = std::make_unique<ToastEngine>();
+    mTargets = ToastEngine::ParamSnapshot();
+    if (mScenario == kDynamics) {
+      mTargets.thdAmount = 0.5;
+      mTargets.dynamics = 0.5;
+      mEngine->SetThreshold(-30.0);
+    }
+    if (mScenario == kHot) {
+      mTargets.driveDB = 12.0;
+      mTargets.thdAmount = 1.0;
+    }
+    mEngine->SetParamTargets(mTargets);
+    mEngine->SetOversampling(mNumStages, mFilter);
+    mEngine->SetEnvelopeLink(mLink);
+    mEngine->SetWaveshaper(mWaveshaper);
+    mEngine->SetBypassed(mScenario == kBypassed);
+    mEngine->Reset(sampleRate, mNumChannels);
+    for (int c = 0; c < mNumChannels; c++) {
+      mInput[c].resize(blockSize);
+      mOutput[c].resize(blockSize);
+      if (mScenario == kSilence || mScenario == kDecay)
+        std::fill(mInput[c].begin(), mInput[c].end(), 0.0);
+      else
+        FillTestSignal(mInput[c], sampleRate, c);
+    }
+    // Shorter than the engine's tail, so it never goes idle
+    mImpulsePeriod = (int)(0.25 * sampleRate);
+    mFramesToImpulse = 0;
+  }
+
+  void Run() override {
+    if (mScenario == kAutomation) {
+      mTargets.driveDB = mTargets.driveDB > 0.0 ? -3.0 : 3.0;
+      mTargets.outputDB = -mTargets.driveDB;
+      mEngine->SetParamTargets(mTargets);
+    }
+    if (mScenario == kDecay) {
+      const bool impulse = mFramesToImpulse <= 0;
+      for (int c = 0; c < mNumChannels; c++)
+        mInput[c][0] = impulse ? 1.0 : 0.0;
+      if (impulse)
+        mFramesToImpulse += mImpulsePeriod;
+      mFramesToImpulse -= (int)mInput[0].size();
+    }
+    double* inputs[ToastEngine::kMaxChannels];
+    double* outputs[ToastEngine::kMaxChannels];
+    for (int c = 0; c < mNumChannels; c++) {
+      inputs[c] = mInput[c].data();
+      outputs[c] = mOutput[c].data();
+    }
+    mEngine->ProcessBlock(inputs, outputs, mNumChannels,
+                          (int)mOutput[0].size());
+    gSink = (float)mOutput[mNumChannels - 1].back();
+  }
+
+  int GetNumChannels() const override { return mNumChannels; }
+
+private:
+  Scenario mScenario;
+  int mNumStages;
+  OversamplingFilter mFilter;
+  int mNumChannels;
+  ToastEngine::EnvelopeLink mLink;
+  WaveshaperMode mWaveshaper;
+  int mImpulsePeriod = 0;
+  int mFramesToImpulse = 0;
+  std::unique_ptr<ToastEngine> mEngine;
+  ToastEngine::ParamSnapshot mTargets;
+  std::vector<double> mInput[ToastEngine::kMaxChannels];
+  std::vector<double> mOutput[ToastEngine::kMaxChannels];
+};
+
+// ==========================================
+// Registry
+// ==========================================
+
+struct BenchmarkEntry {
+  std::string name;
+  std::unique_ptr<Benchmark> benchmark;
+};
+
+std::vector<BenchmarkEntry> CreateBenchmarks() {
+  std::vector<BenchmarkEntry> entries;
+  auto add = [&](const std::string& name, std::unique_ptr<Benchmark> b) {
+    entries.push_back({name, std::move(b)});
+  };
+
+  using State = ChannelState<Sample>;
+  using Amount = AmountCoefficients<Sample>;
+  using Coefs = THDCoefficients<Sample>;
+
+  add("thd/stage/low_shelf",
+      MakeStageBenchmark([](const Sample* in, Sample* out, int n, State& s,
+                            const Amount&, const Coefs& c) {
+        for (int i = 0; i < n; i++)
+          out[i] = LowShelf(in[i], s.lowShelf, c);
+      }));
+  add("thd/stage/hysteresis",
+      MakeStageBenchmark([](const Sample* in, Sample* out, int n, State& s,
+                            const Amount&, const Coefs& c) {
+        for (int i = 0; i < n; i++)
+          out[i] = Hysteresis(in[i], s.hysteresis, c);
+      }));
+  add("thd/stage/saturation",
+      MakeStageBenchmark([](const Sample* in, Sample* out, int n, State&,
+                            const Amount& a, const Coefs& c) {
+        for (int i = 0; i < n; i++)
+          out[i] = AsymmetricSaturation(in[i], a, c);
+      }));
+  add("thd/stage/high_dampening",
+      MakeStageBenchmark([](const Sample* in, Sample* out, int n, State& s,
+                            const Amount& a, const Coefs& c) {
+        for (int i = 0; i < n; i++)
+          out[i] = HighDampening(in[i], s.highDampen, a, c);
+      }));
+  add("thd/stage/dc_blocker",
+      MakeStageBenchmark([](const Sample* in, Sample* out, int n, State& s,
+                            const Amount&, const Coefs& c) {
+        for (int i = 0; i < n; i++)
+          out[i] = DCBlocker(in[i], s.dcPrevInput, s.dcPrevOutput, c);
+      }));
+  add("thd/stage/soft_limit",
+      MakeStageBenchmark([](const Sample* in, Sample* out, int n, State&,
+                            const Amount&, const Coefs& c) {
+        // Scaled so part of the signal crosses the limiter's knee
+        for (int i = 0; i < n; i++)
+          out[i] = SoftLimit(in[i] * 1.4f, c);
+      }));
+  add("thd/stage/soft_limit_table",
+      MakeStageBenchmark([](const Sample* in, Sample* out, int n, State&,
+                            const Amount&, const Coefs& c) {
+        Coefs table = c;
+        table.kneeTable = &KneeTable<Sample>();
+        for (int i = 0; i < n; i++)
+          out[i] = SoftLimit(in[i] * 1.4f, table);
+      }));
+  add("thd/magnetic/low_shelf",
+      MakeStageBenchmark(
+          [](const Sample* in, Sample* out, int n, State& s, const Amount&,
+             const Coefs& c) {
+            for (int i = 0; i < n; i++)
+              out[i] = MagneticLowShelf(in[i], s.lowShelf, s.lowShelf2, c);
+          },
+          kTHDMagnetic));
+  add("thd/magnetic/hysteresis",
+      MakeStageBenchmark(
+          [](const Sample* in, Sample* out, int n, State& s, const Amount&,
+             const Coefs& c) {
+            for (int i = 0; i < n; i++)
+              out[i] = MagneticHysteresis(in[i], s.hysteresis, c);
+          },
+          kTHDMagnetic));
+  add("thd/magnetic/saturation",
+      MakeStageBenchmark(
+          [](const Sample* in, Sample* out, int n, State&, const Amount& a,
+             const Coefs& c) {
+            for (int i = 0; i < n; i++)
+              out[i] = MagneticSaturation(in[i], a, c);
+          },
+          kTHDMagnetic));
+
+  add("thd/transformer", std::make_unique<TransformerTHDBenchmark>(false));
+  add("thd/transformer_modulated",
+      std::make_unique<TransformerTHDBenchmark>(true));
+
+  static const char* const kOversamplingNames[] = {"1x", "2x", "4x", "8x"};
+  for (int stages = 0; stages <= 3; stages++) {
+    add(std::string("thd/stereo/") + kOversamplingNames[stages] + "_min",
+        std::make_unique<StereoTHDBenchmark>(stages, kMinimumPhaseIIR));
+    if (stages > 0)
+      add(std::string("thd/stereo/") + kOversamplingNames[stages] + "_linear",
+          std::make_unique<StereoTHDBenchmark>(stages, kLinearPhaseFIR));
+  }
+  add("thd/stereo/1x_two_mono", std::make_unique<TransformerPairBenchmark>());
+  add("thd/stereo/1x_adaa1",
+      std::make_unique<StereoTHDBenchmark>(0, kMinimumPhaseIIR,
+                                           kADAAFirstOrder));
+  add("thd/stereo/1x_adaa2",
+      std::make_unique<StereoTHDBenchmark>(0, kMinimumPhaseIIR,
+                                           kADAASecondOrder));
+  add("thd/stereo/1x_magnetic",
+      std::make_unique<StereoTHDBenchmark>(0, kMinimumPhaseIIR,
+                                           kAntialiasingOff, kTHDMagnetic));
+
+  static const char* const kModeNames[] = {"peak", "rms", "vintage",
+                                           "vactrol"};
+  for (int mode = EnvelopeFollower<Sample>::PEAK; mode <= EnvelopeFollower<Sample>::VACTROL;
+       mode++) {
+    const auto m = (EnvelopeFollower<Sample>::Mode)mode;
+    add(std::string("envelope/") + kModeNames[mode],
+        std::make_unique<EnvelopeBenchmark>(m, false, false));
+    add(std::string("envelope/") + kModeNames[mode] + "_stereo_block",
+        std::make_unique<EnvelopeBenchmark>(m, true, true));
+  }
+  add("envelope/rms_stereo",
+      std::make_unique<EnvelopeBenchmark>(EnvelopeFollower<Sample>::RMS, true, false));
+
+  add("smoother/log_param", std::make_unique<SmootherBenchmark>());
+
+  add("meter/stereo", std::make_unique<MeterBenchmark>());
+
+  add("engine/default", std::make_unique<EngineBenchmark>(
+                            EngineBenchmark::kDefault, 0, kMinimumPhaseIIR));
+  add("engine/dynamics", std::make_unique<EngineBenchmark>(
+                             EngineBenchmark::kDynamics, 0, kMinimumPhaseIIR));
+  add("engine/automation",
+      std::make_unique<EngineBenchmark>(EngineBenchmark::kAutomation, 0,
+                                        kMinimumPhaseIIR));
+  add("engine/silence", std::make_unique<EngineBenchmark>(
+                            EngineBenchmark::kSilence, 0, kMinimumPhaseIIR));
+  add("engine/decay", std::make_unique<EngineBenchmark>(
+                          EngineBenchmark::kDecay, 0, kMinimumPhaseIIR));
+  add("engine/decay_4x", std::make_unique<EngineBenchmark>(
+                             EngineBenchmark::kDecay, 2, kMinimumPhaseIIR));
+  add("engine/bypassed", std::make_unique<EngineBenchmark>(
+                             EngineBenchmark::kBypassed, 0, kMinimumPhaseIIR));
+  add("engine/bypassed_4x", std::make_unique<EngineBenchmark>(
+                                EngineBenchmark::kBypassed, 2, kMinimumPhaseIIR));
+  add("engine/hot", std::make_unique<EngineBenchmark>(
+                        EngineBenchmark::kHot, 0, kMinimumPhaseIIR));
+  add("engine/hot_analytic",
+      std::make_unique<EngineBenchmark>(EngineBenchmark::kHot, 0,
+                                        kMinimumPhaseIIR, 2,
+                                        ToastEngine::kLinkMax,
+                                        kWaveshaperAnalytic));
+  add("engine/dynamics_4x_linear",
+      std::make_unique<EngineBenchmark>(EngineBenchmark::kDynamics, 2,
+                                        kLinearPhaseFIR));
+  // 7.1.4
+  add("engine/surround_grouped",
+      std::make_unique<EngineBenchmark>(EngineBenchmark::kDynamics, 0,
+                                        kMinimumPhaseIIR, 12,
+                                        ToastEngine::kLinkGrouped));
+  add("engine/surround_channel",
+      std::make_unique<EngineBenchmark>(EngineBenchmark::kDynamics, 0,
+                                        kMinimumPhaseIIR, 12,
+                                        ToastEngine::kLinkPerChannel));
+
+  add("lifecycle/load_x500",
+      std::make_unique<LifecycleBenchmark>());
+  return entries;
+}
+
+// ==========================================
+// Timing
+// ==========================================
+
+struct Result {
+  std::string name;
+  double sampleRate;
+  int blockSize;
+  int numChannels;
+  long long iterations;
+  double nsPerSample; // median over the repetitions
+  double nsPerSampleMin;
+};
+
+double Now() {
+  return std::chrono::duration<double>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+double TimeBlocks(Benchmark& benchmark, long long numBlocks) {
+  const double start = Now();
+  for (long long i = 0; i < numBlocks; i++)
+    benchmark.Run();
+  return Now() - start;
+}
+
+Result Measure(const BenchmarkEntry& entry, double sampleRate, int blockSize,
+               double minTime) {
+  Benchmark& benchmark = *entry.benchmark;
+  benchmark.Setup(sampleRate, blockSize);
+
+  // Warm up caches and filter state, and size one repetition to
+  // minTime / kRepetitions
+  const double repetitionTime = minTime / kRepetitions;
+  long long numBlocks = 1;
+  for (;;) {
+    const double elapsed = TimeBlocks(benchmark, numBlocks);
+    if (elapsed >= repetitionTime * 0.5)
+      break;
+    const double scale =
+        elapsed > 0.0 ? std::min(100.0, repetitionTime / elapsed) : 100.0;
+    numBlocks = (long long)((double)numBlocks * std::max(2.0, scale));
+  }
+
+  std::vector<double> nsPerSample(kRepetitions);
+  for (int r = 0; r < kRepetitions; r++) {
+    const double elapsed = TimeBlocks(benchmark, numBlocks);
+    nsPerSample[r] =
+        elapsed * 1e9 / ((double)numBlocks * benchmark.GetUnitsPerRun(blockSize));
+  }
+  std::sort(nsPerSample.begin(), nsPerSample.end());
+
+  Result result;
+  result.name = entry.name;
+  result.sampleRate = sampleRate;
+  result.blockSize = blockSize;
+  result.numChannels = benchmark.GetNumChannels();
+  result.iterations = numBlocks * kRepetitions;
+  result.nsPerSample = nsPerSample[kRepetitions / 2];
+  result.nsPerSampleMin = nsPerSample[0];
+  return result;
+}
+
+// ==========================================
+// Output
+// ==========================================
+
+double RealtimeMultiple(const Result& r) {
+  return 1e9 / (r.nsPerSample * r.sampleRate);
+}
+
+bool WriteJson(const std::string& path, const std::vector<Result>& results,
+               double minTime) {
+  FILE* file = path == "-" ? stdout : fopen(path.c_str(), "w");
+  if (!file)
+    return false;
+
+  char date[32];
+  const time_t now = time(nullptr);
+  strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%SZ", gmtime(&now));
+
+  fprintf(file, "{\n  \"context\": {\n");
+  fprintf(file, "    \"date\": \"%s\",\n", date);
+  fprintf(file, "    \"revision\": \"%s\",\n", TOAST_BENCH_REVISION);
+#ifdef __VERSION__
+  fprintf(file, "    \"compiler\": \"%s\",\n", __VERSION__);
+#endif
+  fprintf(file, "    \"precision\": \"%s\",\n",
+          sizeof(Sample) == sizeof(double) ? "double" : "float");
+  fprintf(file, "    \"min_time_ms\": %g,\n", minTime * 1000.0);
+  fprintf(file, "    \"repetitions\": %d,\n", kRepetitions);
+  fprintf(file, "    \"unit\": \"ns per sample frame\"\n  },\n");
+  fprintf(file, "  \"benchmarks\": [\n");
+  for (size_t i = 0; i < results.size(); i++) {
+    const Result& r = results[i];
+    fprintf(file,
+            "    {\"name\": \"%s\", \"sample_rate\": %g, \"block_size\": %d, "
+            "\"channels\": %d, \"iterations\": %lld, \"ns_per_sample\": %.4f, "
+            "\"ns_per_sample_min\": %.4f, \"realtime_multiple\": %.1f}%s\n",
+            r.name.c_str(), r.sampleRate, r.blockSize, r.numChannels,
+            r.iterations, r.nsPerSample, r.nsPerSampleMin,
+            RealtimeMultiple(r), i + 1 < results.size() ? "," : "");
+  }
+  fprintf(file, "  ]\n}\n");
+
+  return file == stdout ? true : fclose(file) == 0;
+}
+
+template <typename T>
+bool ParseList(const char* text, std::vector<T>& values) {
+  values.clear();
+  const char* p = text;
+  while (*p) {
+    char* end = nullptr;
+    const double value = strtod(p, &end);
+    if (end == p || value <= 0.0)
+      return false;
+    values.push_back((T)value);
+    p = *end == ',' ? end + 1 : end;
+    if (*end && *end != ',')
+      return false;
+  }
+  return !values.empty();
+}
+
+void PrintUsage() {
+  fprintf(stderr,
+          "usage: toast-bench [options]\n"
+          "\n"
+          "  --filter <text>          only benchmarks whose name contains text\n"
+          "  --block-sizes <list>     default 16,32,64,128,256,512,1024,2048,4096\n"
+          "  --sample-rates <list>    default 44100,48000,88200,96000,176400,192000\n"
+          "  --min-time <ms>          time per measurement (default 20)\n"
+          "  --json <file>            write results as JSON (- for stdout)\n"
+          "  --list                   list benchmark names\n");
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  std::string filter;
+  std::string jsonPath;
+  std::vector<int> blockSizes = {16, 32, 64, 128, 256, 512, 1024, 2048, 4096};
+  std::vector<double> sampleRates = {44100.0, 48000.0,  88200.0,
+                                     96000.0, 176400.0, 192000.0};
+  double minTime = 0.02;
+  bool list = false;
+
+  for (int i = 1; i < argc; i++) {
+    const std::string arg = argv[i];
+    const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+    bool ok = true;
+    if (arg == "--list") {
+      list = true;
+      continue;
+    } else if (!value) {
+      ok = false;
+    } else if (arg == "--filter") {
+      filter = value;
+    } else if (arg == "--json") {
+      jsonPath = value;
+    } else if (arg == "--block-sizes") {
+      ok = ParseList(value, blockSizes);
+    } else if (arg == "--sample-rates") {
+      ok = ParseList(value, sampleRates);
+    } else if (arg == "--min-time") {
+      minTime = atof(value) / 1000.0;
+      ok = minTime > 0.0;
+    } else {
+      ok = false;
+    }
+    if (!ok) {
+      PrintUsage();
+      return 1;
+    }
+    i++;
+  }
+
+  std::vector<BenchmarkEntry> benchmarks = CreateBenchmarks();
+  if (list) {
+    for (const BenchmarkEntry& entry : benchmarks)
+      printf("%s\n", entry.name.c_str());
+    return 0;
+  }
+
+  // The table goes to stderr when the JSON goes to stdout
+  FILE* table = jsonPath == "-" ? stderr : stdout;
+  fprintf(table, "%-28s %8s %6s %3s %12s %12s\n", "benchmark", "rate",
+          "block", "ch", "ns/sample", "x realtime");
+
+  std::vector<Result> results;
+  for (const BenchmarkEntry& entry : benchmarks) {
+    if (entry.name.find(filter) == std::string::npos)
+      continue;
+    for (double sampleRate : sampleRates) {
+      for (int blockSize : blockSizes) {
+        if (blockSize != blockSizes.front() &&
+            !entry.benchmark->DependsOnBlockSize())
+          continue;
+        const Result r = Measure(entry, sampleRate, blockSize, minTime);
+        fprintf(table, "%-28s %8g %6d %3d %12.3f %12.1f\n", r.name.c_str(),
+                r.sampleRate, r.blockSize, r.numChannels, r.nsPerSample,
+                RealtimeMultiple(r));
+        results.push_back(r);
+      }
+    }
+  }
+
+  if (!jsonPath.empty() && !WriteJson(jsonPath, results, minTime)) {
+    fprintf(stderr, "toast-bench: cannot write %s\n", jsonPath.c_str());
+    return 1;
+  }
+  return 0;
+}
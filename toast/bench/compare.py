@@ -0,0 +1,48 @@
+#!/usr/bin/env python3
+# Compares two toast-bench JSON files and lists the changes in ns/sample.
+#
+#   compare.py before.json after.json [threshold_percent]
+#
+# Exits with 1 if anything got slower by more than the threshold (default 5%).
+
+import json
+import sys
+
+
+def load(path):
+    with open(path) as f:
+        data = json.load(f)
+    results = {}
+    for b in data["benchmarks"]:
+        key = (b["name"], b["sample_rate"], b["block_size"])
+        results[key] = b["ns_per_sample"]
+    return data["context"].get("revision", path), results
+
+
+def main():
+    if len(sys.argv) < 3:
+        print("usage: compare.py before.json after.json [threshold_percent]")
+        return 2
+    threshold = float(sys.argv[3]) if len(sys.argv) > 3 else 5.0
+    before_rev, before = load(sys.argv[1])
+    after_rev, after = load(sys.argv[2])
+
+    print("%s -> %s" % (before_rev, after_rev))
+    print("%-28s %8s %6s %10s %10s %8s" % ("benchmark", "rate", "block", "before", "after", "change"))
+    regressions = 0
+    for key in sorted(before.keys() & after.keys()):
+        change = (after[key] / before[key] - 1.0) * 100.0
+        flag = ""
+        if change > threshold:
+            flag = "  slower"
+            regressions += 1
+        elif change < -threshold:
+            flag = "  faster"
+        print("%-28s %8g %6d %10.3f %10.3f %+7.1f%%%s" % (key + (before[key], after[key], change, flag)))
+
+    print("%d regression(s) over %g%%" % (regressions, threshold))
+    return 1 if regressions else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,370 @@
+// WavFile.cpp
+#include "WavFile.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace {
+
+constexpr uint16_t kFormatPCM = 1;
+constexpr uint16_t kFormatFloat = 3;
+constexpr uint16_t kFormatExtensible = 0xFFFE;
+
+// JUNK chunk payload, the size of a ds64 chunk without a table
+constexpr uint32_t kDS64Size = 28;
+constexpr uint32_t kMaxSize32 = 0xFFFFFFFF;
+
+bool Seek(FILE* file, int64_t offset, int whence) {
+#ifdef _WIN32
+  return _fseeki64(file, offset, whence) == 0;
+#else
+  return fseeko(file, (off_t)offset, whence) == 0;
+#endif
+}
+
+uint16_t ReadU16(const uint8_t* p) { return (uint16_t)(p[0] | (p[1] << 8)); }
+
+uint32_t ReadU32(const uint8_t* p) {
+  return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) |
+         ((uint32_t)p[3] << 24);
+}
+
+uint64_t ReadU64(const uint8_t* p) {
+  return (uint64_t)ReadU32(p) | ((uint64_t)ReadU32(p + 4) << 32);
+}
+
+void WriteU16(uint8_t* p, uint16_t v) {
+  p[0] = (uint8_t)v;
+  p[1] = (uint8_t)(v >> 8);
+}
+
+void WriteU32(uint8_t* p, uint32_t v) {
+  for (int i = 0; i < 4; i++)
+    p[i] = (uint8_t)(v >> (8 * i));
+}
+
+void WriteU64(uint8_t* p, uint64_t v) {
+  WriteU32(p, (uint32_t)v);
+  WriteU32(p + 4, (uint32_t)(v >> 32));
+}
+
+// More than two channels or a speaker mask need WAVE_FORMAT_EXTENSIBLE
+bool IsExtensible(const WavFormat& format) {
+  return format.numChannels > 2 || format.channelMask != 0;
+}
+
+uint32_t FmtChunkSize(const WavFormat& format) {
+  return IsExtensible(format) ? 40 : format.isFloat ? 18 : 16;
+}
+
+double DecodeSample(const uint8_t* p, const WavFormat& format) {
+  if (format.isFloat) {
+    if (format.bitsPerSample == 32) {
+      float f;
+      uint32_t bits = ReadU32(p);
+      std::memcpy(&f, &bits, sizeof(f));
+      return f;
+    }
+    double d;
+    uint64_t bits = ReadU64(p);
+    std::memcpy(&d, &bits, sizeof(d));
+    return d;
+  }
+
+  switch (format.bitsPerSample) {
+  case 16:
+    return (int16_t)ReadU16(p) / 32768.0;
+  case 24: {
+    int32_t v = (int32_t)(p[0] | (p[1] << 8) | (p[2] << 16));
+    v = (v ^ 0x800000) - 0x800000; // sign extend
+    return v / 8388608.0;
+  }
+  default:
+    return (int32_t)ReadU32(p) / 2147483648.0;
+  }
+}
+
+int32_t Quantize(double sample, double scale) {
+  double v = std::max(-scale, std::min(sample * scale, scale - 1.0));
+  return (int32_t)std::lrint(v);
+}
+
+void EncodeSample(uint8_t* p, double sample, const WavFormat& format) {
+  if (format.isFloat) {
+    if (format.bitsPerSample == 32) {
+      float f = (float)sample;
+      uint32_t bits;
+      std::memcpy(&bits, &f, sizeof(bits));
+      WriteU32(p, bits);
+    } else {
+      uint64_t bits;
+      std::memcpy(&bits, &sample, sizeof(bits));
+      WriteU64(p, bits);
+    }
+    return;
+  }
+
+  switch (format.bitsPerSample) {
+  case 16:
+    WriteU16(p, (uint16_t)Quantize(sample, 32768.0));
+    break;
+  case 24: {
+    int32_t v = Quantize(sample, 8388608.0);
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);
+    break;
+  }
+  default:
+    WriteU32(p, (uint32_t)Quantize(sample, 2147483648.0));
+    break;
+  }
+}
+
+bool IsSupported(const WavFormat& format) {
+  if (format.numChannels < 1 || format.sampleRate < 1)
+    return false;
+  if (format.isFloat)
+    return format.bitsPerSample == 32 || format.bitsPerSample == 64;
+  return format.bitsPerSample == 16 || format.bitsPerSample == 24 ||
+         format.bitsPerSample == 32;
+}
+
+} // namespace
+
+// ==========================================
+// WavReader
+// ==========================================
+
+WavReader::~WavReader() { Close(); }
+
+bool WavReader::Fail(const std::string& message) {
+  mError = message;
+  Close();
+  return false;
+}
+
+void WavReader::Close() {
+  if (mFile) {
+    fclose(mFile);
+    mFile = nullptr;
+  }
+}
+
+bool WavReader::Open(const std::string& path) {
+  Close();
+  mFormat = WavFormat();
+  mNumFrames = mFramesLeft = 0;
+  mError.clear();
+
+  mFile = fopen(path.c_str(), "rb");
+  if (!mFile)
+    return Fail("cannot open file");
+
+  uint8_t header[12];
+  if (fread(header, 1, 12, mFile) != 12 || std::memcmp(header + 8, "WAVE", 4))
+    return Fail("not a WAV file");
+  const bool isRF64 = !std::memcmp(header, "RF64", 4);
+  if (!isRF64 && std::memcmp(header, "RIFF", 4))
+    return Fail("not a WAV file");
+
+  uint64_t ds64DataSize = 0;
+  bool haveFormat = false;
+
+  for (;;) {
+    uint8_t chunk[8];
+    if (fread(chunk, 1, 8, mFile) != 8)
+      return Fail("no data chunk");
+    const uint32_t size = ReadU32(chunk + 4);
+
+    if (!std::memcmp(chunk, "ds64", 4)) {
+      uint8_t ds64[24];
+      if (size < 24 || fread(ds64, 1, 24, mFile) != 24)
+        return Fail("truncated ds64 chunk");
+      ds64DataSize = ReadU64(ds64 + 8);
+      if (!Seek(mFile, (int64_t)(size - 24) + (size & 1), SEEK_CUR))
+        return Fail("truncated ds64 chunk");
+    } else if (!std::memcmp(chunk, "fmt ", 4)) {
+      uint8_t fmt[40] = {};
+      const uint32_t readSize = std::min<uint32_t>(size, sizeof(fmt));
+      if (size < 16 || fread(fmt, 1, readSize, mFile) != readSize)
+        return Fail("truncated fmt chunk");
+      uint16_t tag = ReadU16(fmt);
+      if (tag == kFormatExtensible && size >= 40) {
+        mFormat.channelMask = ReadU32(fmt + 20);
+        tag = ReadU16(fmt + 24); // first two bytes of the subformat GUID
+      }
+      mFormat.numChannels = ReadU16(fmt + 2);
+      mFormat.sampleRate = (int)ReadU32(fmt + 4);
+      mFormat.bitsPerSample = ReadU16(fmt + 14);
+      mFormat.isFloat = tag == kFormatFloat;
+      if ((tag != kFormatPCM && tag != kFormatFloat) || !IsSupported(mFormat))
+        return Fail("unsupported sample format");
+      if (!Seek(mFile, (int64_t)(size - readSize) + (size & 1), SEEK_CUR))
+        return Fail("truncated fmt chunk");
+      haveFormat = true;
+    } else if (!std::memcmp(chunk, "data", 4)) {
+      if (!haveFormat)
+        return Fail("data chunk before fmt chunk");
+      const uint64_t dataSize =
+          (isRF64 && size == kMaxSize32) ? ds64DataSize : size;
+      mNumFrames = mFramesLeft = dataSize / mFormat.BytesPerFrame();
+      return true;
+    } else if (!Seek(mFile, (int64_t)size + (size & 1), SEEK_CUR)) {
+      return Fail("no data chunk");
+    }
+  }
+}
+
+int WavReader::Read(double* const* channels, int maxFrames) {
+  if (!mFile)
+    return 0;
+
+  const int frames = (int)std::min<uint64_t>(maxFrames, mFramesLeft);
+  const int bytesPerSample = mFormat.bitsPerSample / 8;
+  mBuffer.resize((size_t)frames * mFormat.BytesPerFrame());
+  const int framesRead =
+      (int)(fread(mBuffer.data(), mFormat.BytesPerFrame(), frames, mFile));
+
+  const uint8_t* p = mBuffer.data();
+  for (int i = 0; i < framesRead; i++) {
+    for (int c = 0; c < mFormat.numChannels; c++) {
+      channels[c][i] = DecodeSample(p, mFormat);
+      p += bytesPerSample;
+    }
+  }
+
+  // A short read is a truncated file: stop there
+  mFramesLeft = framesRead < frames ? 0 : mFramesLeft - framesRead;
+  return framesRead;
+}
+
+// ==========================================
+// WavWriter
+// ==========================================
+
+WavWriter::~WavWriter() {
+  if (mFile)
+    Close();
+}
+
+bool WavWriter::Fail(const std::string& message) {
+  if (mError.empty())
+    mError = message;
+  return false;
+}
+
+bool WavWriter::Open(const std::string& path, const WavFormat& format) {
+  mFormat = format;
+  mDataBytes = 0;
+  mError.clear();
+  if (!IsSupported(format))
+    return Fail("unsupported sample format");
+
+  mFile = fopen(path.c_str(), "wb");
+  if (!mFile)
+    return Fail("cannot create file");
+
+  // RIFF, JUNK (ds64 placeholder), fmt, data
+  const bool extensible = IsExtensible(format);
+  const uint16_t tag = format.isFloat ? kFormatFloat : kFormatPCM;
+  const uint32_t fmtSize = FmtChunkSize(format);
+  uint8_t header[12 + 8 + kDS64Size + 8 + 40 + 8] = {};
+  uint8_t* p = header;
+  std::memcpy(p, "RIFF", 4);
+  std::memcpy(p + 8, "WAVE", 4);
+  p += 12;
+  std::memcpy(p, "JUNK", 4);
+  WriteU32(p + 4, kDS64Size);
+  p += 8 + kDS64Size;
+  std::memcpy(p, "fmt ", 4);
+  WriteU32(p + 4, fmtSize);
+  WriteU16(p + 8, extensible ? kFormatExtensible : tag);
+  WriteU16(p + 10, (uint16_t)format.numChannels);
+  WriteU32(p + 12, (uint32_t)format.sampleRate);
+  WriteU32(p + 16, (uint32_t)(format.sampleRate * format.BytesPerFrame()));
+  WriteU16(p + 20, (uint16_t)format.BytesPerFrame());
+  WriteU16(p + 22, (uint16_t)format.bitsPerSample);
+  if (extensible) {
+    static const uint8_t kSubformatTail[14] = {0x00, 0x00, 0x00, 0x00, 0x10,
+                                               0x00, 0x80, 0x00, 0x00, 0xAA,
+                                               0x00, 0x38, 0x9B, 0x71};
+    WriteU16(p + 24, 22); // cbSize
+    WriteU16(p + 26, (uint16_t)format.bitsPerSample);
+    WriteU32(p + 28, format.channelMask);
+    WriteU16(p + 32, tag);
+    std::memcpy(p + 34, kSubformatTail, sizeof(kSubformatTail));
+  }
+  p += 8 + fmtSize; // cbSize (plain float) stays 0
+  std::memcpy(p, "data", 4);
+  p += 8;
+
+  const size_t headerSize = (size_t)(p - header);
+  if (fwrite(header, 1, headerSize, mFile) != headerSize)
+    return Fail("write failed");
+  return true;
+}
+
+bool WavWriter::Write(const double* const* channels, int numFrames) {
+  if (!mFile)
+    return false;
+
+  const int bytesPerSample = mFormat.bitsPerSample / 8;
+  mBuffer.resize((size_t)numFrames * mFormat.BytesPerFrame());
+  uint8_t* p = mBuffer.data();
+  for (int i = 0; i < numFrames; i++) {
+    for (int c = 0; c < mFormat.numChannels; c++) {
+      EncodeSample(p, channels[c][i], mFormat);
+      p += bytesPerSample;
+    }
+  }
+
+  if (fwrite(mBuffer.data(), 1, mBuffer.size(), mFile) != mBuffer.size())
+    return Fail("write failed");
+  mDataBytes += mBuffer.size();
+  return true;
+}
+
+bool WavWriter::Close() {
+  if (!mFile)
+    return mError.empty();
+
+  const uint64_t dataOffset = 12 + 8 + kDS64Size + 8 + FmtChunkSize(mFormat);
+  const uint64_t pad = mDataBytes & 1;
+  if (pad && fputc(0, mFile) == EOF)
+    Fail("write failed");
+  const uint64_t riffSize = dataOffset + 8 + mDataBytes + pad - 8;
+
+  uint8_t size[4];
+  if (riffSize <= kMaxSize32) {
+    WriteU32(size, (uint32_t)riffSize);
+    if (!Seek(mFile, 4, SEEK_SET) || fwrite(size, 1, 4, mFile) != 4)
+      Fail("write failed");
+    WriteU32(size, (uint32_t)mDataBytes);
+  } else {
+    // Promote to RF64: the JUNK chunk becomes ds64 with the real sizes
+    uint8_t header[12 + 8 + kDS64Size];
+    std::memcpy(header, "RF64", 4);
+    WriteU32(header + 4, kMaxSize32);
+    std::memcpy(header + 8, "WAVE", 4);
+    std::memcpy(header + 12, "ds64", 4);
+    WriteU32(header + 16, kDS64Size);
+    WriteU64(header + 20, riffSize);
+    WriteU64(header + 28, mDataBytes);
+    WriteU64(header + 36, mDataBytes / mFormat.BytesPerFrame());
+    WriteU32(header + 44, 0); // no table
+    if (!Seek(mFile, 0, SEEK_SET) ||
+        fwrite(header, 1, sizeof(header), mFile) != sizeof(header))
+      Fail("write failed");
+    WriteU32(size, kMaxSize32);
+  }
+  if (!Seek(mFile, (int64_t)dataOffset + 4, SEEK_SET) ||
+      fwrite(size, 1, 4, mFile) != 4)
+    Fail("write failed");
+
+  if (fclose(mFile) != 0)
+    Fail("write failed");
+  mFile = nullptr;
+  return mError.empty();
+}
@@ -0,0 +1,76 @@
+// WavFile.h
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// ==========================================
+// Streaming WAV / RF64 reader and writer
+// ==========================================
+//
+// PCM 16 / 24 / 32 bit and IEEE float 32 / 64 bit, little-endian, any
+// channel count. Samples are exchanged as deinterleaved doubles in [-1, 1).
+
+struct WavFormat {
+  int numChannels = 0;
+  int sampleRate = 0;
+  int bitsPerSample = 0;
+  bool isFloat = false;
+  uint32_t channelMask = 0; // WAVE_FORMAT_EXTENSIBLE speakers, 0 if none
+
+  int BytesPerFrame() const { return numChannels * (bitsPerSample / 8); }
+};
+
+class WavReader {
+public:
+  ~WavReader();
+
+  // False with error set if the file is missing or not a supported WAV
+  bool Open(const std::string& path);
+  void Close();
+
+  const WavFormat& GetFormat() const { return mFormat; }
+  uint64_t GetNumFrames() const { return mNumFrames; }
+  const std::string& GetError() const { return mError; }
+
+  // Reads up to maxFrames into channels[c][0..); returns frames read,
+  // 0 at the end of the data
+  int Read(double* const* channels, int maxFrames);
+
+private:
+  bool Fail(const std::string& message);
+
+  FILE* mFile = nullptr;
+  WavFormat mFormat;
+  uint64_t mNumFrames = 0;
+  uint64_t mFramesLeft = 0;
+  std::vector<uint8_t> mBuffer;
+  std::string mError;
+};
+
+// Writes a RIFF header with a JUNK chunk reserved for ds64, and promotes
+// the file to RF64 in Close() if the data outgrew 4 GB.
+class WavWriter {
+public:
+  ~WavWriter();
+
+  bool Open(const std::string& path, const WavFormat& format);
+  // Patches the header sizes; false if writing failed at any point
+  bool Close();
+
+  const std::string& GetError() const { return mError; }
+
+  // Integer formats are clipped to full scale
+  bool Write(const double* const* channels, int numFrames);
+
+private:
+  bool Fail(const std::string& message);
+
+  FILE* mFile = nullptr;
+  WavFormat mFormat;
+  uint64_t mDataBytes = 0;
+  std::vector<uint8_t> mBuffer;
+  std::string mError;
+};
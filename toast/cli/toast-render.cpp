@@ -0,0 +1,497 @@
+// toast-render.cpp
+//
+// Offline renderer: runs WAV / RF64 files through ToastEngine, the same
+// signal chain as the plugin, several files in parallel.
+//
+//   toast-render [options] file.wav...
+//
+// Output keeps the input format and goes to <name>.toast.wav next to the
+// input, or to <out-dir>/<name>.wav. Latency is compensated, so the
+// output lines up with the input sample for sample.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ToastEngine.h"
+#include "WavFile.h"
+
+namespace {
+
+// Frames per ToastEngine::ProcessBlock call; also the read / write size
+constexpr int kRenderBlockSize = 4096;
+constexpr int kMaxChannels = ToastEngine::kMaxChannels;
+
+struct RenderSettings {
+  double inputDB = 0.0;
+  double driveAmount = 30.0;
+  double dynamics = 0.0;
+  double thresholdDB = -20.0;
+  double attackMs = 1.0;
+  double releaseMs = 120.0;
+  double curve = 50.0;
+  double mix = 100.0;
+  double outputDB = 0.0;
+  double lookaheadMs = 0.0;
+  double detectorHighPassHz = 20.0;
+  double detectorLowPassHz = 20000.0;
+  bool linkGain = true;
+  bool outputSet = false;
+  int oversamplingStages = 0;
+  OversamplingFilter oversamplingFilter = kMinimumPhaseIIR;
+  THDModel model = kTHDClassic;
+  WaveshaperMode waveshaper = kWaveshaperTable;
+  Antialiasing antialiasing = kAntialiasingOff;
+  ToastEngine::EnvelopeLink envelopeLink = ToastEngine::kLinkMax;
+};
+
+struct Options {
+  RenderSettings settings;
+  std::string outDir;
+  int numThreads = 0;
+  std::vector<std::string> files;
+};
+
+// Same names, units and ranges as the plugin parameters
+struct NumericOption {
+  const char* name;
+  double RenderSettings::*value;
+  double min;
+  double max;
+};
+
+const NumericOption kNumericOptions[] = {
+    {"input", &RenderSettings::inputDB, -12.0, 12.0},
+    {"drive", &RenderSettings::driveAmount, 0.0, 100.0},
+    {"dynamics", &RenderSettings::dynamics, -100.0, 100.0},
+    {"threshold", &RenderSettings::thresholdDB, -60.0, 0.0},
+    {"attack", &RenderSettings::attackMs, 0.5, 50.0},
+    {"release", &RenderSettings::releaseMs, 10.0, 500.0},
+    {"curve", &RenderSettings::curve, 0.0, 100.0},
+    {"mix", &RenderSettings::mix, 0.0, 100.0},
+    {"output", &RenderSettings::outputDB, -12.0, 12.0},
+    {"lookahead", &RenderSettings::lookaheadMs, 0.0,
+     ToastEngine::kMaxLookaheadMs},
+    {"detector-hpf", &RenderSettings::detectorHighPassHz, 20.0, 2000.0},
+    {"detector-lpf", &RenderSettings::detectorLowPassHz, 200.0, 20000.0},
+};
+
+void PrintUsage() {
+  fprintf(stderr,
+          "usage: toast-render [options] file.wav...\n"
+          "\n"
+          "  --input <dB>          -12 to 12      (default 0)\n"
+          "  --drive <%%>           0 to 100       (default 30)\n"
+          "  --dynamics <%%>        -100 to 100    (default 0)\n"
+          "  --threshold <dB>      -60 to 0       (default -20)\n"
+          "  --attack <ms>         0.5 to 50      (default 1)\n"
+          "  --release <ms>        10 to 500      (default 120)\n"
+          "  --curve <%%>           0 to 100       (default 50)\n"
+          "  --mix <%%>             0 to 100       (default 100)\n"
+          "  --output <dB>         -12 to 12, needs --link off\n"
+          "  --link on|off         output = -input (default on)\n"
+          "  --lookahead <ms>      0 to 10        (default 0)\n"
+          "  --detector-hpf <Hz>   20 to 2000     (default 20, off)\n"
+          "  --detector-lpf <Hz>   200 to 20000   (default 20000, off)\n"
+          "  --oversampling off|2x|4x|8x          (default off)\n"
+          "  --os-filter min|linear               (default min)\n"
+          "  --model classic|magnetic             (default classic)\n"
+          "  --waveshaper table|analytic          (default table)\n"
+          "  --antialiasing off|adaa1|adaa2       (default off)\n"
+          "  --envelope-link max|channel|grouped  (default max)\n"
+          "  --preset <file>       key = value lines with the option names\n"
+          "                        above; later command line options win\n"
+          "  -o, --out-dir <dir>   write <dir>/<name>.wav\n"
+          "  -j <n>                files rendered in parallel\n"
+          "                        (default: hardware threads)\n");
+}
+
+bool ParseDouble(const std::string& text, double& value) {
+  char* end = nullptr;
+  value = strtod(text.c_str(), &end);
+  return !text.empty() && end && *end == '\0';
+}
+
+// Applies one named setting; false with error set if it is invalid
+bool ApplySetting(RenderSettings& settings, const std::string& name,
+                  const std::string& value, std::string& error) {
+  for (const NumericOption& option : kNumericOptions) {
+    if (name != option.name)
+      continue;
+    double v;
+    if (!ParseDouble(value, v) || v < option.min || v > option.max) {
+      char range[64];
+      snprintf(range, sizeof(range), " must be a number from %g to %g",
+               option.min, option.max);
+      error = name + range;
+      return false;
+    }
+    settings.*option.value = v;
+    if (name == "output")
+      settings.outputSet = true;
+    return true;
+  }
+
+  if (name == "link") {
+    if (value != "on" && value != "off") {
+      error = "link must be on or off";
+      return false;
+    }
+    settings.linkGain = value == "on";
+    return true;
+  }
+
+  if (name == "oversampling") {
+    static const std::map<std::string, int> stages = {
+        {"off", 0}, {"2x", 1}, {"4x", 2}, {"8x", 3}};
+    auto it = stages.find(value);
+    if (it == stages.end()) {
+      error = "oversampling must be off, 2x, 4x or 8x";
+      return false;
+    }
+    settings.oversamplingStages = it->second;
+    return true;
+  }
+
+  if (name == "envelope-link") {
+    static const std::map<std::string, ToastEngine::EnvelopeLink> links = {
+        {"max", ToastEngine::kLinkMax},
+        {"channel", ToastEngine::kLinkPerChannel},
+        {"grouped", ToastEngine::kLinkGrouped}};
+    auto it = links.find(value);
+    if (it == links.end()) {
+      error = "envelope-link must be max, channel or grouped";
+      return false;
+    }
+    settings.envelopeLink = it->second;
+    return true;
+  }
+
+  if (name == "os-filter") {
+    if (value != "min" && value != "linear") {
+      error = "os-filter must be min or linear";
+      return false;
+    }
+    settings.oversamplingFilter =
+        value == "min" ? kMinimumPhaseIIR : kLinearPhaseFIR;
+    return true;
+  }
+
+  if (name == "model") {
+    if (value != "classic" && value != "magnetic") {
+      error = "model must be classic or magnetic";
+      return false;
+    }
+    settings.model = value == "classic" ? kTHDClassic : kTHDMagnetic;
+    return true;
+  }
+
+  if (name == "waveshaper") {
+    if (value != "table" && value != "analytic") {
+      error = "waveshaper must be table or analytic";
+      return false;
+    }
+    settings.waveshaper =
+        value == "table" ? kWaveshaperTable : kWaveshaperAnalytic;
+    return true;
+  }
+
+  if (name == "antialiasing") {
+    static const std::map<std::string, Antialiasing> modes = {
+        {"off", kAntialiasingOff},
+        {"adaa1", kADAAFirstOrder},
+        {"adaa2", kADAASecondOrder}};
+    auto it = modes.find(value);
+    if (it == modes.end()) {
+      error = "antialiasing must be off, adaa1 or adaa2";
+      return false;
+    }
+    settings.antialiasing = it->second;
+    return true;
+  }
+
+  error = "unknown setting " + name;
+  return false;
+}
+
+std::string Trim(const std::string& text) {
+  const size_t begin = text.find_first_not_of(" \t\r");
+  if (begin == std::string::npos)
+    return "";
+  const size_t end = text.find_last_not_of(" \t\r");
+  return text.substr(begin, end - begin + 1);
+}
+
+bool LoadPreset(RenderSettings& settings, const std::string& path,
+                std::string& error) {
+  std::ifstream file(path);
+  if (!file) {
+    error = "cannot open preset " + path;
+    return false;
+  }
+
+  std::string line;
+  for (int lineNumber = 1; std::getline(file, line); lineNumber++) {
+    line = Trim(line.substr(0, line.find('#')));
+    if (line.empty())
+      continue;
+    const size_t equals = line.find('=');
+    if (equals == std::string::npos ||
+        !ApplySetting(settings, Trim(line.substr(0, equals)),
+                      Trim(line.substr(equals + 1)), error)) {
+      if (equals == std::string::npos)
+        error = "expected key = value";
+      error = path + ":" + std::to_string(lineNumber) + ": " + error;
+      return false;
+    }
+  }
+  return true;
+}
+
+bool ParseArguments(int argc, char** argv, Options& options,
+                    std::string& error) {
+  // The preset is loaded first so the command line overrides it
+  for (int i = 1; i < argc - 1; i++) {
+    if (std::string(argv[i]) == "--preset" &&
+        !LoadPreset(options.settings, argv[++i], error))
+      return false;
+  }
+
+  for (int i = 1; i < argc; i++) {
+    const std::string arg = argv[i];
+    if (arg.size() < 2 || arg[0] != '-') {
+      options.files.push_back(arg);
+      continue;
+    }
+    if (i + 1 >= argc) {
+      error = arg + " needs a value";
+      return false;
+    }
+    const std::string value = argv[++i];
+
+    if (arg == "--preset")
+      continue;
+    if (arg == "-o" || arg == "--out-dir") {
+      options.outDir = value;
+    } else if (arg == "-j") {
+      options.numThreads = atoi(value.c_str());
+      if (options.numThreads < 1) {
+        error = "-j must be at least 1";
+        return false;
+      }
+    } else if (arg.compare(0, 2, "--") != 0 ||
+               !ApplySetting(options.settings, arg.substr(2), value, error)) {
+      if (error.empty())
+        error = "unknown option " + arg;
+      return false;
+    }
+  }
+
+  const RenderSettings& settings = options.settings;
+  if (settings.linkGain && settings.outputSet) {
+    error = "output is set by input while linked; use --link off";
+    return false;
+  }
+  if (options.files.empty()) {
+    error = "no input files";
+    return false;
+  }
+  return true;
+}
+
+std::string OutputPath(const std::string& input, const std::string& outDir) {
+  const size_t slash = input.find_last_of("/\\");
+  const size_t nameStart = slash == std::string::npos ? 0 : slash + 1;
+  size_t dot = input.find_last_of('.');
+  if (dot == std::string::npos || dot < nameStart)
+    dot = input.size();
+
+  if (!outDir.empty()) {
+    std::string dir = outDir;
+    if (dir.back() != '/' && dir.back() != '\\')
+      dir += '/';
+    return dir + input.substr(nameStart, dot - nameStart) + ".wav";
+  }
+  return input.substr(0, dot) + ".toast.wav";
+}
+
+void ConfigureEngine(ToastEngine& engine, const RenderSettings& settings,
+                     double sampleRate, int numChannels) {
+  ToastEngine::ParamSnapshot targets;
+  targets.driveDB = settings.inputDB;
+  targets.outputDB = settings.linkGain ? -settings.inputDB : settings.outputDB;
+  targets.thdAmount = settings.driveAmount / 100.0;
+  targets.dynamics = settings.dynamics / 100.0;
+  targets.mix = settings.mix / 100.0;
+
+  engine.SetParamTargets(targets);
+  engine.SetOversampling(settings.oversamplingStages,
+                         settings.oversamplingFilter);
+  engine.SetModel(settings.model);
+  engine.SetWaveshaper(settings.waveshaper);
+  engine.SetAntialiasing(settings.antialiasing);
+  engine.SetThreshold(settings.thresholdDB);
+  engine.SetAttack(settings.attackMs);
+  engine.SetRelease(settings.releaseMs);
+  engine.SetCurve(settings.curve / 100.0);
+  engine.SetLookahead(settings.lookaheadMs);
+  engine.SetEnvelopeLink(settings.envelopeLink);
+  // The ends of the ranges switch the filters off, as in the plugin
+  engine.SetDetectorFilters(
+      settings.detectorHighPassHz > 20.0 ? settings.detectorHighPassHz : 0.0,
+      settings.detectorLowPassHz < 20000.0 ? settings.detectorLowPassHz : 0.0);
+  engine.Reset(sampleRate, numChannels);
+}
+
+struct RenderResult {
+  double audioSeconds = 0.0;
+  double wallSeconds = 0.0;
+  std::string error;
+};
+
+RenderResult RenderFile(const std::string& inputPath,
+                        const std::string& outputPath,
+                        const RenderSettings& settings) {
+  RenderResult result;
+  const auto startTime = std::chrono::steady_clock::now();
+
+  WavReader reader;
+  if (!reader.Open(inputPath)) {
+    result.error = reader.GetError();
+    return result;
+  }
+  const WavFormat format = reader.GetFormat();
+  if (format.numChannels > kMaxChannels) {
+    result.error = "more than 16 channels are not supported";
+    return result;
+  }
+
+  WavWriter writer;
+  if (!writer.Open(outputPath, format)) {
+    result.error = outputPath + ": " + writer.GetError();
+    return result;
+  }
+
+  ToastEngine engine;
+  ConfigureEngine(engine, settings, format.sampleRate, format.numChannels);
+
+  std::vector<double> buffer((size_t)format.numChannels * kRenderBlockSize);
+  double* channels[kMaxChannels];
+  for (int c = 0; c < format.numChannels; c++)
+    channels[c] = buffer.data() + (size_t)c * kRenderBlockSize;
+
+  // The first latency frames out of the engine precede the input; drop
+  // them and flush as many frames of silence at the end
+  int framesToSkip = engine.GetLatency();
+  int flushFrames = framesToSkip;
+  bool ok = true;
+
+  for (;;) {
+    int frames = reader.Read(channels, kRenderBlockSize);
+    if (frames == 0) {
+      frames = std::min(flushFrames, kRenderBlockSize);
+      if (frames == 0)
+        break;
+      flushFrames -= frames;
+      for (int c = 0; c < format.numChannels; c++)
+        std::fill(channels[c], channels[c] + frames, 0.0);
+    }
+
+    engine.ProcessBlock(channels, channels, format.numChannels, frames);
+
+    const int skip = std::min(framesToSkip, frames);
+    framesToSkip -= skip;
+    const double* outputs[kMaxChannels];
+    for (int c = 0; c < format.numChannels; c++)
+      outputs[c] = channels[c] + skip;
+    if (!writer.Write(outputs, frames - skip)) {
+      ok = false;
+      break;
+    }
+  }
+
+  if (!writer.Close() || !ok) {
+    result.error = outputPath + ": " + writer.GetError();
+    return result;
+  }
+
+  result.audioSeconds = (double)reader.GetNumFrames() / format.sampleRate;
+  result.wallSeconds = std::chrono::duration<double>(
+                           std::chrono::steady_clock::now() - startTime)
+                           .count();
+  return result;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  Options options;
+  std::string error;
+  if (argc < 2 || std::string(argv[1]) == "-h" ||
+      std::string(argv[1]) == "--help") {
+    PrintUsage();
+    return argc < 2 ? 1 : 0;
+  }
+  if (!ParseArguments(argc, argv, options, error)) {
+    fprintf(stderr, "toast-render: %s\n", error.c_str());
+    return 1;
+  }
+
+  const int numFiles = (int)options.files.size();
+  int numThreads = options.numThreads;
+  if (numThreads == 0)
+    numThreads = std::max(1, (int)std::thread::hardware_concurrency());
+  numThreads = std::min(numThreads, numFiles);
+
+  std::atomic<int> nextFile{0};
+  std::mutex printMutex;
+  double totalAudioSeconds = 0.0;
+  int numFailed = 0;
+
+  const auto startTime = std::chrono::steady_clock::now();
+
+  auto worker = [&]() {
+    for (int i = nextFile++; i < numFiles; i = nextFile++) {
+      const std::string& input = options.files[i];
+      const std::string output = OutputPath(input, options.outDir);
+      const RenderResult result = RenderFile(input, output, options.settings);
+
+      std::lock_guard<std::mutex> lock(printMutex);
+      if (!result.error.empty()) {
+        fprintf(stderr, "%s: %s\n", input.c_str(), result.error.c_str());
+        numFailed++;
+        continue;
+      }
+      totalAudioSeconds += result.audioSeconds;
+      printf("%s -> %s  %.1f s  %.1fx realtime\n", input.c_str(),
+             output.c_str(), result.audioSeconds,
+             result.audioSeconds / std::max(result.wallSeconds, 1e-9));
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (int t = 1; t < numThreads; t++)
+    threads.emplace_back(worker);
+  worker();
+  for (std::thread& thread : threads)
+    thread.join();
+
+  const double wallSeconds =
+      std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                    startTime)
+          .count();
+  printf("%d file(s), %.1f s of audio in %.2f s on %d thread(s): "
+         "%.1fx realtime\n",
+         numFiles - numFailed, totalAudioSeconds, wallSeconds, numThreads,
+         totalAudioSeconds / std::max(wallSeconds, 1e-9));
+
+  return numFailed > 0 ? 1 : 0;
+}
@@ -18,7 +18,8 @@
 #ifdef APP_API
 #define PLUG_CHANNEL_IO "1-2"
 #else
-#define PLUG_CHANNEL_IO "1-1 2-2"
+// 2.2: stereo sidechain for the dynamics; 6 - 16: 5.1 up to 9.1.6 beds
+#define PLUG_CHANNEL_IO "1-1 2-2 2.2-2 6-6 8-8 10-10 12-12 16-16"
 #endif
 
 #define PLUG_LATENCY 0
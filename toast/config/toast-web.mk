@@ -5,6 +5,8 @@ IPLUG2_ROOT = ../../iPlug2
 include ../../iPlug2/common-web.mk
 
 SRC += $(PROJECT_ROOT)/toast.cpp
+SRC += $(PROJECT_ROOT)/ToastEngine.cpp
+SRC += $(PROJECT_ROOT)/THD.cpp
 
 # WAM_SRC +=
 
@@ -0,0 +1,1044 @@
+// ToastTests.cpp
+//
+// Regression checks for the DSP: block processing against the per-sample
+// path, StereoTHD against two TransformerTHDs, block-size invariance of the
+// engine, its output stage against a stage-by-stage reference, the FastMath
+// error bounds, latency reporting, the ADAA alias floor, the float THD and
+// envelope follower against the double ones, the cost and the end of an
+// impulse's tail, and golden renders of both THD models. Prints one line per
+// check and exits non-zero if any fails.
+//
+//   toast-tests [--filter <text>] [--list] [--golden <dir>] [--write-golden]
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <complex>
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "EnvelopeFollower.h"
+#include "FastMath.h"
+#include "LoadMonitor.h"
+#include "Oversampling.h"
+#include "THD.h"
+#include "ToastEngine.h"
+#include "cli/WavFile.h"
+
+namespace {
+
+using Sample = ToastEngine::Sample;
+
+// The plugin's fixed THD character
+constexpr float kWarmth = 1.0f;
+constexpr float kAsymmetry = 0.75f;
+constexpr float kHysteresis = 0.75f;
+
+const THDModel kModels[] = {kTHDClassic, kTHDMagnetic};
+const Antialiasing kAntialiasingModes[] = {kAntialiasingOff, kADAAFirstOrder,
+                                           kADAASecondOrder};
+const WaveshaperMode kWaveshapers[] = {kWaveshaperAnalytic, kWaveshaperTable};
+
+// Set by a failing check, reported with its name
+std::string gFailure;
+
+#if defined(__GNUC__)
+__attribute__((format(printf, 1, 2)))
+#endif
+bool Fail(const char* format, ...) {
+  char message[256];
+  va_list args;
+  va_start(args, format);
+  vsnprintf(message, sizeof(message), format, args);
+  va_end(args);
+  gFailure = message;
+  return false;
+}
+
+// Tone bursts over a low sine and a little noise, different per channel:
+// drives the THD and the envelope through attack and release
+template <typename T>
+std::vector<T> MakeProgram(int numFrames, double sampleRate, int channel) {
+  std::vector<T> buffer(numFrames);
+  uint32_t seed = 0x9e3779b9u + channel;
+  for (int i = 0; i < numFrames; i++) {
+    seed = seed * 1664525u + 1013904223u;
+    const double noise = (double)(seed >> 8) / (double)(1 << 24) - 0.5;
+    const double t = (double)i / sampleRate;
+    const double gate = std::fmod(t * 4.0 + 0.25 * channel, 1.0) < 0.5 ? 1.0 : 0.1;
+    buffer[i] = (T)(0.7 * gate * std::sin(2.0 * M_PI * 220.0 * t + channel) +
+                    0.2 * std::sin(2.0 * M_PI * 55.0 * t) + 0.01 * noise);
+  }
+  return buffer;
+}
+
+template <typename THD> void SetCharacter(THD& thd, double sampleRate) {
+  thd.Initialize((Sample)sampleRate);
+  thd.SetWarmth(kWarmth);
+  thd.SetAsymmetry(kAsymmetry);
+  thd.SetHysteresis(kHysteresis);
+}
+
+// ==========================================
+// THD
+// ==========================================
+
+// ProcessBlock, with and without per-sample amounts, against ProcessSample
+bool TransformerBlockMatchesSamples() {
+  const double sampleRate = 48000.0;
+  const int numFrames = 4000;
+  const std::vector<Sample> input = MakeProgram<Sample>(numFrames, sampleRate, 0);
+
+  for (THDModel model : kModels) {
+    for (Antialiasing antialiasing : kAntialiasingModes) {
+      for (WaveshaperMode waveshaper : kWaveshapers) {
+        TransformerTHD<Sample> perSample, block, modulated;
+        for (TransformerTHD<Sample>* thd : {&perSample, &block, &modulated}) {
+          SetCharacter(*thd, sampleRate);
+          thd->SetModel(model);
+          thd->SetAntialiasing(antialiasing);
+          thd->SetWaveshaper(waveshaper);
+          thd->SetTHDAmount((Sample)0.6);
+          thd->Reset();
+        }
+
+        std::vector<Sample> expected(numFrames), output(numFrames);
+        for (int i = 0; i < numFrames; i++)
+          expected[i] = perSample.ProcessSample(input[i]);
+
+        // Uneven blocks, so the state has to carry across them
+        for (int start = 0, size = 1; start < numFrames; start += size, size = size * 3 + 1)
+          block.ProcessBlock(input.data() + start, output.data() + start,
+                             std::min(size, numFrames - start));
+        for (int i = 0; i < numFrames; i++) {
+          if (output[i] != expected[i])
+            return Fail("model %d, antialiasing %d: frame %d differs", (int)model,
+                        (int)antialiasing, i);
+        }
+
+        const std::vector<Sample> amounts(numFrames, (Sample)0.6);
+        modulated.ProcessBlock(input.data(), output.data(), amounts.data(), numFrames);
+        for (int i = 0; i < numFrames; i++) {
+          if (std::abs(output[i] - expected[i]) > 1e-6)
+            return Fail("per-sample amounts, model %d: frame %d off by %g",
+                        (int)model, i, (double)std::abs(output[i] - expected[i]));
+        }
+      }
+    }
+  }
+  return true;
+}
+
+// Each SIMD lane of StereoTHD against its own TransformerTHD
+bool StereoMatchesTwoMono() {
+  const double sampleRate = 44100.0;
+  const int numFrames = 4000;
+  std::vector<Sample> input[2], expected[2], output[2];
+  for (int c = 0; c < 2; c++) {
+    input[c] = MakeProgram<Sample>(numFrames, sampleRate, c);
+    expected[c].resize(numFrames);
+    output[c].resize(numFrames);
+  }
+  std::vector<Sample> amounts(numFrames);
+  for (int i = 0; i < numFrames; i++)
+    amounts[i] = (Sample)(0.3 + 0.6 * i / numFrames);
+
+  for (THDModel model : kModels) {
+    for (Antialiasing antialiasing : kAntialiasingModes) {
+      for (WaveshaperMode waveshaper : kWaveshapers) {
+        StereoTHD<Sample> stereo;
+        SetCharacter(stereo, sampleRate);
+        stereo.SetModel(model);
+        stereo.SetAntialiasing(antialiasing);
+        stereo.SetWaveshaper(waveshaper);
+        stereo.SetTHDAmount(amounts[0]);
+        stereo.Reset();
+        const Sample* inputs[2] = {input[0].data(), input[1].data()};
+        Sample* outputs[2] = {output[0].data(), output[1].data()};
+        stereo.ProcessBlock(inputs, outputs, 2, amounts.data(), numFrames);
+
+        for (int c = 0; c < 2; c++) {
+          TransformerTHD<Sample> mono;
+          SetCharacter(mono, sampleRate);
+          mono.SetModel(model);
+          mono.SetAntialiasing(antialiasing);
+          mono.SetWaveshaper(waveshaper);
+          mono.SetTHDAmount(amounts[0]);
+          mono.Reset();
+          mono.ProcessBlock(input[c].data(), expected[c].data(), amounts.data(), numFrames);
+          for (int i = 0; i < numFrames; i++) {
+            if (output[c][i] != expected[c][i])
+              return Fail("model %d, antialiasing %d: frame %d differs",
+                          (int)model, (int)antialiasing, i);
+          }
+        }
+      }
+    }
+  }
+  return true;
+}
+
+// The tanh table within its stated bound of the exact curve
+bool WaveshaperTableMatchesAnalytic() {
+  const double sampleRate = 48000.0;
+  const int numFrames = 8000;
+  std::vector<Sample> input = MakeProgram<Sample>(numFrames, sampleRate, 0);
+  for (Sample& x : input)
+    x *= 4; // Well into the limiter
+
+  for (THDModel model : kModels) {
+    std::vector<Sample> output[2];
+    for (int w = 0; w < 2; w++) {
+      TransformerTHD<Sample> thd;
+      SetCharacter(thd, sampleRate);
+      thd.SetModel(model);
+      thd.SetWaveshaper(kWaveshapers[w]);
+      thd.SetTHDAmount(1);
+      thd.Reset();
+      output[w].resize(numFrames);
+      thd.ProcessBlock(input.data(), output[w].data(), numFrames);
+    }
+    for (int i = 0; i < numFrames; i++) {
+      // 1e-8 in the curve, plus float rounding in the float build
+      if (std::abs(output[0][i] - output[1][i]) > 1e-6)
+        return Fail("model %d: frame %d off by %g", (int)model, i,
+                    (double)std::abs(output[0][i] - output[1][i]));
+    }
+  }
+  return true;
+}
+
+// Non-harmonic energy relative to the fundamental, in dB, for a full-scale
+// sine of frequency Hz through StereoTHD at 44.1 kHz. Integer cycles in a
+// second, so every harmonic and every alias falls on its own 1 Hz bin.
+double AliasFloorDb(int numStages, Antialiasing antialiasing, int frequency) {
+  const int sampleRate = 44100;
+  StereoTHD<Sample> thd;
+  SetCharacter(thd, sampleRate);
+  thd.SetOversampling(numStages, kLinearPhaseFIR);
+  thd.SetAntialiasing(antialiasing);
+  thd.SetTHDAmount(1);
+  thd.Reset();
+
+  std::vector<Sample> input(2 * sampleRate), output(2 * sampleRate);
+  for (int i = 0; i < 2 * sampleRate; i++)
+    input[i] = (Sample)(0.9 * std::sin(2.0 * M_PI * frequency * i / sampleRate));
+  const Sample* inputs[2] = {input.data(), input.data()};
+  Sample* outputs[2] = {output.data(), output.data()};
+  thd.ProcessBlock(inputs, outputs, 1, 2 * sampleRate);
+
+  // The second second, after the DC blocker has settled
+  auto binPower = [&](int bin) {
+    std::complex<double> sum = 0.0;
+    for (int i = 0; i < sampleRate; i++)
+      sum += (double)output[sampleRate + i] *
+             std::polar(1.0, -2.0 * M_PI * bin * i / sampleRate);
+    return std::norm(sum) * 2.0 / ((double)sampleRate * sampleRate);
+  };
+  double total = 0.0;
+  for (int i = 0; i < sampleRate; i++)
+    total += (double)output[sampleRate + i] * output[sampleRate + i];
+  total /= sampleRate;
+
+  double harmonics = binPower(0) / 2.0;
+  for (int bin = frequency; bin < sampleRate / 2; bin += frequency)
+    harmonics += binPower(bin);
+  return 10.0 * std::log10(std::max(total - harmonics, 1e-30) / binPower(frequency));
+}
+
+// The highest alias floor over tones from 1 to 18 kHz
+double WorstAliasFloorDb(int numStages, Antialiasing antialiasing) {
+  double worst = -300.0;
+  for (int frequency : {1000, 3000, 5000, 8000, 11000, 14000, 18000})
+    worst = std::max(worst, AliasFloorDb(numStages, antialiasing, frequency));
+  return worst;
+}
+
+// ADAA lowers the aliases, second order more than first, at every tone
+bool AntialiasingLowersAliases() {
+  const double off = WorstAliasFloorDb(0, kAntialiasingOff);
+  const double adaa1 = WorstAliasFloorDb(0, kADAAFirstOrder);
+  const double adaa2 = WorstAliasFloorDb(0, kADAASecondOrder);
+  const double oversampled2x = WorstAliasFloorDb(1, kAntialiasingOff);
+  const double oversampled4x = WorstAliasFloorDb(2, kAntialiasingOff);
+  printf("    worst alias floor, 1 - 18 kHz: off %.1f dB, adaa1 %.1f, adaa2 %.1f, "
+         "2x %.1f, 4x %.1f\n", off, adaa1, adaa2, oversampled2x, oversampled4x);
+  if (adaa1 > off - 6.0)
+    return Fail("adaa1 %g dB against %g dB off", adaa1, off);
+  if (adaa2 > adaa1 - 6.0)
+    return Fail("adaa2 %g dB against %g dB for adaa1", adaa2, adaa1);
+  if (oversampled2x > off - 6.0)
+    return Fail("2x %g dB against %g dB off", oversampled2x, off);
+  if (oversampled4x > oversampled2x - 6.0)
+    return Fail("4x %g dB against %g dB for 2x", oversampled4x, oversampled2x);
+  return true;
+}
+
+// The float signal path against the double reference, in one binary: the
+// THD in every model and antialiasing mode, at 1x and 4x, and the envelope
+// follower in every mode, all within the -90 dBFS peak difference the
+// float build is held to (see ToastEngine::Sample)
+constexpr double kPrecisionNullTolerance = 3.1622777e-5; // -90 dBFS
+
+template <typename T>
+std::vector<double> RenderTHDIn(THDModel model, Antialiasing antialiasing, int numStages,
+                                OversamplingFilter filter, const std::vector<double> (&input)[2],
+                                const std::vector<double>& amounts) {
+  const int numFrames = (int)amounts.size();
+  std::vector<T> in[2], out[2];
+  std::vector<T> amountsIn(amounts.begin(), amounts.end());
+  for (int c = 0; c < 2; c++) {
+    in[c].assign(input[c].begin(), input[c].end());
+    out[c].resize(numFrames);
+  }
+  StereoTHD<T> thd;
+  thd.Initialize((T)48000);
+  thd.SetWarmth(kWarmth);
+  thd.SetAsymmetry(kAsymmetry);
+  thd.SetHysteresis(kHysteresis);
+  thd.SetModel(model);
+  thd.SetAntialiasing(antialiasing);
+  thd.SetOversampling(numStages, filter);
+  thd.SetTHDAmount(amountsIn[0]);
+  thd.Reset();
+  const T* inputs[2] = {in[0].data(), in[1].data()};
+  T* outputs[2] = {out[0].data(), out[1].data()};
+  thd.ProcessBlock(inputs, outputs, 2, amountsIn.data(), numFrames);
+
+  std::vector<double> output(out[0].begin(), out[0].end());
+  output.insert(output.end(), out[1].begin(), out[1].end());
+  return output;
+}
+
+template <typename T>
+std::vector<double> RenderEnvelopeIn(typename EnvelopeFollower<T>::Mode mode,
+                                     const std::vector<double> (&input)[2]) {
+  const int numFrames = (int)input[0].size();
+  EnvelopeFollower<T> follower;
+  follower.Initialize((T)48000);
+  follower.SetMode(mode);
+  follower.SetSensitivity(0);
+  follower.SetAttack(1);
+  follower.SetRelease(120);
+  follower.SetSmoothing(1);
+  follower.SetCurve((T)0.5);
+  follower.SetAmount(1);
+  follower.Reset();
+  std::vector<T> envelope(numFrames);
+  const double* inputs[2] = {input[0].data(), input[1].data()};
+  for (int start = 0; start < numFrames; start += 512) {
+    const double* block[2] = {inputs[0] + start, inputs[1] + start};
+    follower.ProcessBlock(block, 2, envelope.data() + start, std::min(512, numFrames - start));
+  }
+  return std::vector<double>(envelope.begin(), envelope.end());
+}
+
+double PeakDifference(const std::vector<double>& a, const std::vector<double>& b) {
+  double peak = 0.0;
+  for (size_t i = 0; i < a.size(); i++)
+    peak = std::max(peak, std::abs(a[i] - b[i]));
+  return peak;
+}
+
+bool FloatNullsAgainstDouble() {
+  const int numFrames = 48000;
+  std::vector<double> input[2];
+  for (int c = 0; c < 2; c++) {
+    input[c] = MakeProgram<double>(numFrames, 48000.0, c);
+    for (double& x : input[c])
+      x *= 2.0; // +6 dB of drive
+  }
+  // Amounts sweeping 0.2 - 1 and back, as the envelope modulates them
+  std::vector<double> amounts(numFrames);
+  for (int i = 0; i < numFrames; i++)
+    amounts[i] = 0.6 - 0.4 * std::cos(2.0 * M_PI * 3.0 * i / numFrames);
+
+  double worst = 0.0;
+  for (THDModel model : kModels) {
+    for (Antialiasing antialiasing : kAntialiasingModes) {
+      for (int numStages : {0, 2}) {
+        for (OversamplingFilter filter : {kMinimumPhaseIIR, kLinearPhaseFIR}) {
+          if (numStages == 0 && filter == kLinearPhaseFIR)
+            continue;
+          const double peak = PeakDifference(
+              RenderTHDIn<float>(model, antialiasing, numStages, filter, input, amounts),
+              RenderTHDIn<double>(model, antialiasing, numStages, filter, input, amounts));
+          worst = std::max(worst, peak);
+          if (peak > kPrecisionNullTolerance)
+            return Fail("model %d, antialiasing %d, %d stages, filter %d: %.1f dBFS",
+                        (int)model, (int)antialiasing, numStages, (int)filter,
+                        20.0 * std::log10(peak));
+        }
+      }
+    }
+  }
+  printf("    THD: worst %.1f dBFS\n", 20.0 * std::log10(worst));
+
+  worst = 0.0;
+  for (int mode = EnvelopeFollower<float>::PEAK; mode <= EnvelopeFollower<float>::VACTROL; mode++) {
+    const double peak = PeakDifference(
+        RenderEnvelopeIn<float>((EnvelopeFollower<float>::Mode)mode, input),
+        RenderEnvelopeIn<double>((EnvelopeFollower<double>::Mode)mode, input));
+    worst = std::max(worst, peak);
+    if (peak > kPrecisionNullTolerance)
+      return Fail("envelope mode %d: %.1f dBFS", mode, 20.0 * std::log10(peak));
+  }
+  printf("    envelope: worst %.1f dBFS\n", 20.0 * std::log10(std::max(worst, 1e-30)));
+  return true;
+}
+
+// ==========================================
+// FastMath
+// ==========================================
+
+// The maximum errors stated in FastMath.h, over its stated ranges
+bool FastMathWithinBounds() {
+  double dbToAmp = 0.0, ampToDb = 0.0, pow = 0.0;
+  for (int i = 0; i <= 144000; i++) {
+    const float dB = -120.0f + (float)i * 0.001f;
+    const double exact = std::pow(10.0, dB / 20.0);
+    dbToAmp = std::max(dbToAmp, std::abs(20.0 * std::log10(FastDBToAmp(dB) / exact)));
+  }
+  for (int i = 0; i <= 200000; i++) {
+    const float amp = (float)std::pow(10.0, -6.0 + 7.2 * i / 200000.0); // 1e-6 - 16
+    ampToDb = std::max(ampToDb, std::abs(FastAmpToDB(amp) - 20.0 * std::log10((double)amp)));
+  }
+  for (int i = 0; i <= 1000; i++) {
+    const float x = (float)i / 1000.0f;
+    for (int j = 0; j <= 20; j++) {
+      const float y = 1.0f + (float)j * 0.01f;
+      pow = std::max(pow, std::abs(FastPow(x, y) - std::pow((double)x, (double)y)));
+    }
+  }
+  printf("    max error: FastDBToAmp %.2g dB, FastAmpToDB %.2g dB, FastPow %.2g\n",
+         dbToAmp, ampToDb, pow);
+  if (dbToAmp >= 5e-4)
+    return Fail("FastDBToAmp off by %g dB", dbToAmp);
+  if (ampToDb >= 2e-4)
+    return Fail("FastAmpToDB off by %g dB", ampToDb);
+  if (pow >= 5e-5)
+    return Fail("FastPow off by %g", pow);
+  return true;
+}
+
+// ==========================================
+// Latency
+// ==========================================
+
+// An impulse through the oversampling filters alone: the linear-phase FIR
+// peaks exactly at its latency, and the IIR's low-frequency group delay
+// (the impulse response's centroid) rounds to its latency
+bool OversamplerLatencyMatchesImpulse() {
+  for (OversamplingFilter filter : {kMinimumPhaseIIR, kLinearPhaseFIR}) {
+    for (int numStages = 1; numStages <= 3; numStages++) {
+      Oversampler<double> oversampler;
+      oversampler.Setup(numStages, filter);
+      auto identity = [](double x) { return x; };
+      int peak = 0;
+      double peakValue = 0.0, moment = 0.0, sum = 0.0;
+      for (int i = 0; i < 1024; i++) {
+        const double y = oversampler.Process(i == 0 ? 1.0 : 0.0, identity);
+        if (std::abs(y) > peakValue) {
+          peakValue = std::abs(y);
+          peak = i;
+        }
+        moment += i * y;
+        sum += y;
+      }
+      const int latency = oversampler.GetLatency();
+      if (filter == kLinearPhaseFIR && peak != latency)
+        return Fail("FIR %d stages: peak at %d, latency %d", numStages, peak, latency);
+      if (filter == kMinimumPhaseIIR && std::lround(moment / sum) != latency)
+        return Fail("IIR %d stages: group delay %g, latency %d", numStages,
+                    moment / sum, latency);
+    }
+  }
+  return true;
+}
+
+// With the bypass fade over, the output is the input delayed by exactly
+// the reported latency, for every latency source. The program stops for
+// longer than the tail in the middle, leaving only a signal below the
+// silence threshold, which true bypass passes on as well.
+bool BypassDelayMatchesLatency() {
+  const double sampleRate = 48000.0;
+  const int numFrames = 40000;
+  std::vector<double> input = MakeProgram<double>(numFrames, sampleRate, 0);
+  for (int i = 8000; i < 32000; i++)
+    input[i] = (i & 1) ? 1e-10 : -1e-10;
+
+  for (int numStages = 0; numStages <= 3; numStages++) {
+    for (OversamplingFilter filter : {kMinimumPhaseIIR, kLinearPhaseFIR}) {
+      for (Antialiasing antialiasing : kAntialiasingModes) {
+        for (double lookaheadMs : {0.0, 2.5}) {
+          ToastEngine engine;
+          engine.SetOversampling(numStages, filter);
+          engine.SetAntialiasing(antialiasing);
+          engine.SetLookahead(lookaheadMs);
+          engine.SetBypassed(true);
+          engine.Reset(sampleRate, 1);
+          const int latency = engine.GetLatency();
+
+          std::vector<double> output(numFrames);
+          for (int start = 0; start < numFrames; start += 256) {
+            double* in[1] = {const_cast<double*>(input.data()) + start};
+            double* out[1] = {output.data() + start};
+            engine.ProcessBlock(in, out, 1, std::min(256, numFrames - start));
+          }
+          // Past the first fade (5 ms) and the delays
+          for (int i = 1000; i < numFrames; i++) {
+            if (output[i] != input[i - latency])
+              return Fail("%d stages, lookahead %g ms: frame %d is not the "
+                          "delayed input",
+                          numStages, lookaheadMs, i);
+          }
+        }
+      }
+    }
+  }
+  return true;
+}
+
+// ==========================================
+// Engine
+// ==========================================
+
+struct RenderSettings {
+  int numChannels = 2;
+  double thdAmount = 0.7;
+  double dynamics = 0.0;
+  double mix = 1.0;
+  int numStages = 0;
+  OversamplingFilter filter = kMinimumPhaseIIR;
+  double lookaheadMs = 0.0;
+  ToastEngine::EnvelopeLink link = ToastEngine::kLinkMax;
+  THDModel model = kTHDClassic;
+};
+
+// The program through the engine in blocks of the given sizes, in turn
+std::vector<std::vector<double>> Render(const RenderSettings& settings,
+                                        const std::vector<int>& blockSizes,
+                                        int numFrames, double sampleRate = 48000.0) {
+  ToastEngine engine;
+  ToastEngine::ParamSnapshot targets;
+  targets.thdAmount = settings.thdAmount;
+  targets.dynamics = settings.dynamics;
+  targets.mix = settings.mix;
+  engine.SetParamTargets(targets);
+  engine.SetOversampling(settings.numStages, settings.filter);
+  engine.SetLookahead(settings.lookaheadMs);
+  engine.SetEnvelopeLink(settings.link);
+  engine.SetModel(settings.model);
+  engine.Reset(sampleRate, settings.numChannels);
+
+  std::vector<std::vector<double>> channels(settings.numChannels);
+  for (int c = 0; c < settings.numChannels; c++)
+    channels[c] = MakeProgram<double>(numFrames, sampleRate, c);
+
+  double* buffers[ToastEngine::kMaxChannels];
+  for (int start = 0, block = 0; start < numFrames; block++) {
+    const int frames = std::min(blockSizes[block % blockSizes.size()], numFrames - start);
+    for (int c = 0; c < settings.numChannels; c++)
+      buffers[c] = channels[c].data() + start;
+    engine.ProcessBlock(buffers, buffers, settings.numChannels, frames);
+    start += frames;
+  }
+  return channels;
+}
+
+// Irregular host blocks give the same output as regular ones: single
+// frames, sizes either side of 4096, and a 65536-frame block, all
+// running through the engine's chunk loop and scratch buffers
+bool EngineInvariantToBlockSize() {
+  RenderSettings settings[4];
+  settings[1].dynamics = 0.6;
+  settings[2].dynamics = -0.5;
+  settings[2].mix = 0.6;
+  settings[2].numStages = 2;
+  settings[2].lookaheadMs = 1.5;
+  settings[3].numChannels = 6;
+  settings[3].dynamics = 0.8;
+  settings[3].numStages = 1;
+  settings[3].filter = kLinearPhaseFIR;
+  settings[3].link = ToastEngine::kLinkGrouped;
+
+  // Enough for every size once
+  const std::vector<int> blockSizes = {1, 3, 17, 64, 500, 4095, 4096, 4097, 65536, 7};
+  const int numFrames = 80000;
+  for (const RenderSettings& s : settings) {
+    const auto regular = Render(s, {512}, numFrames);
+    const auto irregular = Render(s, blockSizes, numFrames);
+    for (int c = 0; c < s.numChannels; c++) {
+      for (int i = 0; i < numFrames; i++) {
+        // Denormal flushing at block ends may move the last bits of
+        // near-silent samples
+        if (std::abs(regular[c][i] - irregular[c][i]) > 1e-12)
+          return Fail("channel %d, frame %d off by %g", c, i,
+                      std::abs(regular[c][i] - irregular[c][i]));
+      }
+    }
+  }
+  return true;
+}
+
+// The smoothed gain the engine runs on: the fast approximation in the
+// float build, exact in the double build (as ToastEngine.cpp)
+Sample SmoothedGain(double dB) {
+  if constexpr (std::is_same<Sample, double>::value) {
+    return std::pow(10.0, dB / 20.0);
+  } else {
+    return FastDBToAmp((float)dB);
+  }
+}
+
+// The fused output loop of ProcessFrames against the stages run one pass
+// at a time over each host block: the smoothed gains, the THD, output
+// gain, dry / wet mix, the DC blocker and the bypass crossfade. Host blocks
+// of 1 - 1024 frames and random parameter targets, some settling before
+// the next; a bypass fade reversed after 100 frames, and one run out into
+// true bypass. The reference repeats the engine's arithmetic in the same
+// order, so the two null to within rounding (a compiler may contract
+// either into fused multiply-adds differently).
+constexpr double kOutputStageTolerance = 8 * 1.1920929e-7; // Float epsilons
+
+bool OutputStageMatchesReference() {
+  const double sampleRate = 48000.0;
+  const int numFrames = 96000;
+  const int fadeSamples = 240; // 5 ms
+  // As in ToastEngine: the output DC blocker's pole, the smoothing times,
+  // the settle threshold and the THD modulation interval
+  const Sample dcPole = (Sample)0.995;
+  const double gainSmoothingMs = 50.0;
+  const double paramSmoothingMs = 30.0;
+  const double settleThreshold = 1e-6;
+  const int modulationInterval = 16;
+
+  // Bypass on, reversed mid-fade, and on again for the rest; host blocks
+  // are split at these frames
+  const int bypassOnFrame = 30000;
+  const int bypassOffFrame = 30100;
+  const int bypassEndFrame = 90000;
+
+  struct HostBlock {
+    int start;
+    int frames;
+    ToastEngine::ParamSnapshot targets;
+    bool bypassed;
+  };
+  std::vector<HostBlock> blocks;
+  uint32_t seed = 0x2545f491u;
+  auto random = [&seed]() {
+    seed = seed * 1664525u + 1013904223u;
+    return (double)(seed >> 8) / (double)(1 << 24);
+  };
+  ToastEngine::ParamSnapshot initialTargets;
+  initialTargets.thdAmount = 0.5;
+  initialTargets.mix = 0.8;
+  ToastEngine::ParamSnapshot targets = initialTargets;
+  for (int start = 0; start < numFrames;) {
+    // New targets about every 8000 frames
+    if (random() < 1.0 / 16.0) {
+      targets.driveDB = -6.0 + 24.0 * random();
+      targets.outputDB = -12.0 + 18.0 * random();
+      targets.thdAmount = random();
+      targets.mix = random();
+    }
+    int end = std::min(start + 1 + (int)(random() * 1024.0), numFrames);
+    for (int event : {bypassOnFrame, bypassOffFrame, bypassEndFrame}) {
+      if (start < event && end > event)
+        end = event;
+    }
+    const bool bypassed = (start >= bypassOnFrame && start < bypassOffFrame) || start >= bypassEndFrame;
+    blocks.push_back({start, end - start, targets, bypassed});
+    start = end;
+  }
+
+  std::vector<double> input[2], output[2];
+  for (int c = 0; c < 2; c++) {
+    input[c] = MakeProgram<double>(numFrames, sampleRate, c);
+    output[c] = input[c];
+  }
+
+  ToastEngine engine;
+  engine.SetParamTargets(initialTargets);
+  engine.SetBypassFade(5.0, ToastEngine::kBypassRaisedCosine);
+  engine.Reset(sampleRate, 2);
+  for (const HostBlock& block : blocks) {
+    engine.SetParamTargets(block.targets);
+    engine.SetBypassed(block.bypassed);
+    double* buffers[2] = {output[0].data() + block.start, output[1].data() + block.start};
+    engine.ProcessBlock(buffers, buffers, 2, block.frames);
+  }
+
+  // The reference, from the same starting state as the engine after Reset
+  StereoTHD<Sample> thd;
+  SetCharacter(thd, sampleRate);
+  thd.SetTHDAmount((Sample)initialTargets.thdAmount);
+  thd.Reset();
+  iplug::LogParamSmooth<double> driveSmooth(gainSmoothingMs, initialTargets.driveDB);
+  iplug::LogParamSmooth<double> outputSmooth(gainSmoothingMs, initialTargets.outputDB);
+  iplug::LogParamSmooth<double> thdAmountSmooth(paramSmoothingMs, initialTargets.thdAmount);
+  iplug::LogParamSmooth<double> mixSmooth(paramSmoothingMs, initialTargets.mix);
+  driveSmooth.SetSmoothTime(gainSmoothingMs, sampleRate);
+  outputSmooth.SetSmoothTime(gainSmoothingMs, sampleRate);
+  thdAmountSmooth.SetSmoothTime(paramSmoothingMs, sampleRate);
+  mixSmooth.SetSmoothTime(paramSmoothingMs, sampleRate);
+  ToastEngine::ParamSnapshot params = initialTargets, smoothed = initialTargets;
+  bool settled = true;
+  std::vector<Sample> fadeTable(fadeSamples + 1);
+  for (int i = 0; i <= fadeSamples; i++)
+    fadeTable[i] = (Sample)(0.5 * (1.0 - std::cos(M_PI * i / fadeSamples)));
+  bool bypassState = false, fading = false;
+  int fadeCounter = 0;
+  Sample modulatedAmount = (Sample)initialTargets.thdAmount;
+  Sample modulationFrom = 0, modulationTo = 0;
+  int modulationPhase = 0;
+  Sample dcInput[2] = {}, dcOutput[2] = {};
+
+  std::vector<double> expected[2] = {input[0], input[1]};
+  for (const HostBlock& block : blocks) {
+    const int n = block.frames;
+    if (!(block.targets == params)) {
+      params = block.targets;
+      settled = false;
+    }
+    if (block.bypassed != bypassState) {
+      bypassState = block.bypassed;
+      fadeCounter = fading ? fadeSamples - fadeCounter : 0;
+      fading = true;
+    }
+    // True bypass passes the input on; the render ends in it
+    if (bypassState && !fading)
+      continue;
+
+    // Gains and the THD amount, per frame
+    std::vector<Sample> driveGains(n), thdBaseAmounts(n), outputGains(n), dryGains(n), wetGains(n);
+    for (int i = 0; i < n; i++) {
+      if (!settled) {
+        smoothed.driveDB = driveSmooth.Process(params.driveDB);
+        smoothed.outputDB = outputSmooth.Process(params.outputDB);
+        smoothed.thdAmount = thdAmountSmooth.Process(params.thdAmount);
+        smoothed.mix = mixSmooth.Process(params.mix);
+      }
+      driveGains[i] = settled ? (Sample)std::pow(10.0, params.driveDB / 20.0) : SmoothedGain(smoothed.driveDB);
+      outputGains[i] = settled ? (Sample)std::pow(10.0, params.outputDB / 20.0) : SmoothedGain(smoothed.outputDB);
+      thdBaseAmounts[i] = (Sample)smoothed.thdAmount;
+      dryGains[i] = (Sample)(1.0 - smoothed.mix);
+      wetGains[i] = (Sample)smoothed.mix;
+    }
+
+    // The amount ramped between control points (no dynamics)
+    std::vector<Sample> thdAmounts(n);
+    for (int i = 0; i < n; i++) {
+      if (modulationPhase == 0) {
+        modulationFrom = modulatedAmount;
+        modulationTo = std::max(Sample(0), std::min(thdBaseAmounts[i], Sample(1)));
+      }
+      const Sample step = (modulationTo - modulationFrom) / (Sample)modulationInterval;
+      thdAmounts[i] = modulationFrom + step * (Sample)(++modulationPhase);
+      if (modulationPhase == modulationInterval) {
+        thdAmounts[i] = modulationTo;
+        modulationPhase = 0;
+      }
+      modulatedAmount = thdAmounts[i];
+    }
+
+    // Drive and the THD
+    std::vector<Sample> dry[2], wet[2];
+    for (int c = 0; c < 2; c++) {
+      dry[c].resize(n);
+      wet[c].resize(n);
+      for (int i = 0; i < n; i++) {
+        dry[c][i] = (Sample)input[c][block.start + i];
+        wet[c][i] = dry[c][i] * driveGains[i];
+      }
+    }
+    const Sample* thdInputs[2] = {wet[0].data(), wet[1].data()};
+    Sample* thdOutputs[2] = {wet[0].data(), wet[1].data()};
+    thd.ProcessBlock(thdInputs, thdOutputs, 2, thdAmounts.data(), n);
+
+    // Bypass shares, the same for both channels
+    std::vector<Sample> processedShares(n), dryShares(n);
+    for (int i = 0; i < n; i++) {
+      Sample fadeIn = bypassState ? 0 : 1;
+      Sample fadeOut = bypassState ? 1 : 0;
+      if (fading && fadeCounter < fadeSamples) {
+        fadeIn = fadeTable[fadeCounter];
+        fadeOut = fadeTable[fadeSamples - fadeCounter];
+        fadeCounter++;
+        if (bypassState)
+          std::swap(fadeIn, fadeOut);
+      }
+      processedShares[i] = fadeIn;
+      dryShares[i] = fadeOut;
+    }
+    if (fadeCounter >= fadeSamples)
+      fading = false;
+
+    // Output gain, mix, DC blocker and crossfade, one stage at a time
+    for (int c = 0; c < 2; c++) {
+      std::vector<Sample> stage(n);
+      for (int i = 0; i < n; i++)
+        stage[i] = wet[c][i] * outputGains[i];
+      for (int i = 0; i < n; i++)
+        stage[i] = (dry[c][i] * dryGains[i]) + (stage[i] * wetGains[i]);
+      for (int i = 0; i < n; i++) {
+        const Sample mixed = stage[i];
+        stage[i] = mixed - dcInput[c] + dcPole * dcOutput[c];
+        dcInput[c] = mixed;
+        dcOutput[c] = stage[i];
+      }
+      for (int i = 0; i < n; i++)
+        expected[c][block.start + i] = stage[i] * processedShares[i] + dry[c][i] * dryShares[i];
+    }
+
+    if (!settled && std::abs(smoothed.driveDB - params.driveDB) < settleThreshold &&
+        std::abs(smoothed.outputDB - params.outputDB) < settleThreshold &&
+        std::abs(smoothed.thdAmount - params.thdAmount) < settleThreshold &&
+        std::abs(smoothed.mix - params.mix) < settleThreshold) {
+      driveSmooth.SetValue(params.driveDB);
+      outputSmooth.SetValue(params.outputDB);
+      thdAmountSmooth.SetValue(params.thdAmount);
+      mixSmooth.SetValue(params.mix);
+      smoothed = params;
+      settled = true;
+    }
+  }
+
+  for (int c = 0; c < 2; c++) {
+    for (int i = 0; i < numFrames; i++) {
+      if (std::abs(output[c][i] - expected[c][i]) > kOutputStageTolerance)
+        return Fail("channel %d, frame %d off by %g", c, i, std::abs(output[c][i] - expected[c][i]));
+    }
+  }
+  return true;
+}
+
+// Half a second of the program, then an impulse and silence while the
+// engine is still inside its tail (a long release keeps it processing).
+// The filters decay through the denormal range; flushing keeps every
+// block of the tail within LoadMonitor's spike ratio of the median cost of
+// a program block, and the output and the follower states reach exactly
+// zero rather than lingering as denormals.
+bool ImpulseDecayStaysCheap() {
+  const double sampleRate = 48000.0;
+  const int blockSize = 512;
+  const int numProgramBlocks = 24000 / blockSize;
+  const int numTailBlocks = 640; // 6.8 s, the modulation ending at 6 s
+  const int numBlocks = numProgramBlocks + numTailBlocks;
+  const int numPasses = 3;
+  const std::vector<double> program[2] = {
+      MakeProgram<double>(numProgramBlocks * blockSize, sampleRate, 0),
+      MakeProgram<double>(numProgramBlocks * blockSize, sampleRate, 1)};
+
+  // Per block, the fastest of the passes: preemption only adds time
+  std::vector<double> blockNanos(numBlocks, 1e30);
+  std::vector<double> left(blockSize), right(blockSize);
+  for (int pass = 0; pass < numPasses; pass++) {
+    ToastEngine engine;
+    ToastEngine::ParamSnapshot targets;
+    targets.thdAmount = 0.7;
+    targets.dynamics = 0.5;
+    engine.SetParamTargets(targets);
+    engine.SetOversampling(2, kMinimumPhaseIIR);
+    engine.SetRelease(1000.0);
+    engine.SetThreshold(-60.0);
+    engine.Reset(sampleRate, 2);
+    if (engine.GetTailSamples() <= numTailBlocks * blockSize)
+      return Fail("tail of %d frames ends before the silence", engine.GetTailSamples());
+
+    for (int b = 0; b < numBlocks; b++) {
+      if (b < numProgramBlocks) {
+        std::copy_n(program[0].begin() + b * blockSize, blockSize, left.begin());
+        std::copy_n(program[1].begin() + b * blockSize, blockSize, right.begin());
+      } else {
+        std::fill(left.begin(), left.end(), 0.0);
+        std::fill(right.begin(), right.end(), 0.0);
+        if (b == numProgramBlocks)
+          left[0] = right[0] = 1.0;
+      }
+      double* buffers[2] = {left.data(), right.data()};
+      const auto begin = std::chrono::steady_clock::now();
+      engine.ProcessBlock(buffers, buffers, 2, blockSize);
+      const auto end = std::chrono::steady_clock::now();
+      blockNanos[b] = std::min(blockNanos[b],
+                               (double)std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count());
+    }
+    for (int i = 0; i < blockSize; i++) {
+      if (left[i] != 0.0 || right[i] != 0.0)
+        return Fail("output %g after %.1f s of silence", std::max(std::abs(left[i]), std::abs(right[i])),
+                    numTailBlocks * blockSize / sampleRate);
+    }
+  }
+
+  // Against the program blocks after the first
+  std::vector<double> sorted(blockNanos.begin() + 1, blockNanos.begin() + numProgramBlocks);
+  std::nth_element(sorted.begin(), sorted.begin() + sorted.size() / 2, sorted.end());
+  const double median = sorted[sorted.size() / 2];
+  double worst = 0.0;
+  for (int b = numProgramBlocks; b < numBlocks; b++) {
+    if (blockNanos[b] > LoadMonitor::kSpikeRatio * median)
+      return Fail("tail block %d took %.0f ns, program median %.0f ns",
+                  b - numProgramBlocks, blockNanos[b], median);
+    worst = std::max(worst, blockNanos[b]);
+  }
+  printf("    program blocks: median %.1f us; tail blocks: worst %.1f us\n",
+         median * 0.001, worst * 0.001);
+
+  // The engine's followers are private: one with its default settings,
+  // on its own
+  EnvelopeFollower<Sample> follower;
+  follower.Initialize((Sample)sampleRate);
+  follower.SetMode(EnvelopeFollower<Sample>::RMS);
+  follower.SetSensitivity(1);
+  follower.SetAttack(1);
+  follower.SetRelease(120);
+  follower.SetSmoothing(1);
+  follower.SetCurve((Sample)0.5);
+  follower.SetAmount(1);
+  follower.Reset();
+  std::vector<Sample> input(blockSize), envelope(blockSize);
+  const Sample* inputs[1] = {input.data()};
+  for (int b = 0; b < numTailBlocks; b++) {
+    input[0] = b == 0 ? 1 : 0;
+    follower.ProcessBlock(inputs, 1, envelope.data(), blockSize);
+  }
+  if (follower.GetEnvelope() != 0)
+    return Fail("envelope %g after %.1f s of silence", (double)follower.GetEnvelope(),
+                numTailBlocks * blockSize / sampleRate);
+  return true;
+}
+
+// Golden renders: --drive 70 --dynamics 40 on the test program, stereo at
+// 48 kHz, one cycle of its bursts. Every frame is checked against the
+// reference recorded from the same precision (golden/<model>_<precision>.wav,
+// 32-bit float), the peak and RMS difference within a few float epsilons:
+// enough for another compiler's contractions, not for a change of sound.
+// --write-golden records new references after an intended change.
+constexpr int kGoldenFrames = 12000;
+constexpr double kGoldenPeakTolerance = 32 * 1.1920929e-7;
+constexpr double kGoldenRmsTolerance = 2 * 1.1920929e-7;
+
+std::string gGoldenDir = "golden";
+bool gWriteGolden = false;
+
+bool CheckGolden(THDModel model, const char* name) {
+  RenderSettings settings;
+  settings.thdAmount = 0.7;
+  settings.dynamics = 0.4;
+  settings.model = model;
+  const auto output = Render(settings, {512}, kGoldenFrames);
+
+  const std::string path = gGoldenDir + "/" + name +
+                           (std::is_same<Sample, double>::value ? "_double.wav" : "_float.wav");
+  if (gWriteGolden) {
+    WavFormat format;
+    format.numChannels = 2;
+    format.sampleRate = 48000;
+    format.bitsPerSample = 32;
+    format.isFloat = true;
+    WavWriter writer;
+    const double* channels[2] = {output[0].data(), output[1].data()};
+    if (!writer.Open(path, format) || !writer.Write(channels, kGoldenFrames) ||
+        !writer.Close())
+      return Fail("%s: %s", path.c_str(), writer.GetError().c_str());
+    printf("    wrote %s\n", path.c_str());
+    return true;
+  }
+
+  WavReader reader;
+  if (!reader.Open(path))
+    return Fail("%s", reader.GetError().c_str());
+  if (reader.GetFormat().numChannels != 2 || reader.GetNumFrames() != (uint64_t)kGoldenFrames)
+    return Fail("%s is not a %d-frame stereo render", path.c_str(), kGoldenFrames);
+  std::vector<double> golden[2] = {std::vector<double>(kGoldenFrames),
+                                   std::vector<double>(kGoldenFrames)};
+  double* channels[2] = {golden[0].data(), golden[1].data()};
+  if (reader.Read(channels, kGoldenFrames) != kGoldenFrames)
+    return Fail("%s: %s", path.c_str(), reader.GetError().c_str());
+
+  for (int c = 0; c < 2; c++) {
+    double peak = 0.0, sumOfSquares = 0.0;
+    int peakFrame = 0;
+    for (int i = 0; i < kGoldenFrames; i++) {
+      const double difference = std::abs(output[c][i] - golden[c][i]);
+      sumOfSquares += difference * difference;
+      if (difference > peak) {
+        peak = difference;
+        peakFrame = i;
+      }
+    }
+    const double rms = std::sqrt(sumOfSquares / kGoldenFrames);
+    if (peak > kGoldenPeakTolerance || rms > kGoldenRmsTolerance)
+      return Fail("channel %d: peak difference %.3g at frame %d, RMS %.3g", c,
+                  peak, peakFrame, rms);
+  }
+  return true;
+}
+
+bool GoldenClassic() { return CheckGolden(kTHDClassic, "classic"); }
+bool GoldenMagnetic() { return CheckGolden(kTHDMagnetic, "magnetic"); }
+
+struct Test {
+  const char* name;
+  bool (*run)();
+};
+
+const Test kTests[] = {
+    {"thd/transformer_block_matches_samples", TransformerBlockMatchesSamples},
+    {"thd/stereo_matches_two_mono", StereoMatchesTwoMono},
+    {"thd/table_matches_analytic", WaveshaperTableMatchesAnalytic},
+    {"thd/antialiasing_lowers_aliases", AntialiasingLowersAliases},
+    {"precision/float_nulls_against_double", FloatNullsAgainstDouble},
+    {"fastmath/error_bounds", FastMathWithinBounds},
+    {"latency/oversampler_impulse", OversamplerLatencyMatchesImpulse},
+    {"latency/bypass_delay", BypassDelayMatchesLatency},
+    {"engine/block_size_invariance", EngineInvariantToBlockSize},
+    {"engine/output_stage_matches_reference", OutputStageMatchesReference},
+    {"engine/impulse_decay", ImpulseDecayStaysCheap},
+    {"engine/golden_classic", GoldenClassic},
+    {"engine/golden_magnetic", GoldenMagnetic},
+};
+
+} // namespace
+
+int main(int argc, char** argv) {
+  std::string filter;
+  for (int i = 1; i < argc; i++) {
+    const std::string arg = argv[i];
+    if (arg == "--list") {
+      for (const Test& test : kTests)
+        printf("%s\n", test.name);
+      return 0;
+    } else if (arg == "--filter" && i + 1 < argc) {
+      filter = argv[++i];
+    } else if (arg == "--golden" && i + 1 < argc) {
+      gGoldenDir = argv[++i];
+    } else if (arg == "--write-golden") {
+      gWriteGolden = true;
+    } else {
+      fprintf(stderr, "usage: toast-tests [--filter <text>] [--list] "
+                      "[--golden <dir>] [--write-golden]\n");
+      return 1;
+    }
+  }
+
+  int numRun = 0, numFailed = 0;
+  for (const Test& test : kTests) {
+    if (std::string(test.name).find(filter) == std::string::npos)
+      continue;
+    gFailure.clear();
+    const bool passed = test.run();
+    printf("%s %s%s%s\n", passed ? "PASS" : "FAIL", test.name,
+           passed ? "" : ": ", gFailure.c_str());
+    numRun++;
+    numFailed += passed ? 0 : 1;
+  }
+  printf("%d of %d passed\n", numRun - numFailed, numRun);
+  return numFailed > 0 ? 1 : 0;
+}
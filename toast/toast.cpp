@@ -15,6 +15,20 @@ toast::toast(const InstanceInfo& info)
     GetParam(kParamMix)->InitDouble("Mix", 100.0, 0.0, 100.0, 0.1, "%");
     GetParam(kParamOutput)->InitDouble("Output", 0.0, -12.0, 12.0, 0.1, "dB");
     GetParam(kParamLinkGain)->InitBool("Link", true);
+    GetParam(kParamOversampling)->InitEnum("Oversampling", 0, {"Off", "2x", "4x", "8x"});
+    GetParam(kParamOversamplingFilter)->InitEnum("OS Filter", 0, {"Min Phase", "Linear Phase"});
+    GetParam(kParamLookahead)->InitDouble("Lookahead", 0.0, 0.0, ToastEngine::kMaxLookaheadMs, 0.1, "ms");
+    GetParam(kParamSidechain)->InitBool("Sidechain", false);
+    GetParam(kParamDetectorHPF)->InitFrequency("Detector HPF", 20.0, 20.0, 2000.0, 1.0);    // Off at 20 Hz
+    GetParam(kParamDetectorLPF)->InitFrequency("Detector LPF", 20000.0, 200.0, 20000.0, 1.0); // Off at 20 kHz
+    GetParam(kParamEnvelopeLink)->InitEnum("Envelope Link", ToastEngine::kLinkMax, {"Max", "Per Channel", "Grouped"});
+    GetParam(kParamBypassFade)->InitDouble("Bypass Fade", 5.0, ToastEngine::kMinBypassFadeMs,
+                                           ToastEngine::kMaxBypassFadeMs, 0.1, "ms");
+    GetParam(kParamBypassCurve)->InitEnum("Bypass Curve", ToastEngine::kBypassRaisedCosine,
+                                          {"Equal Power", "Linear", "Raised Cosine"});
+    GetParam(kParamAntialiasing)->InitEnum("Antialiasing", kAntialiasingOff, {"Off", "ADAA 1st", "ADAA 2nd"});
+    GetParam(kParamModel)->InitEnum("Model", kTHDClassic, {"Classic", "Magnetic"});
+    
 #ifdef DEBUG
   SetCustomUrlScheme("iplug2");
   SetEnableDevTools(true);
@@ -29,215 +43,100 @@ toast::toast(const InstanceInfo& info)
 
 void toast::ProcessBlock(sample** inputs, sample** outputs, int nFrames)
 {
-    const int nChans = NOutChansConnected();
-    
-    // Set THD parameters
-    leftTHD.SetWarmth(mWarmth);
-    leftTHD.SetAsymmetry(mAsymmetry);
-    leftTHD.SetHysteresis(mHysteresis);
-    
-    if (nChans >= 2) {
-        rightTHD.SetWarmth(mWarmth);
-        rightTHD.SetAsymmetry(mAsymmetry);
-        rightTHD.SetHysteresis(mHysteresis);
-    }
-    
-    // Buffers for processing
-    double processedBuffer[2][4096];
-    double dryBuffer[2][4096];
-    double* processedPtrs[2] = { processedBuffer[0], processedBuffer[1] };
+    mLoadMonitor.BeginBlock();
     
-    // Check if we should bypass (host bypass state)
-    bool shouldBypass = !mHostIsActive;
+    const int nChans = std::min(NOutChansConnected(), ToastEngine::kMaxChannels);
     
-    // Detect bypass state changes
-    if (shouldBypass != mBypassState) {
-        mBypassState = shouldBypass;
-        mBypassFading = true;
-        mBypassFadeCounter = 0;
+    // The meters show the front pair (the one channel for mono); the input
+    // is measured first, as the host may process in place
+    const bool metering = mMetering.load(std::memory_order_relaxed);
+    const int nMeterChans = std::min(nChans, 2);
+    if (metering) {
+        mMeter.AddInput(inputs, nMeterChans, nFrames);
     }
     
-    // Process each sample
-    for (int s = 0; s < nFrames; s++) {
-        // Get smoothed parameters
-        double targetDriveDB = GetParam(kParamDrive)->Value();
-        double targetOutputDB = GetParam(kParamOutput)->Value();
-        double targetTHDAmount = GetParam(kParamTHDAmount)->Value() / 100.0;
-        double targetDynamics = GetParam(kParamDynamics)->Value() / 100.0;
-        double targetMix = GetParam(kParamMix)->Value() / 100.0;
-        
-        double smoothedDriveDB = mDriveSmooth.Process(targetDriveDB);
-        double smoothedOutputDB = mOutputSmooth.Process(targetOutputDB);
-        double smoothedTHDAmount = mTHDAmountSmooth.Process(targetTHDAmount);
-        double smoothedDynamics = mDynamicsSmooth.Process(targetDynamics);
-        double smoothedMix = mMixSmooth.Process(targetMix);
-        
-        double smoothedDriveGain = std::pow(10.0, smoothedDriveDB / 20.0);
-        double smoothedOutputGain = std::pow(10.0, smoothedOutputDB / 20.0);
-        double smoothedDryGain = 1.0 - smoothedMix;
-        double smoothedWetGain = smoothedMix;
-        
-        // Get envelope
-        float rawEnvelope = 0.0f;
-        if (nChans >= 2) {
-            rawEnvelope = mEnvelopeFollower.ProcessStereo(inputs[0][s], inputs[1][s]);
-        } else if (nChans >= 1) {
-            rawEnvelope = mEnvelopeFollower.ProcessSample(inputs[0][s]);
-        }
-        
-        // Calculate modulation
-        float envelopeDb = -120.0f;
-        if (rawEnvelope > 0.000001f) {
-            envelopeDb = 20.0f * std::log10(rawEnvelope);
-        }
-        
-        float thresholdedEnvelope = 0.0f;
-        if (envelopeDb > mThresholdDb) {
-            float headroom = 0.0f - (float)mThresholdDb;
-            float aboveThreshold = envelopeDb - (float)mThresholdDb;
-            thresholdedEnvelope = std::min(1.0f, aboveThreshold / headroom);
+    // The sidechain bus follows the stereo main bus: inputs 2 and 3 (one
+    // channel in AAX)
+    sample* sidechain[2] = {};
+    int nSidechainChans = 0;
+    if (mUseSidechain.load(std::memory_order_relaxed) && nChans == 2) {
+        for (int c = 2; c < 4 && IsChannelConnected(ERoute::kInput, c); c++) {
+            sidechain[nSidechainChans++] = inputs[c];
         }
-        
-        float modulatedThd = (float)smoothedTHDAmount;
-        float modulation = thresholdedEnvelope * (float)smoothedDynamics;
-        modulatedThd = std::max(0.0f, std::min(modulatedThd + modulation, 1.0f));
-        
-        leftTHD.SetTHDAmount(modulatedThd);
-        if (nChans >= 2) {
-            rightTHD.SetTHDAmount(modulatedThd);
-        }
-        
-        // Process left channel
-        if (nChans >= 1) {
-            double input = inputs[0][s];
-            dryBuffer[0][s] = input;
-            
-            // Always process to keep THD warm
-            double driven = input * smoothedDriveGain;
-            double processed = leftTHD.ProcessSample(driven);
-            double wet = processed * smoothedOutputGain;
-            double mixed = (input * smoothedDryGain) + (wet * smoothedWetGain);
-            processedBuffer[0][s] = mixed;
-        }
-        
-        // Process right channel
-        if (nChans >= 2) {
-            double input = inputs[1][s];
-            dryBuffer[1][s] = input;
-            
-            double driven = input * smoothedDriveGain;
-            double processed = rightTHD.ProcessSample(driven);
-            double wet = processed * smoothedOutputGain;
-            double mixed = (input * smoothedDryGain) + (wet * smoothedWetGain);
-            processedBuffer[1][s] = mixed;
-        }
-        
-        mEnvelopeValue = thresholdedEnvelope;
-        mModulatedTHDAmount = modulatedThd;
     }
     
-    // Apply DC blocking to processed signal
-    mDCBlocker.ProcessBlock(processedPtrs, processedPtrs, nChans, nFrames);
-    
-    // Output with bypass crossfade
-    for (int c = 0; c < nChans; c++) {
-        for (int s = 0; s < nFrames; s++) {
-            if (mBypassFading && mBypassFadeCounter < kBypassFadeSamples) {
-                double fadeProgress = (double)mBypassFadeCounter / (double)kBypassFadeSamples;
-                double fadeCurve = 0.5 * (1.0 - std::cos(M_PI * fadeProgress));
-                
-                if (mBypassState) {
-                    // Fading to bypass
-                    outputs[c][s] = processedBuffer[c][s] * (1.0 - fadeCurve) + dryBuffer[c][s] * fadeCurve;
-                } else {
-                    // Fading to active
-                    outputs[c][s] = dryBuffer[c][s] * (1.0 - fadeCurve) + processedBuffer[c][s] * fadeCurve;
-                }
-                
-                if (c == 0) mBypassFadeCounter++;
-                if (mBypassFadeCounter >= kBypassFadeSamples) mBypassFading = false;
-            } else {
-                outputs[c][s] = mBypassState ? dryBuffer[c][s] : processedBuffer[c][s];
-            }
-        }
-    }
+    // Soft bypass (VST3 kIsBypass and the like) fades like deactivation
+    mEngine.SetBypassed(GetBypassed());
+    mEngine.ProcessBlock(inputs, outputs, nChans, nFrames, sidechain, nSidechainChans);
     
-    // Pass through      additional channels
+    // Pass through additional channels
     for (int c = nChans; c < NOutChansConnected(); c++) {
         for (int s = 0; s < nFrames; s++) {
             outputs[c][s] = (c < NInChansConnected()) ? inputs[c][s] : 0.0;
         }
     }
-    mSender.ProcessBlock(outputs, nFrames, kCtrlTagMeter);
+    MeterFrame frame;
+    if (metering) {
+        mMeter.AddOutput(outputs, nMeterChans, nFrames);
+        if (mMeter.EndBlock(nFrames, (float)mEngine.GetEnvelopeActivity(),
+                            (float)mEngine.GetModulatedTHDAmount(), frame)) {
+            mMeterQueue.Push(frame);
+        }
+    }
+    
+    ISenderData<kNumLoadStats> load;
+    if (mLoadMonitor.EndBlock(nFrames, load.vals.data())) {
+        load.ctrlTag = kCtrlTagLoad;
+        mLoadSender.PushData(load);
+    }
 }
 
 void toast::OnReset()
 {
-    // Initialize THD processors
-    leftTHD.Initialize(GetSampleRate());
-    rightTHD.Initialize(GetSampleRate());
-    
-    // Warm up processors
-    for (int i = 0; i < 512; i++) {
-        leftTHD.ProcessSample(0.0);
-        rightTHD.ProcessSample(0.0);
-    }
-    
-    // Configure envelope follower
-    mEnvelopeFollower.Initialize(GetSampleRate());
-    mEnvelopeFollower.SetMode(EnvelopeFollower::RMS);
-    mEnvelopeFollower.SetSensitivity(1.0f);
-    mEnvelopeFollower.SetAttack(mAttackMs);
-    mEnvelopeFollower.SetRelease(mReleaseMs);
-    mEnvelopeFollower.SetSmoothing(1.0f);
-    mEnvelopeFollower.SetCurve(mCurveValue);
-    mEnvelopeFollower.SetAmount(1.0f);
-    mEnvelopeFollower.Reset();
-    
-    // Initialize smoothers
-    const double gainSmoothingMs = 50.0;
-    const double paramSmoothingMs = 30.0;
-    
-    double initialDriveDB = GetParam(kParamDrive)->Value();
-    double initialOutputDB = GetParam(kParamOutput)->Value();
-    double initialTHDAmount = GetParam(kParamTHDAmount)->Value() / 100.0;
-    double initialDynamics = GetParam(kParamDynamics)->Value() / 100.0;
-    double initialMix = GetParam(kParamMix)->Value() / 100.0;
-    
-    mDriveSmooth = LogParamSmooth<double>(gainSmoothingMs, initialDriveDB);
-    mDriveSmooth.SetSmoothTime(gainSmoothingMs, GetSampleRate());
-    mDriveSmooth.SetValue(initialDriveDB);
-    
-    mOutputSmooth = LogParamSmooth<double>(gainSmoothingMs, initialOutputDB);
-    mOutputSmooth.SetSmoothTime(gainSmoothingMs, GetSampleRate());
-    mOutputSmooth.SetValue(initialOutputDB);
-    
-    mTHDAmountSmooth = LogParamSmooth<double>(paramSmoothingMs, initialTHDAmount);
-    mTHDAmountSmooth.SetSmoothTime(paramSmoothingMs, GetSampleRate());
-    mTHDAmountSmooth.SetValue(initialTHDAmount);
-    
-    mDynamicsSmooth = LogParamSmooth<double>(paramSmoothingMs, initialDynamics);
-    mDynamicsSmooth.SetSmoothTime(paramSmoothingMs, GetSampleRate());
-    mDynamicsSmooth.SetValue(initialDynamics);
-    
-    mMixSmooth = LogParamSmooth<double>(paramSmoothingMs, initialMix);
-    mMixSmooth.SetSmoothTime(paramSmoothingMs, GetSampleRate());
-    mMixSmooth.SetValue(initialMix);
-    
-    // Reset state
-    mEnvelopeValue = 0.0f;
-    mModulatedTHDAmount = (float)initialTHDAmount;
-    mDryGain = 1.0 - initialMix;
-    mWetGain = initialMix;
-    
-    mBypassState = false;
-    mBypassFading = false;
-    mBypassFadeCounter = 0;
-    mHostIsActive = true;
+    mEngine.SetOversampling(GetParam(kParamOversampling)->Int(),
+                            (OversamplingFilter)GetParam(kParamOversamplingFilter)->Int());
+    mEngine.SetLookahead(GetParam(kParamLookahead)->Value());
+    mEngine.SetEnvelopeLink((ToastEngine::EnvelopeLink)GetParam(kParamEnvelopeLink)->Int());
+    mEngine.SetAntialiasing((Antialiasing)GetParam(kParamAntialiasing)->Int());
+    mEngine.SetModel((THDModel)GetParam(kParamModel)->Int());
+    mLoadMonitor.SetSampleRate(GetSampleRate(), 1.0 / PLUG_FPS);
+    mMeter.Reset(GetSampleRate(), 1.0 / PLUG_FPS);
+    PublishDetectorFilters();
+    PublishBypassFade();
+    PublishParamTargets();
+    mEngine.Reset(GetSampleRate(), std::min(NOutChansConnected(), ToastEngine::kMaxChannels));
+    SetLatency(mEngine.GetLatency());
+    SetTailSize(mEngine.GetTailSamples());
+}
+
+void toast::PublishParamTargets()
+{
+    ToastEngine::ParamSnapshot targets;
+    targets.driveDB = GetParam(kParamDrive)->Value();
+    targets.outputDB = GetParam(kParamOutput)->Value();
+    targets.thdAmount = GetParam(kParamTHDAmount)->Value() / 100.0;
+    targets.dynamics = GetParam(kParamDynamics)->Value() / 100.0;
+    targets.mix = GetParam(kParamMix)->Value() / 100.0;
+    mEngine.SetParamTargets(targets);
+}
+
+void toast::PublishDetectorFilters()
+{
+    // The ends of the ranges switch the filters off
+    const IParam* highPass = GetParam(kParamDetectorHPF);
+    const IParam* lowPass = GetParam(kParamDetectorLPF);
+    mEngine.SetDetectorFilters(highPass->Value() > highPass->GetMin() ? highPass->Value() : 0.0,
+                               lowPass->Value() < lowPass->GetMax() ? lowPass->Value() : 0.0);
+}
+
+void toast::PublishBypassFade()
+{
+    mEngine.SetBypassFade(GetParam(kParamBypassFade)->Value(),
+                          (ToastEngine::BypassCurve)GetParam(kParamBypassCurve)->Int());
 }
 
 void toast::OnActivate(bool active){
-    mHostIsActive = active;
+    mEngine.SetActive(active);
 }
 
 void toast::OnParamChange(int paramIdx){
@@ -256,22 +155,21 @@ void toast::OnParamChange(int paramIdx){
         break;
         
         case kParamThreshold:
-            mThresholdDb = GetParam(kParamThreshold)->Value();
+            mEngine.SetThreshold(GetParam(kParamThreshold)->Value());
+            SetTailSize(mEngine.GetTailSamples());
             break;
         
         case kParamAttack:
-            mAttackMs = GetParam(kParamAttack)->Value();
-            mEnvelopeFollower.SetAttack(mAttackMs);
+            mEngine.SetAttack(GetParam(kParamAttack)->Value());
             break;
         
         case kParamRelease:
-            mReleaseMs = GetParam(kParamRelease)->Value();
-            mEnvelopeFollower.SetRelease(mReleaseMs);
+            mEngine.SetRelease(GetParam(kParamRelease)->Value());
+            SetTailSize(mEngine.GetTailSamples());
             break;
         
         case kParamCurve:
-            mCurveValue = GetParam(kParamCurve)->Value() / 100.0;
-            mEnvelopeFollower.SetCurve(mCurveValue);
+            mEngine.SetCurve(GetParam(kParamCurve)->Value() / 100.0);
             break;
         
         case kParamOutput:
@@ -307,12 +205,112 @@ void toast::OnParamChange(int paramIdx){
         }
         break;
         
+        case kParamOversampling:
+        case kParamOversamplingFilter:
+        {
+            // The engine picks up the new setting; report its latency now
+            int numStages = GetParam(kParamOversampling)->Int();
+            auto filter = (OversamplingFilter)GetParam(kParamOversamplingFilter)->Int();
+            mEngine.SetOversampling(numStages, filter);
+            SetLatency(mEngine.GetLatency());
+            SetTailSize(mEngine.GetTailSamples());
+        }
+        break;
+        
+        case kParamLookahead:
+            // Wet and dry are both delayed, so the host compensates the whole
+            // lookahead
+            mEngine.SetLookahead(GetParam(kParamLookahead)->Value());
+            SetLatency(mEngine.GetLatency());
+            SetTailSize(mEngine.GetTailSamples());
+            break;
+        
+        case kParamSidechain:
+            mUseSidechain.store(GetParam(kParamSidechain)->Bool(), std::memory_order_relaxed);
+            break;
+        
+        case kParamDetectorHPF:
+        case kParamDetectorLPF:
+            PublishDetectorFilters();
+            break;
+        
+        case kParamEnvelopeLink:
+            mEngine.SetEnvelopeLink((ToastEngine::EnvelopeLink)GetParam(kParamEnvelopeLink)->Int());
+            break;
+        
+        case kParamBypassFade:
+        case kParamBypassCurve:
+            PublishBypassFade();
+            break;
+        
+        case kParamAntialiasing:
+            // Second order delays the wet path by a sample
+            mEngine.SetAntialiasing((Antialiasing)GetParam(kParamAntialiasing)->Int());
+            SetLatency(mEngine.GetLatency());
+            SetTailSize(mEngine.GetTailSamples());
+            break;
+        
+        case kParamModel:
+            mEngine.SetModel((THDModel)GetParam(kParamModel)->Int());
+            break;
+        
         default:
             break;
     }
+    
+    // Linked gains are changed with Set() above, so publish every target
+    PublishParamTargets();
 }
 
 void toast::OnIdle()
 {
-  mSender.TransmitData(*this);
+    // The frames since the last call go out as one, in one binary message
+    MeterFrame frame;
+    MeterFrame merged;
+    int count = 0;
+    while (mMeterQueue.Pop(frame)) {
+        if (++count == 1) {
+            merged = frame;
+        } else {
+            MergeMeterFrames(merged, frame, count);
+        }
+    }
+    if (count > 0) {
+        SendArbitraryMsgFromDelegate(kMsgTagMeter, sizeof(MeterFrame), &merged);
+    }
+    
+    mLoadSender.TransmitData(*this);
+}
+
+bool toast::OnMessage(int msgTag, int ctrlTag, int dataSize, const void* pData)
+{
+    switch (msgTag) {
+        case kMsgTagLoadPanelOpened:
+            mLoadMonitor.SetEnabled(true);
+            return true;
+            
+        case kMsgTagLoadPanelClosed:
+            mLoadMonitor.SetEnabled(false);
+            return true;
+            
+        default:
+            return false;
+    }
+}
+
+void toast::OnUIOpen()
+{
+    // Frames left from when the editor was last open are stale
+    MeterFrame stale;
+    while (mMeterQueue.Pop(stale)) {
+    }
+    mMetering.store(true, std::memory_order_relaxed);
+}
+
+void toast::OnUIClose()
+{
+    mMetering.store(false, std::memory_order_relaxed);
+    
+    // The panel goes with the editor, without a message
+    mLoadMonitor.SetEnabled(false);
 }
@@ -1,12 +1,11 @@
 #pragma once
 
 #include "IPlug_include_in_plug_hdr.h"
-#include "Smoothers.h"
-#include "DCBlocker.h"
 #include "ISender.h"
 
-#include "THD.h"
-#include "EnvelopeFollower.h"
+#include "LoadMonitor.h"
+#include "Metering.h"
+#include "ToastEngine.h"
 
 using namespace iplug;
 
@@ -24,12 +23,31 @@ enum EParams
     kParamMix,
     kParamOutput,
     kParamLinkGain,
+    kParamOversampling,
+    kParamOversamplingFilter,
+    kParamLookahead,
+    kParamSidechain,
+    kParamDetectorHPF,
+    kParamDetectorLPF,
+    kParamEnvelopeLink,
+    kParamBypassFade,
+    kParamBypassCurve,
+    kParamAntialiasing,
+    kParamModel,
     kNumParams
 };
 
 enum EControlTags
 {
-  kCtrlTagMeter = 0,
+  kCtrlTagLoad = 0, // LoadStat values, while the UI's load panel is open
+};
+
+// Messages from the UI (SAMFUI, without data) and to it (SAMFD)
+enum EMsgTags
+{
+  kMsgTagLoadPanelOpened = 0,
+  kMsgTagLoadPanelClosed,
+  kMsgTagMeter,     // One MeterFrame per idle call, while the UI is open
 };
 
 class toast final : public Plugin
@@ -42,53 +60,34 @@ public:
     void OnActivate(bool active) override;
     
     void OnIdle() override;
+    bool OnMessage(int msgTag, int ctrlTag, int dataSize, const void* pData) override;
+    void OnUIOpen() override;
+    void OnUIClose() override;
 
 private:
-  iplug::IPeakSender<2> mSender;
-    TransformerTHD leftTHD;
-    TransformerTHD rightTHD;
+    void PublishParamTargets();
+    void PublishDetectorFilters();
+    void PublishBypassFade();
     
-    EnvelopeFollower mEnvelopeFollower;
+    ToastEngine mEngine;
     
-    // Parameter smoothing using LogParamSmooth
-    LogParamSmooth<double> mDriveSmooth;
-    LogParamSmooth<double> mOutputSmooth;
-    LogParamSmooth<double> mTHDAmountSmooth;
-    LogParamSmooth<double> mDynamicsSmooth;
-    LogParamSmooth<double> mMixSmooth;
+    // Levels of the front pair, measured while the UI is open and passed
+    // to OnIdle through a lock-free queue (half a second of frames)
+    Meter mMeter;
+    MeterQueue<MeterFrame, 32> mMeterQueue;
+    std::atomic<bool> mMetering{false};
     
-    // Parameter modulation system
-    float mEnvelopeValue = 0.0f;
-    float mModulatedTHDAmount = 0.0f;
+    // Times ProcessBlock while the UI's load panel is open
+    LoadMonitor mLoadMonitor;
+    iplug::ISender<kNumLoadStats> mLoadSender;
+    
+    // Envelope follows the sidechain bus when it is connected
+    std::atomic<bool> mUseSidechain{false};
     
     // User parameters
-    double mThresholdDb = -20.0;
-    double mAttackMs = 1.0;
-    double mReleaseMs = 120.0;
-    double mCurveValue = 0.5;
     bool mLinkGain = true;
     double mUserOutputDB = 0.0;
     
-    // Hardcoded THD settings
-    const double mWarmth = 1.0;
-    const double mAsymmetry = 0.75;
-    const double mHysteresis = 0.75;
-    
-    // Dry/wet gains
-    double mDryGain = 0.0;
-    double mWetGain = 1.0;
-    
     // Link recursion prevention
     bool mUpdatingLinkedParam = false;
-    
-    // Bypass handling
-    bool mHostIsActive = true;
-    bool mBypassState = false;
-    bool mBypassFading = false;
-    int mBypassFadeCounter = 0;
-    static constexpr int kBypassFadeSamples = 256;
-    
-    // DC blocking filter
-    DCBlocker<double, 2> mDCBlocker;
-    
 };
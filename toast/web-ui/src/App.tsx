@@ -1,5 +1,7 @@
 import { Component, onMount, onCleanup } from "solid-js";
 import { ParameterSlider } from "./components/ParameterSlider";
+import { LoadPanel } from "./components/LoadPanel";
+import { Meters } from "./components/Meters";
 import { ParameterIndex } from "./lib/parameter-store";
 import { initializeBridge, cleanupBridge } from "./lib/iplug-bridge";
 
@@ -36,6 +38,15 @@ const App: Component = () => {
 
             <ParameterSlider paramIdx={ParameterIndex.DRIVE} />
           </div>
+
+          <div class="p-4">
+            <Meters />
+          </div>
+
+          {/* Debug: processing time, measured only while open */}
+          <div class="p-4">
+            <LoadPanel />
+          </div>
         </div>
       </main>
     </>
@@ -0,0 +1,75 @@
+import { Component, createSignal, onCleanup, Show } from "solid-js";
+import {
+  type LoadStats,
+  onLoadUpdate,
+  setLoadPanelOpen,
+} from "../lib/iplug-bridge";
+
+// Debug panel: the plugin's processing time, timed only while it is open
+export const LoadPanel: Component = () => {
+  const [open, setOpen] = createSignal(false);
+  const [stats, setStats] = createSignal<LoadStats | null>(null);
+  // Since the panel was opened
+  const [xrunRiskBlocks, setXrunRiskBlocks] = createSignal(0);
+  const [spikeBlocks, setSpikeBlocks] = createSignal(0);
+
+  let unsubscribe: (() => void) | undefined;
+
+  const handleToggle = (event: Event) => {
+    const isOpen = (event.currentTarget as HTMLDetailsElement).open;
+    setOpen(isOpen);
+    unsubscribe?.();
+    unsubscribe = undefined;
+
+    if (isOpen) {
+      setStats(null);
+      setXrunRiskBlocks(0);
+      setSpikeBlocks(0);
+      unsubscribe = onLoadUpdate((update) => {
+        setStats(update);
+        setXrunRiskBlocks((n) => n + update.xrunRiskBlocks);
+        setSpikeBlocks((n) => n + update.spikeBlocks);
+      });
+    }
+    setLoadPanelOpen(isOpen);
+  };
+
+  onCleanup(() => {
+    unsubscribe?.();
+    if (open()) {
+      setLoadPanelOpen(false);
+    }
+  });
+
+  const row = (label: string, value: string) => (
+    <div class="flex justify-between">
+      <span>{label}</span>
+      <span class="font-mono">{value}</span>
+    </div>
+  );
+
+  return (
+    <details class="text-sm" onToggle={handleToggle}>
+      <summary class="cursor-pointer select-none">CPU load</summary>
+      <Show
+        when={stats()}
+        fallback={<div class="mt-2 text-gray-500">Waiting for audio</div>}
+      >
+        {(s) => (
+          <div class="mt-2 space-y-1">
+            {row("Load", `${s().averagePercent.toFixed(1)} %`)}
+            {row("Peak load", `${s().maxPercent.toFixed(1)} %`)}
+            {row("Block (avg)", `${s().averageMicros.toFixed(1)} µs`)}
+            {row(
+              "Block (min / max)",
+              `${s().minMicros.toFixed(1)} / ${s().maxMicros.toFixed(1)} µs`,
+            )}
+            {row("Blocks / update", `${s().blocks}`)}
+            {row("Xrun-risk blocks", `${xrunRiskBlocks()}`)}
+            {row("Spikes", `${spikeBlocks()}`)}
+          </div>
+        )}
+      </Show>
+    </details>
+  );
+};
@@ -0,0 +1,155 @@
+import {
+  Accessor,
+  Component,
+  createSignal,
+  Index,
+  onCleanup,
+  onMount,
+} from "solid-js";
+import { type MeterFrame, onMeterUpdate } from "../lib/iplug-bridge";
+
+// Scale of the level bars
+const MIN_DB = -60;
+const MAX_DB = 6;
+
+// Ballistics: peaks fall back at this rate, RMS is averaged over about
+// this long (the plugin's frames are one UI frame of audio each)
+const PEAK_FALL_DB_PER_SECOND = 20;
+const RMS_SECONDS = 0.3;
+
+const toDb = (amplitude: number) =>
+  amplitude > 0 ? 20 * Math.log10(amplitude) : -Infinity;
+
+const toPercent = (db: number) =>
+  Math.max(0, Math.min(1, (db - MIN_DB) / (MAX_DB - MIN_DB))) * 100;
+
+const formatDb = (db: number) => (db < MIN_DB ? "-inf" : db.toFixed(1));
+
+interface ChannelLevels {
+  peakDb: number;
+  rmsPower: number;
+}
+
+interface Levels {
+  input: [ChannelLevels, ChannelLevels];
+  output: [ChannelLevels, ChannelLevels];
+  truePeakDb: number; // Largest since the last reset (click to reset)
+  thdEnvelope: number;
+  thdAmount: number;
+}
+
+const silent = (): ChannelLevels => ({ peakDb: -Infinity, rmsPower: 0 });
+
+// Input and output level (RMS bar, peak line), the output true peak and
+// the THD activity
+export const Meters: Component = () => {
+  const [levels, setLevels] = createSignal<Levels>({
+    input: [silent(), silent()],
+    output: [silent(), silent()],
+    truePeakDb: -Infinity,
+    thdEnvelope: 0,
+    thdAmount: 0,
+  });
+  let lastUpdate = performance.now();
+
+  onMount(() => {
+    const unsubscribe = onMeterUpdate((frame: MeterFrame) => {
+      const now = performance.now();
+      const seconds = Math.min(1, (now - lastUpdate) / 1000);
+      lastUpdate = now;
+      const fall = PEAK_FALL_DB_PER_SECOND * seconds;
+      const rmsCoef = 1 - Math.exp(-seconds / RMS_SECONDS);
+
+      const follow = (
+        previous: ChannelLevels,
+        peak: number,
+        rms: number,
+      ): ChannelLevels => ({
+        peakDb: Math.max(toDb(peak), previous.peakDb - fall),
+        rmsPower: previous.rmsPower + (rms * rms - previous.rmsPower) * rmsCoef,
+      });
+
+      setLevels((previous) => ({
+        input: [
+          follow(previous.input[0], frame.inputPeak[0], frame.inputRms[0]),
+          follow(previous.input[1], frame.inputPeak[1], frame.inputRms[1]),
+        ],
+        output: [
+          follow(previous.output[0], frame.outputPeak[0], frame.outputRms[0]),
+          follow(previous.output[1], frame.outputPeak[1], frame.outputRms[1]),
+        ],
+        truePeakDb: Math.max(
+          previous.truePeakDb,
+          toDb(Math.max(frame.outputTruePeak[0], frame.outputTruePeak[1])),
+        ),
+        thdEnvelope: frame.thdEnvelope,
+        thdAmount: frame.thdAmount,
+      }));
+    });
+
+    onCleanup(unsubscribe);
+  });
+
+  const resetTruePeak = () =>
+    setLevels((previous) => ({ ...previous, truePeakDb: -Infinity }));
+
+  const bar = (channel: Accessor<ChannelLevels>) => (
+    <div class="relative h-2 w-full bg-gray-300 rounded">
+      <div
+        class="absolute h-full bg-gray-600 rounded"
+        style={{
+          width: `${toPercent(toDb(Math.sqrt(channel().rmsPower)))}%`,
+        }}
+      />
+      <div
+        class="absolute h-full w-0.5 bg-black"
+        style={{ left: `${toPercent(channel().peakDb)}%` }}
+      />
+    </div>
+  );
+
+  const pair = (
+    label: string,
+    channels: Accessor<[ChannelLevels, ChannelLevels]>,
+  ) => (
+    <div class="flex items-center gap-2">
+      <span class="w-10">{label}</span>
+      <div class="flex-1 space-y-1">
+        <Index each={channels()}>{(channel) => bar(channel)}</Index>
+      </div>
+      <span class="w-12 text-right font-mono">
+        {formatDb(Math.max(channels()[0].peakDb, channels()[1].peakDb))}
+      </span>
+    </div>
+  );
+
+  return (
+    <div class="space-y-2 text-sm">
+      {pair("IN", () => levels().input)}
+      {pair("OUT", () => levels().output)}
+      <div class="flex items-center gap-2">
+        <span class="w-10">THD</span>
+        <div class="relative h-2 flex-1 bg-gray-300 rounded">
+          <div
+            class="absolute h-full bg-gray-600 rounded"
+            style={{ width: `${levels().thdAmount * 100}%` }}
+          />
+          <div
+            class="absolute h-full bg-black rounded opacity-40"
+            style={{ width: `${levels().thdEnvelope * 100}%` }}
+          />
+        </div>
+        <span class="w-12 text-right font-mono">
+          {(levels().thdAmount * 100).toFixed(0)}%
+        </span>
+      </div>
+      <button
+        class="font-mono"
+        onClick={resetTruePeak}
+        title="True peak of the output; click to reset"
+      >
+        TP {formatDb(levels().truePeakDb)} dBTP
+      </button>
+    </div>
+  );
+};
@@ -5,13 +5,51 @@
 
 import { Parameters } from "./parameter-store";
 
+// Control tags matching EControlTags in toast.h
+export const ControlTag = {
+  LOAD: 0, // LoadStats, while the load panel is open
+} as const;
+
+// Message tags matching EMsgTags in toast.h
+const MessageTag = {
+  LOAD_PANEL_OPENED: 0,
+  LOAD_PANEL_CLOSED: 1,
+  METER: 2, // One MeterFrame per plugin idle call
+} as const;
+
+// Levels of the front pair ([left, right]) since the last frame, as linear
+// amplitudes (MeterFrame in Metering.h)
+export interface MeterFrame {
+  inputPeak: [number, number];
+  inputRms: [number, number];
+  outputPeak: [number, number];
+  outputRms: [number, number];
+  outputTruePeak: [number, number];
+  thdEnvelope: number; // envelope above the threshold, 0-1
+  thdAmount: number; // THD amount it drove, 0-1
+}
+
+// Processing load over one report interval (LoadStat in LoadMonitor.h)
+export interface LoadStats {
+  blocks: number;
+  averageMicros: number;
+  minMicros: number;
+  maxMicros: number;
+  averagePercent: number; // of the realtime budget
+  maxPercent: number;
+  xrunRiskBlocks: number;
+  spikeBlocks: number;
+}
+
 // Callback type for parameter updates
 type ParameterUpdateCallback = (paramIdx: number, displayValue: number) => void;
-type MeterUpdateCallback = (levels: number[]) => void;
+type MeterUpdateCallback = (frame: MeterFrame) => void;
+type LoadUpdateCallback = (stats: LoadStats) => void;
 
-// Store callbacks for parameter and meter updates
+// Store callbacks for parameter, meter and load updates
 let parameterUpdateCallbacks: ParameterUpdateCallback[] = [];
 let meterUpdateCallbacks: MeterUpdateCallback[] = [];
+let loadUpdateCallbacks: LoadUpdateCallback[] = [];
 
 /**
  * Convert normalized value (0-1) from plugin to display value
@@ -27,6 +65,10 @@ export function normalizedToDisplay(
     return normalizedValue > 0.5 ? 1 : 0;
   }
 
+  if (param.type === "enum") {
+    return Math.round(normalizedValue * (param.max - param.min) + param.min);
+  }
+
   return normalizedValue * (param.max - param.min) + param.min;
 }
 
@@ -61,6 +103,10 @@ export function formatParameterValue(
     return displayValue > 0.5 ? "ON" : "OFF";
   }
 
+  if (param.type === "enum" && param.labels) {
+    return param.labels[Math.round(displayValue)] ?? displayValue.toString();
+  }
+
   const decimals = param.step < 1 ? Math.abs(Math.log10(param.step)) : 0;
   const formatted = displayValue.toFixed(decimals);
   return param.unit ? `${formatted} ${param.unit}` : formatted;
@@ -108,6 +154,62 @@ export function endParameterAutomation(paramIdx: number): void {
   }
 }
 
+/**
+ * Tell the plugin whether the load panel is open; it only times its
+ * processing while it is
+ */
+export function setLoadPanelOpen(open: boolean): void {
+  if ((globalThis as any).IPlugSendMsg) {
+    (globalThis as any).IPlugSendMsg({
+      msg: "SAMFUI",
+      msgTag: open ? MessageTag.LOAD_PANEL_OPENED : MessageTag.LOAD_PANEL_CLOSED,
+      ctrlTag: -1,
+    });
+  }
+}
+
+/**
+ * Decode a base64 message payload for reading its fields
+ */
+function decodePayload(data: string): DataView {
+  const bytes = Uint8Array.from(atob(data), (c) => c.charCodeAt(0));
+  return new DataView(bytes.buffer);
+}
+
+/**
+ * Decode the values of an ISenderData (int ctrlTag, nChans, chanOffset,
+ * then nChans floats) from its base64 payload
+ */
+function decodeSenderValues(data: string): number[] {
+  const view = decodePayload(data);
+  const nChans = view.getInt32(4, true);
+  const values: number[] = [];
+  for (let i = 0; i < nChans && 12 + 4 * i + 4 <= view.byteLength; i++) {
+    values.push(view.getFloat32(12 + 4 * i, true));
+  }
+  return values;
+}
+
+/**
+ * Decode a MeterFrame: 12 floats, in the order of the struct
+ */
+function decodeMeterFrame(data: string): MeterFrame | null {
+  const view = decodePayload(data);
+  if (view.byteLength < 12 * 4) {
+    return null;
+  }
+  const f = (i: number) => view.getFloat32(4 * i, true);
+  return {
+    inputPeak: [f(0), f(1)],
+    inputRms: [f(2), f(3)],
+    outputPeak: [f(4), f(5)],
+    outputRms: [f(6), f(7)],
+    outputTruePeak: [f(8), f(9)],
+    thdEnvelope: f(10),
+    thdAmount: f(11),
+  };
+}
+
 /**
  * Register callback for parameter updates
  */
@@ -140,6 +242,21 @@ export function onMeterUpdate(callback: MeterUpdateCallback): () => void {
   };
 }
 
+/**
+ * Register callback for load updates (while the load panel is open)
+ */
+export function onLoadUpdate(callback: LoadUpdateCallback): () => void {
+  loadUpdateCallbacks.push(callback);
+
+  // Return unsubscribe function
+  return () => {
+    const index = loadUpdateCallbacks.indexOf(callback);
+    if (index > -1) {
+      loadUpdateCallbacks.splice(index, 1);
+    }
+  };
+}
+
 /**
  * Initialize the iPlug2 communication bridge
  * Must be called once when the app starts
@@ -161,14 +278,25 @@ export function initializeBridge(): boolean {
     });
   };
 
-  // Set up meter data handler
-  (globalThis as any).SAMFD = (dataArray: number[]) => {
-    console.log("Meter levels:", dataArray);
+  // Set up arbitrary message handler: the meters, one binary frame per
+  // plugin idle call
+  (globalThis as any).SAMFD = (
+    msgTag: number,
+    dataSize: number,
+    data: string,
+  ) => {
+    if (msgTag === MessageTag.METER) {
+      const frame = decodeMeterFrame(data);
+      if (frame) {
+        // Notify all registered callbacks
+        meterUpdateCallbacks.forEach((callback) => {
+          callback(frame);
+        });
+      }
+      return;
+    }
 
-    // Notify all registered callbacks
-    meterUpdateCallbacks.forEach((callback) => {
-      callback(dataArray);
-    });
+    console.log("Arbitrary message:", { msgTag, dataSize, data });
   };
 
   // Set up other required handlers
@@ -178,6 +306,33 @@ export function initializeBridge(): boolean {
     dataSize: number,
     data: any,
   ) => {
+    if (ctrlTag === ControlTag.LOAD) {
+      const [
+        blocks,
+        averageMicros,
+        minMicros,
+        maxMicros,
+        averagePercent,
+        maxPercent,
+        xrunRiskBlocks,
+        spikeBlocks,
+      ] = decodeSenderValues(data);
+      const stats: LoadStats = {
+        blocks,
+        averageMicros,
+        minMicros,
+        maxMicros,
+        averagePercent,
+        maxPercent,
+        xrunRiskBlocks,
+        spikeBlocks,
+      };
+      loadUpdateCallbacks.forEach((callback) => {
+        callback(stats);
+      });
+      return;
+    }
+
     console.log("Control message:", { ctrlTag, msgTag, dataSize, data });
   };
 
@@ -233,4 +388,5 @@ export function cleanupBridge(): void {
   // Clear callbacks
   parameterUpdateCallbacks = [];
   meterUpdateCallbacks = [];
+  loadUpdateCallbacks = [];
 }
@@ -14,6 +14,17 @@ export const ParameterIndex = {
   MIX: 7, // Dry/wet mix
   OUTPUT: 8, // Output gain
   LINK_GAIN: 9, // Link input/output gains (boolean)
+  OVERSAMPLING: 10, // Oversampling factor (Off/2x/4x/8x)
+  OVERSAMPLING_FILTER: 11, // Oversampling filter (min/linear phase)
+  LOOKAHEAD: 12, // Envelope detector lookahead (adds latency)
+  SIDECHAIN: 13, // Envelope follows the sidechain bus (boolean)
+  DETECTOR_HPF: 14, // Detector high-pass (off at 20 Hz)
+  DETECTOR_LPF: 15, // Detector low-pass (off at 20 kHz)
+  ENVELOPE_LINK: 16, // Envelope per channel, linked or per layout group
+  BYPASS_FADE: 17, // Bypass crossfade length
+  BYPASS_CURVE: 18, // Bypass crossfade curve
+  ANTIALIASING: 19, // Antiderivative antialiasing (Off/1st/2nd order)
+  MODEL: 20, // Transformer model (Classic/Magnetic)
 } as const;
 
 // Parameter type definitions
@@ -25,8 +36,9 @@ export interface ParameterConfig {
   default: number;
   step: number;
   unit: string;
-  type: "continuous" | "boolean";
+  type: "continuous" | "boolean" | "enum";
   scaling?: "linear" | "exponential" | "discrete";
+  labels?: string[]; // Display names for enum values
   group: string;
 }
 
@@ -56,6 +68,19 @@ export const Parameters: Record<number, ParameterConfig> = {
     scaling: "linear",
     group: "saturation",
   },
+  [ParameterIndex.MODEL]: {
+    name: "Model",
+    displayName: "MODEL",
+    min: 0,
+    max: 1,
+    default: 0,
+    step: 1,
+    unit: "",
+    type: "enum",
+    scaling: "discrete",
+    labels: ["Classic", "Magnetic"],
+    group: "saturation",
+  },
   [ParameterIndex.DYNAMICS]: {
     name: "Dynamics",
     displayName: "DYNAMICS",
@@ -152,6 +177,131 @@ export const Parameters: Record<number, ParameterConfig> = {
     scaling: "discrete",
     group: "output",
   },
+  [ParameterIndex.OVERSAMPLING]: {
+    name: "Oversampling",
+    displayName: "OVERSAMPLING",
+    min: 0,
+    max: 3,
+    default: 0,
+    step: 1,
+    unit: "",
+    type: "enum",
+    scaling: "discrete",
+    labels: ["Off", "2x", "4x", "8x"],
+    group: "quality",
+  },
+  [ParameterIndex.OVERSAMPLING_FILTER]: {
+    name: "OS Filter",
+    displayName: "OS FILTER",
+    min: 0,
+    max: 1,
+    default: 0,
+    step: 1,
+    unit: "",
+    type: "enum",
+    scaling: "discrete",
+    labels: ["Min Phase", "Linear Phase"],
+    group: "quality",
+  },
+  [ParameterIndex.ANTIALIASING]: {
+    name: "Antialiasing",
+    displayName: "ANTIALIAS",
+    min: 0,
+    max: 2,
+    default: 0,
+    step: 1,
+    unit: "",
+    type: "enum",
+    scaling: "discrete",
+    labels: ["Off", "ADAA 1st", "ADAA 2nd"],
+    group: "quality",
+  },
+  [ParameterIndex.LOOKAHEAD]: {
+    name: "Lookahead",
+    displayName: "LOOKAHEAD",
+    min: 0.0,
+    max: 10.0,
+    default: 0.0,
+    step: 0.1,
+    unit: "ms",
+    type: "continuous",
+    scaling: "linear",
+    group: "dynamics",
+  },
+  [ParameterIndex.SIDECHAIN]: {
+    name: "Sidechain",
+    displayName: "SIDECHAIN",
+    min: 0,
+    max: 1,
+    default: 0,
+    step: 1,
+    unit: "",
+    type: "boolean",
+    scaling: "discrete",
+    group: "dynamics",
+  },
+  [ParameterIndex.DETECTOR_HPF]: {
+    name: "Detector HPF",
+    displayName: "DET HPF",
+    min: 20.0,
+    max: 2000.0,
+    default: 20.0,
+    step: 1.0,
+    unit: "Hz",
+    type: "continuous",
+    scaling: "exponential",
+    group: "dynamics",
+  },
+  [ParameterIndex.DETECTOR_LPF]: {
+    name: "Detector LPF",
+    displayName: "DET LPF",
+    min: 200.0,
+    max: 20000.0,
+    default: 20000.0,
+    step: 1.0,
+    unit: "Hz",
+    type: "continuous",
+    scaling: "exponential",
+    group: "dynamics",
+  },
+  [ParameterIndex.ENVELOPE_LINK]: {
+    name: "Envelope Link",
+    displayName: "ENV LINK",
+    min: 0,
+    max: 2,
+    default: 0,
+    step: 1,
+    unit: "",
+    type: "enum",
+    scaling: "discrete",
+    labels: ["Max", "Per Channel", "Grouped"],
+    group: "dynamics",
+  },
+  [ParameterIndex.BYPASS_FADE]: {
+    name: "Bypass Fade",
+    displayName: "BYP FADE",
+    min: 1.0,
+    max: 50.0,
+    default: 5.0,
+    step: 0.1,
+    unit: "ms",
+    type: "continuous",
+    scaling: "linear",
+    group: "output",
+  },
+  [ParameterIndex.BYPASS_CURVE]: {
+    name: "Bypass Curve",
+    displayName: "BYP CURVE",
+    min: 0,
+    max: 2,
+    default: 2,
+    step: 1,
+    unit: "",
+    type: "enum",
+    scaling: "discrete",
+    labels: ["Equal Power", "Linear", "Raised Cosine"],
+    group: "output",
+  },
 };
 
 // checks to see if parameter is boolean